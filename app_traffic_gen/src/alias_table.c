@@ -0,0 +1,85 @@
+/*
+ * Construction of Walker alias tables using Vose's method. Done in integer
+ * arithmetic, scaled so that the total weight represents one full entry.
+ */
+#include <stdint.h>
+#include "alias_table.h"
+
+/* Working space for building a table. Tables are only ever built by the
+ * command handler, so this is kept out of the stack of every caller. */
+static unsigned long long prob[ALIAS_TABLE_MAX_ENTRIES];
+static unsigned short small[ALIAS_TABLE_MAX_ENTRIES];
+static unsigned short large[ALIAS_TABLE_MAX_ENTRIES];
+
+/* A weight shifted down, keeping those above zero from becoming zero */
+static inline unsigned long long scaled_weight(int weight, unsigned shift)
+{
+  if (weight <= 0)
+    return 0;
+  unsigned long long scaled = (unsigned)weight >> shift;
+  return scaled ? scaled : 1;
+}
+
+unsigned alias_table_build(alias_entry_t table[], const int weights[], unsigned count)
+{
+  unsigned num_small = 0;
+  unsigned num_large = 0;
+  unsigned long long total = 0;
+  unsigned shift = 0;
+
+  if (count > ALIAS_TABLE_MAX_ENTRIES)
+    count = ALIAS_TABLE_MAX_ENTRIES;
+
+  for (unsigned i = 0; i < count; i++)
+    total += scaled_weight(weights[i], 0);
+
+  if (total == 0)
+    return 0;
+
+  // Large weights are shifted down until every scaled weight fits in a word, as the thresholds need
+  while (((total >> shift) + count) * count > 0xffffffff)
+    shift++;
+  if (shift) {
+    total = 0;
+    for (unsigned i = 0; i < count; i++)
+      total += scaled_weight(weights[i], shift);
+  }
+
+  // Scale each weight by the entry count so that 'total' is the height of one entry
+  for (unsigned i = 0; i < count; i++) {
+    prob[i] = scaled_weight(weights[i], shift) * count;
+    if (prob[i] < total)
+      small[num_small++] = i;
+    else
+      large[num_large++] = i;
+  }
+
+  while (num_small && num_large) {
+    unsigned s = small[--num_small];
+    unsigned l = large[--num_large];
+
+    table[s].threshold = (unsigned)((prob[s] << 32) / total);
+    table[s].alias = l;
+
+    // The large entry fills the rest of the small entry's column
+    prob[l] -= total - prob[s];
+    if (prob[l] < total)
+      small[num_small++] = l;
+    else
+      large[num_large++] = l;
+  }
+
+  // Whatever is left is full, subject to rounding, and always chooses itself
+  while (num_large) {
+    unsigned l = large[--num_large];
+    table[l].threshold = 0xffffffff;
+    table[l].alias = l;
+  }
+  while (num_small) {
+    unsigned s = small[--num_small];
+    table[s].threshold = 0xffffffff;
+    table[s].alias = s;
+  }
+
+  return (unsigned)total;
+}
@@ -0,0 +1,43 @@
+#ifndef __ALIAS_TABLE_H__
+#define __ALIAS_TABLE_H__
+
+#include <stdint.h>
+
+/*
+ * Walker alias tables allow a weighted choice to be made with a single random
+ * number and a constant amount of work, however many choices there are.
+ *
+ * The random number is multiplied by the number of entries: the top word of the
+ * product selects an entry and the bottom word is compared with the entry's
+ * threshold to decide between the entry itself and its alias.
+ */
+/* The largest table that can be built, which sizes the working space used to build one */
+#ifndef ALIAS_TABLE_MAX_ENTRIES
+#define ALIAS_TABLE_MAX_ENTRIES 64
+#endif
+
+typedef struct alias_entry_t {
+  unsigned threshold;
+  unsigned alias;
+} alias_entry_t;
+
+/*
+ * Build the table for the given weights, which are shifted down together when
+ * their sum times the count would not fit in a word. Returns the sum of the
+ * weights as used; when that is zero the table is not usable and nothing should
+ * be sampled from it.
+ */
+unsigned alias_table_build(alias_entry_t table[], const int weights[], unsigned count);
+
+#ifndef __XC__
+static inline unsigned alias_table_sample(const alias_entry_t table[], unsigned count, unsigned random)
+{
+  unsigned long long scaled = (unsigned long long)random * count;
+  unsigned index = (unsigned)(scaled >> 32);
+  if ((unsigned)scaled < table[index].threshold)
+    return index;
+  return table[index].alias;
+}
+#endif
+
+#endif // __ALIAS_TABLE_H__
@@ -0,0 +1,101 @@
+/*
+ * Buffer management library. There is one structure to
+ * track free buffer pointers and one for used buffer pointers.
+ */
+#include <xccompat.h>
+#include "buffers.h"
+
+/* Declared as words so that every buffer is word aligned */
+unsigned int g_buffer[(MAX_BUFFER_SIZE * BUFFER_COUNT) / sizeof(unsigned int)];
+
+/* Each count is only written by one task, so they are updated without locks */
+static volatile buffers_stats_t g_buffers_stats;
+static volatile unsigned g_generator_starved[GENERATOR_PRODUCERS];
+
+void buffers_free_initialise(REFERENCE_PARAM(buffers_free_t, free))
+{
+  free->top_index = BUFFER_COUNT;
+
+  free->stack[0] = (uintptr_t)g_buffer;
+  for (unsigned i = 1; i < BUFFER_COUNT; i++)
+    free->stack[i] = free->stack[i - 1] + MAX_BUFFER_SIZE;
+}
+
+uintptr_t buffers_free_acquire(REFERENCE_PARAM(buffers_free_t, free))
+{
+  free->top_index--;
+  uintptr_t buffer = free->stack[free->top_index];
+  return buffer;
+}
+
+void buffers_free_release(REFERENCE_PARAM(buffers_free_t, free), uintptr_t buffer)
+{
+  free->stack[free->top_index] = buffer;
+  free->top_index++;
+}
+
+void buffers_used_initialise(REFERENCE_PARAM(buffers_used_t, used))
+{
+  used->head_index = 0;
+  used->tail_index = 0;
+}
+
+void buffers_used_add(REFERENCE_PARAM(buffers_used_t, used), uintptr_t buffer, unsigned length_in_bytes)
+{
+  unsigned index = used->head_index % BUFFER_COUNT;
+  used->pointers[index] = buffer;
+  used->length_in_bytes[index] = length_in_bytes;
+  used->head_index++;
+}
+
+uintptr_t buffers_used_take(REFERENCE_PARAM(buffers_used_t, used), REFERENCE_PARAM(unsigned, length_in_bytes))
+{
+  unsigned index = used->tail_index % BUFFER_COUNT;
+  used->tail_index++;
+  *length_in_bytes = used->length_in_bytes[index];
+  return used->pointers[index];
+}
+
+int buffers_used_full(REFERENCE_PARAM(buffers_used_t, used))
+{
+  return (used->head_index - used->tail_index) == BUFFER_COUNT;
+}
+
+unsigned buffers_used_head_train(REFERENCE_PARAM(buffers_used_t, used))
+{
+  unsigned index = used->tail_index % BUFFER_COUNT;
+  return used->length_in_bytes[index] >> BUFFER_TRAIN_SHIFT;
+}
+
+void buffers_stats_generator_starved(unsigned producer)
+{
+  g_generator_starved[producer]++;
+}
+
+void buffers_stats_transmitter_starved(void)
+{
+  g_buffers_stats.transmitter_starved++;
+}
+
+void buffers_stats_queued(unsigned queued)
+{
+  if (queued > g_buffers_stats.max_queued)
+    g_buffers_stats.max_queued = queued;
+}
+
+void buffers_stats_get(REFERENCE_PARAM(buffers_stats_t, stats))
+{
+  stats->generator_starved = 0;
+  for (unsigned i = 0; i < GENERATOR_PRODUCERS; i++)
+    stats->generator_starved += g_generator_starved[i];
+  stats->transmitter_starved = g_buffers_stats.transmitter_starved;
+  stats->max_queued = g_buffers_stats.max_queued;
+}
+
+void buffers_stats_reset(void)
+{
+  for (unsigned i = 0; i < GENERATOR_PRODUCERS; i++)
+    g_generator_starved[i] = 0;
+  g_buffers_stats.transmitter_starved = 0;
+  g_buffers_stats.max_queued = 0;
+}
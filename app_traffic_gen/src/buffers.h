@@ -2,24 +2,67 @@
 #define __BUFFERS_H__
 
 #include <stdint.h>
+#include <xccompat.h>
 
 /*
- * Define the number of buffers available
+ * The number of buffers in the pool. Each takes MAX_BUFFER_SIZE bytes of SRAM on
+ * the generation tile; use the starvation counts to choose the depth needed.
  */
+#ifndef BUFFER_COUNT
 #define BUFFER_COUNT 6
+#endif
+
+/*
+ * The number of buffers the buffer manager lets the transmitter have at once. The
+ * transmitter queues them by traffic class, so with fewer a class waiting for
+ * credit could hold up the others. Not used with the descriptor rings.
+ */
+#ifndef BUFFERS_IN_FLIGHT
+#define BUFFERS_IN_FLIGHT (BUFFER_COUNT - 2)
+#endif
+
+/*
+ * The number of generator tasks filling buffers at once, each with a share of the
+ * pool. More than one needs the descriptor rings, see descriptor_ring.h.
+ */
+#ifndef GENERATOR_PRODUCERS
+#define GENERATOR_PRODUCERS 1
+#endif
+
+#if (GENERATOR_PRODUCERS < 1) || (GENERATOR_PRODUCERS > 4)
+#error "GENERATOR_PRODUCERS must be from 1 to 4"
+#endif
 
 /* Enough room to cope with a double VLAN-tagged packet */
-#define BUFFER_OVERHEAD_BYTES	4 //to hold delay value
+#define BUFFER_OVERHEAD_BYTES	24 //to hold frame period, the id of the header, the payload pattern and the traffic class in the buffer
 #define MAX_BUFFER_SIZE (1524+BUFFER_OVERHEAD_BYTES)
 
+/*
+ * The length passed to the buffer manager with the first frame of a train also
+ * holds the number of frames in the train. The train is not passed on to the
+ * transmitter until all its frames are queued (or the pool is exhausted).
+ */
+#define BUFFER_TRAIN_SHIFT 16
+#define BUFFER_LENGTH_MASK ((1 << BUFFER_TRAIN_SHIFT) - 1)
+
+/*
+ * The frames filled for the replay ring are marked in their length, which is never
+ * this long, so that the transmitter keeps them rather than sending them once. The
+ * last marks the end of the ring. See replay.h.
+ */
+#define BUFFER_REPLAY       (1 << 15)
+#define BUFFER_REPLAY_LAST  (1 << 14)
+#define BUFFER_REPLAY_PATCH (1 << 13)
+#define BUFFER_REPLAY_FLAGS (BUFFER_REPLAY | BUFFER_REPLAY_LAST | BUFFER_REPLAY_PATCH)
+
 typedef struct buffers_free_t {
   unsigned top_index;
   uintptr_t stack[BUFFER_COUNT];
 } buffers_free_t;
 
-void buffers_free_initialise(buffers_free_t &free);
-uintptr_t buffers_free_acquire(buffers_free_t &free);
-void buffers_free_release(buffers_free_t &free, uintptr_t buffer);
+void buffers_free_initialise(REFERENCE_PARAM(buffers_free_t, free));
+uintptr_t buffers_free_acquire(REFERENCE_PARAM(buffers_free_t, free));
+void buffers_free_release(REFERENCE_PARAM(buffers_free_t, free), uintptr_t buffer);
 
 typedef struct buffers_used_t {
   unsigned tail_index;
@@ -28,13 +71,29 @@ typedef struct buffers_used_t {
   uintptr_t length_in_bytes[BUFFER_COUNT];
 } buffers_used_t;
 
-void buffers_used_initialise(buffers_used_t &used);
-void buffers_used_add(buffers_used_t &used, uintptr_t buffer, unsigned length_in_bytes);
-int buffers_used_full(buffers_used_t &used);
+void buffers_used_initialise(REFERENCE_PARAM(buffers_used_t, used));
+void buffers_used_add(REFERENCE_PARAM(buffers_used_t, used), uintptr_t buffer, unsigned length_in_bytes);
+uintptr_t buffers_used_take(REFERENCE_PARAM(buffers_used_t, used), REFERENCE_PARAM(unsigned, length_in_bytes));
+int buffers_used_full(REFERENCE_PARAM(buffers_used_t, used));
+unsigned buffers_used_head_train(REFERENCE_PARAM(buffers_used_t, used));
 
-#ifdef __XC__
-{uintptr_t, unsigned} buffers_used_take(buffers_used_t &used);
-#endif
+/*
+ * Counts of the times the generator had a frame to fill but no free buffer and of
+ * the times the transmitter finished a frame with no other queued, along with the
+ * most frames that have been queued at once. Each producer counts its own waits
+ * and they are added together when read.
+ */
+typedef struct buffers_stats_t {
+  unsigned generator_starved;
+  unsigned transmitter_starved;
+  unsigned max_queued;
+} buffers_stats_t;
+
+void buffers_stats_generator_starved(unsigned producer);
+void buffers_stats_transmitter_starved(void);
+void buffers_stats_queued(unsigned queued);
+void buffers_stats_get(REFERENCE_PARAM(buffers_stats_t, stats));
+void buffers_stats_reset(void);
 
 
 #endif // __BUFFERS_H__
@@ -0,0 +1,53 @@
+/*
+ * Reassembly and checking of configuration uploads from the host.
+ */
+#include "config_upload.h"
+#include "debug_print.h"
+
+void config_upload_data(config_upload_t *upload, unsigned offset, const uint32_t words[], unsigned count)
+{
+  if (offset == 0) {
+    upload->length = 0;
+    upload->broken = 0;
+    upload->pending = 0;
+  }
+
+  if (upload->broken || offset != upload->length || count > PROTOCOL_UPLOAD_WORDS - offset) {
+    upload->broken = 1;
+    return;
+  }
+
+  for (unsigned i = 0; i < count; i++)
+    upload->words[offset + i] = words[i];
+  upload->length = offset + count;
+}
+
+int config_upload_check(config_upload_t *upload, const protocol_commit_t *commit)
+{
+  uint32_t checksum = 0;
+  unsigned position = 0;
+  unsigned records = 0;
+
+  upload->pending = 0;
+
+  if (upload->broken || commit->words != upload->length) {
+    debug_printf("Upload rejected: %d of %d words received in order (at most %d)\n",
+        upload->broken ? 0 : upload->length, commit->words, PROTOCOL_UPLOAD_WORDS);
+    upload->length = 0;
+    return 0;
+  }
+
+  for (unsigned i = 0; i < upload->length; i++)
+    checksum = protocol_checksum(checksum, upload->words[i]);
+
+  // Every record must end within the upload
+  while (config_records_next(upload->words, upload->length, &position))
+    records++;
+
+  if (checksum != commit->checksum || position != upload->length || records != commit->records) {
+    debug_printf("Upload rejected: the checksum or records do not match\n");
+    upload->length = 0;
+    return 0;
+  }
+  return 1;
+}
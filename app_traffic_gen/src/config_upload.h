@@ -0,0 +1,49 @@
+#ifndef __CONFIG_UPLOAD_H__
+#define __CONFIG_UPLOAD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "host_protocol.h"
+
+/*
+ * The records of a configuration upload, see host_protocol.h. Data messages fill
+ * the upload in order and a commit checks that it arrived whole. The records are
+ * then pending until the packet controller applies them at a swap. Only used by
+ * the task that handles the host's messages.
+ */
+typedef struct config_upload_t {
+  uint32_t words[PROTOCOL_UPLOAD_WORDS];
+  unsigned length;
+  int broken;  // Data was lost, out of order or too long since the upload started
+  int pending; // Committed and waiting for the next swap
+} config_upload_t;
+
+/* Add the data of a message, an offset of zero starts a new upload */
+void config_upload_data(config_upload_t *upload, unsigned offset, const uint32_t words[], unsigned count);
+
+/*
+ * Check that the upload holds exactly the words and records of the commit. Returns
+ * 0 with the reason printed if not, in which case the upload is dropped.
+ */
+int config_upload_check(config_upload_t *upload, const protocol_commit_t *commit);
+
+/*
+ * Step through the records of a checked upload, or of any other whole records.
+ * Returns the next record, with its arguments following, or NULL after the last.
+ */
+static inline const protocol_record_t *config_records_next(const uint32_t words[], unsigned length,
+    unsigned *position)
+{
+  if (*position >= length)
+    return NULL;
+  const protocol_record_t *record = (const protocol_record_t *)&words[*position];
+  *position += 1 + record->args;
+  return record;
+}
+
+static inline const uint32_t *config_record_args(const protocol_record_t *record)
+{
+  return (const uint32_t *)(record + 1);
+}
+
+#endif // __CONFIG_UPLOAD_H__
@@ -0,0 +1,120 @@
+/*
+ * The descriptor rings shared by the producers and transmitter. Buffers go round
+ * from a producer's free ring to the producer, to its ready ring, to the
+ * transmitter and back to the same free ring. Each pair of rings can hold every
+ * buffer so pushes cannot fail.
+ */
+#include <xccompat.h>
+#include "xassert.h"
+#include "descriptor_ring.h"
+
+extern unsigned int g_buffer[];
+
+static descriptor_ring_t g_free_rings[GENERATOR_PRODUCERS];
+static descriptor_ring_t g_ready_rings[GENERATOR_PRODUCERS];
+
+/* The producer each buffer belongs to and the number of buffers each has */
+static unsigned char g_owner[BUFFER_COUNT];
+static unsigned g_share[GENERATOR_PRODUCERS];
+static unsigned g_producers = 1;
+
+/* Only used by the transmitter: the producer to take from next and what is left of its train */
+static unsigned g_next_producer = 0;
+static unsigned g_train_left = 0;
+
+static inline unsigned buffer_owner(uintptr_t dptr)
+{
+  return g_owner[(dptr - (uintptr_t)g_buffer) / MAX_BUFFER_SIZE];
+}
+
+void descriptor_rings_init(unsigned producers)
+{
+  buffers_free_t free_buffers;
+  buffers_free_initialise(&free_buffers);
+
+  g_producers = producers;
+  g_next_producer = 0;
+  g_train_left = 0;
+  for (unsigned i = 0; i < GENERATOR_PRODUCERS; i++) {
+    g_free_rings[i].head = g_free_rings[i].tail = 0;
+    g_ready_rings[i].head = g_ready_rings[i].tail = 0;
+    g_share[i] = 0;
+  }
+
+  // Deal the buffers out in turn, so the shares differ by at most one
+  for (unsigned i = 0; free_buffers.top_index; i++) {
+    uintptr_t dptr = buffers_free_acquire(&free_buffers);
+    unsigned producer = i % producers;
+    g_owner[(dptr - (uintptr_t)g_buffer) / MAX_BUFFER_SIZE] = producer;
+    g_share[producer]++;
+    descriptor_ring_push(&g_free_rings[producer], dptr, 0);
+  }
+}
+
+int descriptor_rings_acquire(unsigned producer, REFERENCE_PARAM(uintptr_t, dptr))
+{
+  unsigned length_in_bytes;
+  return descriptor_ring_pop(&g_free_rings[producer], dptr, &length_in_bytes);
+}
+
+void descriptor_rings_submit(unsigned producer, uintptr_t dptr, unsigned length_in_bytes)
+{
+  if (!descriptor_ring_push(&g_ready_rings[producer], dptr, length_in_bytes))
+    assert(0);
+}
+
+/* Take the next buffer from a producer's ready ring, counting what is still queued */
+static inline void take_from(unsigned producer, uintptr_t *dptr, unsigned *length_in_bytes)
+{
+  unsigned queued = 0;
+
+  descriptor_ring_pop(&g_ready_rings[producer], dptr, length_in_bytes);
+  for (unsigned i = 0; i < g_producers; i++)
+    queued += descriptor_ring_count(&g_ready_rings[i]);
+  buffers_stats_queued(queued + 1);
+}
+
+int descriptor_rings_take(REFERENCE_PARAM(uintptr_t, dptr), REFERENCE_PARAM(unsigned, length_in_bytes))
+{
+  unsigned producer = g_next_producer;
+
+  // The rest of a train comes from the producer it started with
+  if (g_train_left) {
+    if (!descriptor_ring_count(&g_ready_rings[producer]))
+      return 0;
+    take_from(producer, dptr, length_in_bytes);
+    *length_in_bytes &= BUFFER_LENGTH_MASK;
+    if (--g_train_left == 0)
+      g_next_producer = (producer + 1 == g_producers) ? 0 : producer + 1;
+    return 1;
+  }
+
+  for (unsigned i = 0; i < g_producers; i++) {
+    descriptor_ring_t *ring = &g_ready_rings[producer];
+    unsigned ready = descriptor_ring_count(ring);
+
+    if (ready) {
+      // Hold a train back until it is all queued, or as much of it as the producer's buffers allow
+      unsigned train = descriptor_ring_peek_length(ring) >> BUFFER_TRAIN_SHIFT;
+      if ((ready >= train) || (ready >= g_share[producer])) {
+        take_from(producer, dptr, length_in_bytes);
+        *length_in_bytes &= BUFFER_LENGTH_MASK;
+        if (train > 1) {
+          g_next_producer = producer;
+          g_train_left = train - 1;
+        } else {
+          g_next_producer = (producer + 1 == g_producers) ? 0 : producer + 1;
+        }
+        return 1;
+      }
+    }
+    producer = (producer + 1 == g_producers) ? 0 : producer + 1;
+  }
+  return 0;
+}
+
+void descriptor_rings_release(uintptr_t dptr)
+{
+  if (!descriptor_ring_push(&g_free_rings[buffer_owner(dptr)], dptr, 0))
+    assert(0);
+}
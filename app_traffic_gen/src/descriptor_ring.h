@@ -0,0 +1,143 @@
+#ifndef __DESCRIPTOR_RING_H__
+#define __DESCRIPTOR_RING_H__
+
+#include <stdint.h>
+#include <xccompat.h>
+#include "buffers.h"
+
+/*
+ * Lock-free single-producer/single-consumer rings of buffer descriptors. When
+ * USE_DESCRIPTOR_RINGS is set the generator and transmitter hand buffers to each
+ * other through a pair of rings in memory shared on the tile instead of through
+ * the buffer manager, which frees its logical core and the channel round trips.
+ *
+ * Each ring index is only ever written by one side: the producer writes the
+ * entry and then publishes it by advancing the head, the consumer reads the
+ * entry and then hands the slot back by advancing the tail.
+ *
+ * With more than one generator task (GENERATOR_PRODUCERS) each has a pair of
+ * rings and a share of the pool of its own, so every ring still has a single
+ * writer at each end. The transmitter takes from the producers in turn and gives
+ * each buffer back to the producer it came from.
+ */
+#ifndef USE_DESCRIPTOR_RINGS
+#define USE_DESCRIPTOR_RINGS 0
+#endif
+
+// Must be a power of two and big enough to hold every buffer
+#ifndef DESCRIPTOR_RING_SIZE
+#if BUFFER_COUNT <= 8
+#define DESCRIPTOR_RING_SIZE 8
+#elif BUFFER_COUNT <= 16
+#define DESCRIPTOR_RING_SIZE 16
+#elif BUFFER_COUNT <= 32
+#define DESCRIPTOR_RING_SIZE 32
+#else
+#define DESCRIPTOR_RING_SIZE 64
+#endif
+#endif
+
+#if (GENERATOR_PRODUCERS > 1) && !USE_DESCRIPTOR_RINGS
+#error "More than one generator producer needs USE_DESCRIPTOR_RINGS"
+#endif
+
+#if BUFFER_COUNT < 2 * GENERATOR_PRODUCERS
+#error "Each generator producer needs at least two buffers"
+#endif
+
+#if (DESCRIPTOR_RING_SIZE < BUFFER_COUNT) || (DESCRIPTOR_RING_SIZE & (DESCRIPTOR_RING_SIZE - 1))
+#error "DESCRIPTOR_RING_SIZE must be a power of two of at least BUFFER_COUNT"
+#endif
+
+#ifdef __xcore__
+// Memory on a tile is not cached and accesses complete in order, so only the compiler needs fencing
+#define RING_RELEASE() asm volatile("" ::: "memory")
+#define RING_ACQUIRE() asm volatile("" ::: "memory")
+#else
+#define RING_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define RING_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+typedef struct descriptor_t {
+  uintptr_t dptr;
+  unsigned length_in_bytes;
+} descriptor_t;
+
+typedef struct descriptor_ring_t {
+  volatile unsigned head;
+  volatile unsigned tail;
+  descriptor_t entries[DESCRIPTOR_RING_SIZE];
+} descriptor_ring_t;
+
+#ifndef __XC__
+static inline unsigned descriptor_ring_count(const descriptor_ring_t *ring)
+{
+  return ring->head - ring->tail;
+}
+
+static inline int descriptor_ring_push(descriptor_ring_t *ring, uintptr_t dptr, unsigned length_in_bytes)
+{
+  unsigned head = ring->head;
+  if (head - ring->tail == DESCRIPTOR_RING_SIZE)
+    return 0;
+
+  descriptor_t *entry = &ring->entries[head & (DESCRIPTOR_RING_SIZE - 1)];
+  entry->dptr = dptr;
+  entry->length_in_bytes = length_in_bytes;
+
+  // The entry must be complete before it is published
+  RING_RELEASE();
+  ring->head = head + 1;
+  return 1;
+}
+
+/* The length of the oldest entry, which must have been seen with descriptor_ring_count() */
+static inline unsigned descriptor_ring_peek_length(const descriptor_ring_t *ring)
+{
+  // Do not read the entry before seeing it published
+  RING_ACQUIRE();
+  return ring->entries[ring->tail & (DESCRIPTOR_RING_SIZE - 1)].length_in_bytes;
+}
+
+static inline int descriptor_ring_pop(descriptor_ring_t *ring, uintptr_t *dptr, unsigned *length_in_bytes)
+{
+  unsigned tail = ring->tail;
+  if (ring->head == tail)
+    return 0;
+
+  // Do not read the entry before seeing it published
+  RING_ACQUIRE();
+  descriptor_t *entry = &ring->entries[tail & (DESCRIPTOR_RING_SIZE - 1)];
+  *dptr = entry->dptr;
+  *length_in_bytes = entry->length_in_bytes;
+
+  // The entry must be read before its slot is handed back
+  RING_RELEASE();
+  ring->tail = tail + 1;
+  return 1;
+}
+#endif //__XC__
+
+/*
+ * The rings shared by the given number of producers, at most GENERATOR_PRODUCERS,
+ * and the transmitter, with the pool split between the producers. Must be
+ * initialised before any producer acquires its first buffer.
+ */
+void descriptor_rings_init(unsigned producers);
+
+// Producer: get a free buffer of its own, returns 0 if there is none
+int descriptor_rings_acquire(unsigned producer, REFERENCE_PARAM(uintptr_t, dptr));
+
+// Producer: pass a filled buffer to the transmitter
+void descriptor_rings_submit(unsigned producer, uintptr_t dptr, unsigned length_in_bytes);
+
+/*
+ * Transmitter: get the next buffer to send, returns 0 if there is none ready. The
+ * producers are taken from in turn, a whole train at a time.
+ */
+int descriptor_rings_take(REFERENCE_PARAM(uintptr_t, dptr), REFERENCE_PARAM(unsigned, length_in_bytes));
+
+// Transmitter: hand a sent buffer back to the producer it came from
+void descriptor_rings_release(uintptr_t dptr);
+
+#endif // __DESCRIPTOR_RING_H__
@@ -0,0 +1,144 @@
+/*
+ * The flow table. Flows are added by the packet controller and taken into each
+ * configuration as it is prepared, which is all the producers read.
+ */
+#include <string.h>
+#include "debug_print.h"
+#include "flow_table.h"
+#include "packet_generator.h"
+#include "generator_config.h"
+
+extern unsigned char g_src_mac[];
+
+typedef struct flow_table_t {
+  unsigned count;
+  flow_t flows[MAX_FLOWS];
+  unsigned sources; // Source addresses in the pool, after the board's own
+  unsigned char src_macs[FLOW_SOURCE_MACS + 1][MAC_ADDRESS_BYTES];
+} flow_table_t;
+
+static flow_table_t g_flow_table;
+
+static const char *flow_type_names[] = { "unicast", "multicast", "broadcast" };
+
+void flow_table_clear(void)
+{
+  g_flow_table.count = 0;
+  g_flow_table.sources = 0;
+}
+
+/* The index of a source address in the pool, added if it is new, or -1 if the pool is full */
+static int flow_source(const unsigned char src_mac[])
+{
+  static const unsigned char no_mac[MAC_ADDRESS_BYTES] = { 0, 0, 0, 0, 0, 0 };
+
+  if (memcmp(src_mac, no_mac, MAC_ADDRESS_BYTES) == 0)
+    return 0;
+  for (unsigned i = 1; i <= g_flow_table.sources; i++) {
+    if (memcmp(src_mac, g_flow_table.src_macs[i], MAC_ADDRESS_BYTES) == 0)
+      return i;
+  }
+  if (g_flow_table.sources == FLOW_SOURCE_MACS)
+    return -1;
+  memcpy(g_flow_table.src_macs[++g_flow_table.sources], src_mac, MAC_ADDRESS_BYTES);
+  return g_flow_table.sources;
+}
+
+int flow_table_add(const flow_params_t *params)
+{
+  if (g_flow_table.count == MAX_FLOWS || (unsigned)params->type >= TRAFFIC_GEN_TYPES)
+    return -1;
+  if (params->size_max < params->size_min || params->weight > 0xffff)
+    return -1;
+  if ((params->size_max || params->size_min) &&
+      (params->size_min < MIN_FRAME_BYTES || params->size_max > MAX_FRAME_BYTES))
+    return -1;
+
+  int src = flow_source(params->src_mac);
+  if (src < 0)
+    return -1;
+
+  unsigned index = g_flow_table.count++;
+  flow_t *flow = &g_flow_table.flows[index];
+  memcpy(flow->dest_mac, params->dest_mac, MAC_ADDRESS_BYTES);
+  flow->src = src;
+  flow->type = params->type;
+  flow->tci = (params->prio & 0x7) << 13 | (params->vlan & 0xfff);
+  flow->ether_type = params->ether_type ? params->ether_type : TRAFFIC_GEN_ETHERTYPE + params->type;
+  flow->size_min = params->size_min;
+  flow->size_max = params->size_max;
+  flow->weight = params->weight;
+  flow->seq_offset = 2 * MAC_ADDRESS_BYTES + (params->vlan_tag_enabled ? 4 : 0) + 2;
+  flow->index = index;
+  flow->header_id = new_header_id();
+  return index;
+}
+
+unsigned flow_table_count(void)
+{
+  return g_flow_table.count;
+}
+
+unsigned flow_table_active(pkt_type_t type)
+{
+  return config_current()->types[type].flow_count;
+}
+
+void flow_table_prepare(flow_selection_t *flows, pkt_ctrl_t *ctrl)
+{
+  static int weights[MAX_FLOWS];
+  unsigned first = 0;
+  unsigned count = 0;
+
+  memcpy(flows->src_macs[0], g_src_mac, MAC_ADDRESS_BYTES);
+  memcpy(flows->src_macs[1], g_flow_table.src_macs[1], g_flow_table.sources * MAC_ADDRESS_BYTES);
+
+  // The flows of each type follow those of the types before it
+  for (unsigned i = 0; i < g_flow_table.count; i++) {
+    if (g_flow_table.flows[i].type < ctrl->type)
+      first++;
+  }
+
+  for (unsigned i = 0; i < g_flow_table.count; i++) {
+    if (g_flow_table.flows[i].type == ctrl->type) {
+      flows->flows[first + count] = g_flow_table.flows[i];
+      weights[count] = g_flow_table.flows[i].weight;
+      count++;
+    }
+  }
+
+  ctrl->flow_first = first;
+  ctrl->flow_count = 0;
+  if (count && alias_table_build(&flows->alias[first], weights, count))
+    ctrl->flow_count = count;
+}
+
+void flow_table_header(unsigned header[], const flow_selection_t *flows, const flow_t *flow)
+{
+  unsigned vlan_tag_enabled = (flow->seq_offset > 2 * MAC_ADDRESS_BYTES + 2) ? VLAN_TAG_SINGLE : 0;
+  build_header(header, flow->dest_mac, flows->src_macs[flow->src], vlan_tag_enabled, 0, flow->tci,
+      flow->ether_type, flow->index);
+}
+
+void flow_table_print(void)
+{
+  debug_printf("%d flows\n", g_flow_table.count);
+  for (unsigned i = 0; i < g_flow_table.count; i++) {
+    const flow_t *flow = &g_flow_table.flows[i];
+    const unsigned char *dst = flow->dest_mac;
+    const unsigned char *src = flow->src ? g_flow_table.src_macs[flow->src] : g_src_mac;
+
+    debug_printf("Flow %d: %s, weight %d, dst %x:%x:%x:%x:%x:%x, src %x:%x:%x:%x:%x:%x, ethertype %x",
+        i, flow_type_names[flow->type], flow->weight,
+        dst[0], dst[1], dst[2], dst[3], dst[4], dst[5],
+        src[0], src[1], src[2], src[3], src[4], src[5], flow->ether_type);
+    if (flow->seq_offset > 2 * MAC_ADDRESS_BYTES + 2)
+      debug_printf(", vlan %d prio %d", flow->tci & 0xfff, flow->tci >> 13);
+    if (flow->size_max)
+      debug_printf(", sizes %d..%d", flow->size_min, flow->size_max);
+    debug_printf(", seq");
+    for (unsigned j = 0; j < GENERATOR_PRODUCERS; j++)
+      debug_printf(" %d", flow_seq_num(j, i, flow->header_id));
+    debug_printf("\n");
+  }
+}
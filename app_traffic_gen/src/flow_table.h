@@ -0,0 +1,111 @@
+#ifndef __FLOW_TABLE_H__
+#define __FLOW_TABLE_H__
+
+#include <xccompat.h>
+#include "alias_table.h"
+#include "packet_generator.h"
+#include "host_protocol.h"
+
+/*
+ * A table of flows, each with its own addresses, VLAN tag, ethertype, frame sizes,
+ * weight and sequence numbers. When a packet type has flows one of them is chosen
+ * for every frame of the type, by weight, with an alias table so the choice takes
+ * constant time however many flows there are.
+ *
+ * There is one table, which only the packet controller edits. Each configuration
+ * holds the flows its packet types use as they were when it was prepared, see
+ * generator_config.h, so the generator never reads the table itself. A flow is
+ * kept in 24 bytes: its source address is an index into a small pool of
+ * addresses shared by the flows and its header is written into a buffer only
+ * when the buffer does not already hold it. The flow's index is sent in the
+ * frame at FRAME_FLOW_OFFSET so a receiver can follow its sequence numbers. A
+ * flow given an ethertype other than its packet type's is not recognised by the
+ * receiver.
+ *
+ * Every flow costs 24 bytes in the table and 32 in each configuration, and each
+ * producer and the receiver keep its sequence numbers, so MAX_FLOWS is kept small
+ * for the generation tile. Larger tables need a larger upload, see host_protocol.h.
+ */
+// The source addresses flows can have besides the board's own, which is index 0
+#ifndef FLOW_SOURCE_MACS
+#define FLOW_SOURCE_MACS 8
+#endif
+
+#if MAX_FLOWS > ALIAS_TABLE_MAX_ENTRIES
+#error "MAX_FLOWS cannot be more than ALIAS_TABLE_MAX_ENTRIES"
+#endif
+
+// A flow keeps its index in a byte
+#if MAX_FLOWS > 256
+#error "MAX_FLOWS cannot be more than 256"
+#endif
+
+typedef struct flow_t {
+  unsigned header_id; // New for every flow added, so producers number it afresh
+  unsigned char dest_mac[MAC_ADDRESS_BYTES];
+  unsigned char src;        // Index of the source address, 0 for the board's own
+  unsigned char type;
+  unsigned short tci;       // The VLAN tag control bytes, used when the header has a tag
+  unsigned short ether_type;
+  unsigned short size_min;
+  unsigned short size_max;  // Zero to use the sizes of the packet type
+  unsigned short weight;
+  unsigned char seq_offset; // After the ethertype, so also says whether there is a tag
+  unsigned char index;      // In the table, sent in the frame
+} flow_t;
+
+/* The flows of a configuration: those of each packet type in turn, with an alias table over each type's */
+typedef struct flow_selection_t {
+  flow_t flows[MAX_FLOWS];
+  alias_entry_t alias[MAX_FLOWS];
+  unsigned char src_macs[FLOW_SOURCE_MACS + 1][MAC_ADDRESS_BYTES];
+} flow_selection_t;
+
+typedef struct flow_params_t {
+  pkt_type_t type;
+  unsigned char dest_mac[MAC_ADDRESS_BYTES];
+  unsigned char src_mac[MAC_ADDRESS_BYTES]; // All zero for the board's own address
+  unsigned vlan_tag_enabled;
+  unsigned vlan;
+  unsigned prio;
+  unsigned ether_type;                      // Zero for the packet type's own ethertype
+  unsigned size_min;
+  unsigned size_max;
+  unsigned weight;
+} flow_params_t;
+
+#ifndef __XC__
+/* Remove all flows, packet types go back to their own header from the next configuration */
+void flow_table_clear(void);
+
+/*
+ * Returns the index of the new flow, or -1 if the table or the pool of source
+ * addresses is full or the flow is not valid.
+ */
+int flow_table_add(const flow_params_t *params);
+
+unsigned flow_table_count(void);
+
+/* The number of flows of a type in the configuration being used */
+unsigned flow_table_active(pkt_type_t type);
+
+void flow_table_print(void);
+
+/* Take the flows a packet type uses into a configuration, called by prepare_config() */
+void flow_table_prepare(flow_selection_t *flows, pkt_ctrl_t *ctrl);
+
+/* Choose the flow of the next frame of a packet type that has flows */
+static inline const flow_t *flow_table_choose(const flow_selection_t *flows, const pkt_ctrl_t *ctrl, unsigned random)
+{
+  unsigned first = ctrl->flow_first;
+  return &flows->flows[first + alias_table_sample(&flows->alias[first], ctrl->flow_count, random)];
+}
+
+/*
+ * Write the header of a flow into a frame, with the flow id in place and the
+ * sequence number left as zero.
+ */
+void flow_table_header(unsigned header[], const flow_selection_t *flows, const flow_t *flow);
+#endif
+
+#endif // __FLOW_TABLE_H__
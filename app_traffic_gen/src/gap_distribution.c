@@ -0,0 +1,142 @@
+/*
+ * Inter-frame gap distributions. The tables are built when a configuration is
+ * prepared so that sampling costs a random number and a table lookup.
+ */
+#include <string.h>
+#include "gap_distribution.h"
+
+/*
+ * The mean of a unit exponential over each of 256 equally likely slices of its
+ * range, in 16.16 fixed point. Using the mean of each slice rather than its mid
+ * point keeps the overall mean at exactly one; the last slice holds the tail.
+ */
+static const unsigned exponential_quantiles[GAP_QUANTILES] = {
+  0x000080, 0x000181, 0x000283, 0x000386, 0x00048a, 0x00058f, 0x000696, 0x00079d,
+  0x0008a5, 0x0009ae, 0x000ab9, 0x000bc4, 0x000cd1, 0x000ddf, 0x000eed, 0x000ffd,
+  0x00110e, 0x001221, 0x001334, 0x001448, 0x00155e, 0x001675, 0x00178d, 0x0018a6,
+  0x0019c1, 0x001add, 0x001bf9, 0x001d18, 0x001e37, 0x001f58, 0x00207a, 0x00219d,
+  0x0022c2, 0x0023e8, 0x00250f, 0x002637, 0x002761, 0x00288c, 0x0029b9, 0x002ae7,
+  0x002c16, 0x002d47, 0x002e7a, 0x002fad, 0x0030e2, 0x003219, 0x003351, 0x00348b,
+  0x0035c6, 0x003702, 0x003840, 0x003980, 0x003ac1, 0x003c04, 0x003d49, 0x003e8f,
+  0x003fd6, 0x004120, 0x00426b, 0x0043b7, 0x004506, 0x004656, 0x0047a8, 0x0048fb,
+  0x004a50, 0x004ba8, 0x004d01, 0x004e5b, 0x004fb8, 0x005116, 0x005277, 0x0053d9,
+  0x00553d, 0x0056a3, 0x00580b, 0x005975, 0x005ae2, 0x005c50, 0x005dc0, 0x005f32,
+  0x0060a6, 0x00621d, 0x006396, 0x006510, 0x00668d, 0x00680d, 0x00698e, 0x006b12,
+  0x006c98, 0x006e21, 0x006fab, 0x007139, 0x0072c8, 0x00745a, 0x0075ef, 0x007786,
+  0x00791f, 0x007abc, 0x007c5a, 0x007dfc, 0x007fa0, 0x008147, 0x0082f0, 0x00849d,
+  0x00864c, 0x0087fe, 0x0089b3, 0x008b6b, 0x008d25, 0x008ee3, 0x0090a4, 0x009268,
+  0x00942f, 0x0095f9, 0x0097c7, 0x009998, 0x009b6c, 0x009d43, 0x009f1e, 0x00a0fd,
+  0x00a2df, 0x00a4c4, 0x00a6ad, 0x00a89a, 0x00aa8a, 0x00ac7f, 0x00ae77, 0x00b073,
+  0x00b273, 0x00b477, 0x00b67f, 0x00b88b, 0x00ba9c, 0x00bcb1, 0x00beca, 0x00c0e7,
+  0x00c30a, 0x00c530, 0x00c75c, 0x00c98c, 0x00cbc1, 0x00cdfb, 0x00d03a, 0x00d27e,
+  0x00d4c7, 0x00d715, 0x00d969, 0x00dbc2, 0x00de21, 0x00e085, 0x00e2f0, 0x00e560,
+  0x00e7d6, 0x00ea52, 0x00ecd5, 0x00ef5e, 0x00f1ed, 0x00f483, 0x00f720, 0x00f9c3,
+  0x00fc6e, 0x00ff20, 0x0101d9, 0x01049a, 0x010762, 0x010a32, 0x010d0b, 0x010feb,
+  0x0112d4, 0x0115c5, 0x0118bf, 0x011bc2, 0x011ece, 0x0121e4, 0x012503, 0x01282c,
+  0x012b60, 0x012e9d, 0x0131e5, 0x013539, 0x013897, 0x013c01, 0x013f76, 0x0142f8,
+  0x014686, 0x014a21, 0x014dca, 0x015180, 0x015543, 0x015916, 0x015cf7, 0x0160e7,
+  0x0164e7, 0x0168f7, 0x016d18, 0x01714b, 0x01758f, 0x0179e6, 0x017e50, 0x0182ce,
+  0x018760, 0x018c08, 0x0190c5, 0x01959a, 0x019a86, 0x019f8b, 0x01a4aa, 0x01a9e4,
+  0x01af39, 0x01b4ac, 0x01ba3c, 0x01bfed, 0x01c5bf, 0x01cbb3, 0x01d1cb, 0x01d80a,
+  0x01de70, 0x01e501, 0x01ebbe, 0x01f2a9, 0x01f9c6, 0x020117, 0x02089f, 0x021061,
+  0x021861, 0x0220a4, 0x02292c, 0x023201, 0x023b26, 0x0244a2, 0x024e7b, 0x0258b9,
+  0x026365, 0x026e87, 0x027a2b, 0x02865d, 0x02932b, 0x02a0a6, 0x02aee0, 0x02bdf2,
+  0x02cdf4, 0x02df09, 0x02f156, 0x03050c, 0x031a68, 0x0331b6, 0x034b5a, 0x0367db,
+  0x0387f1, 0x03aca3, 0x03d781, 0x040b0d, 0x044bbc, 0x04a2b9, 0x0528ad, 0x068b89,
+};
+
+void gap_dist_set_constant(gap_settings_t *settings)
+{
+  settings->mode = GAP_CONSTANT;
+}
+
+void gap_dist_set_exponential(gap_settings_t *settings)
+{
+  settings->mode = GAP_EXPONENTIAL;
+}
+
+void gap_dist_set_uniform(gap_settings_t *settings, unsigned jitter_percent)
+{
+  if (jitter_percent > 100)
+    jitter_percent = 100;
+
+  settings->mode = GAP_UNIFORM;
+  settings->jitter_percent = jitter_percent;
+}
+
+int gap_dist_set_table(gap_settings_t *settings, const unsigned percent[], const int weights[], unsigned count)
+{
+  int usable = 0;
+
+  if (count > GAP_TABLE_MAX_ENTRIES)
+    count = GAP_TABLE_MAX_ENTRIES;
+
+  for (unsigned i = 0; i < count; i++) {
+    if ((weights[i] > 0) && percent[i])
+      usable = 1;
+  }
+  if (!usable)
+    return 0;
+
+  settings->mode = GAP_TABLE;
+  settings->count = count;
+  for (unsigned i = 0; i < count; i++) {
+    settings->table_percent[i] = percent[i];
+    settings->table_weight[i] = weights[i];
+  }
+  return 1;
+}
+
+static void prepare_table(gap_dist_t *dist, const gap_settings_t *settings)
+{
+  unsigned long long total_weight = 0;
+  unsigned long long weighted_percent = 0;
+  unsigned count = settings->count;
+
+  for (unsigned i = 0; i < count; i++) {
+    if (settings->table_weight[i] > 0) {
+      total_weight += settings->table_weight[i];
+      weighted_percent += (unsigned long long)settings->table_weight[i] * settings->table_percent[i];
+    }
+  }
+  alias_table_build(dist->table_alias, settings->table_weight, count);
+  dist->count = count;
+
+  // Scale the percentages so that their weighted mean is one
+  for (unsigned i = 0; i < count; i++) {
+    unsigned long long multiplier =
+        ((unsigned long long)settings->table_percent[i] * total_weight * GAP_MULTIPLIER_ONE) / weighted_percent;
+    dist->multiplier[i] = (multiplier > 0xffffffff) ? 0xffffffff : (unsigned)multiplier;
+  }
+}
+
+void gap_dist_prepare(gap_dist_t *dist, const gap_settings_t *settings)
+{
+  dist->mode = settings->mode;
+
+  switch (settings->mode) {
+    case GAP_CONSTANT:
+      dist->count = 1;
+      dist->multiplier[0] = GAP_MULTIPLIER_ONE;
+      break;
+
+    case GAP_EXPONENTIAL:
+      dist->count = GAP_QUANTILES;
+      memcpy(dist->multiplier, exponential_quantiles, sizeof(exponential_quantiles));
+      break;
+
+    case GAP_UNIFORM:
+      // The mid point of each slice, which are symmetric about one
+      dist->count = GAP_QUANTILES;
+      for (int i = 0; i < GAP_QUANTILES; i++) {
+        int offset = (2 * i + 1 - GAP_QUANTILES) * (int)settings->jitter_percent *
+            (GAP_MULTIPLIER_ONE / GAP_QUANTILES) / 100;
+        dist->multiplier[i] = GAP_MULTIPLIER_ONE + offset;
+      }
+      break;
+
+    case GAP_TABLE:
+      prepare_table(dist, settings);
+      break;
+  }
+}
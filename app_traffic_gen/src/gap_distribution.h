@@ -0,0 +1,80 @@
+#ifndef __GAP_DISTRIBUTION_H__
+#define __GAP_DISTRIBUTION_H__
+
+#include <xccompat.h>
+#include "alias_table.h"
+
+/*
+ * Distributions of the idle time between frames. Each frame's idle time (its period
+ * less its time on the wire) is scaled by a multiplier drawn from the distribution.
+ * The multipliers have a mean of one so the configured rate is kept on average.
+ *
+ * Multipliers are 16.16 fixed point. Exponential and uniform distributions are
+ * held as equally likely quantiles and tables as an alias table, so a sample
+ * always takes one random number and no divide.
+ */
+typedef enum {
+  GAP_CONSTANT,    // Every frame gets exactly its period
+  GAP_EXPONENTIAL, // Poisson arrivals at the configured rate
+  GAP_UNIFORM,     // Uniform within +/- a percentage of the idle time
+  GAP_TABLE,       // Weighted list of multipliers given as percentages
+} gap_mode_t;
+
+#define GAP_MULTIPLIER_ONE 0x10000
+
+// The number of quantiles used for the exponential and uniform distributions
+#define GAP_QUANTILES 256
+
+// The most entries in a table driven distribution
+#define GAP_TABLE_MAX_ENTRIES 16
+
+/* A distribution as the host gave it, kept by the packet controller */
+typedef struct gap_settings_t {
+  gap_mode_t mode;
+  unsigned jitter_percent;
+
+  // For a table driven distribution
+  unsigned count;
+  unsigned table_percent[GAP_TABLE_MAX_ENTRIES];
+  int table_weight[GAP_TABLE_MAX_ENTRIES];
+} gap_settings_t;
+
+/* The distribution the generator samples, built from the settings by gap_dist_prepare() */
+typedef struct gap_dist_t {
+  gap_mode_t mode;
+  unsigned count;
+  alias_entry_t table_alias[GAP_TABLE_MAX_ENTRIES];
+  unsigned multiplier[GAP_QUANTILES];
+} gap_dist_t;
+
+#ifdef __XC__
+extern "C" {
+#endif
+
+void gap_dist_set_constant(gap_settings_t *settings);
+void gap_dist_set_exponential(gap_settings_t *settings);
+void gap_dist_set_uniform(gap_settings_t *settings, unsigned jitter_percent);
+
+/*
+ * Set a table driven distribution. Returns 0 and leaves the settings unchanged
+ * if there is no entry with both a weight and a non-zero percentage.
+ */
+int gap_dist_set_table(gap_settings_t *settings, const unsigned percent[], const int weights[], unsigned count);
+
+/* Build the distribution for the settings */
+void gap_dist_prepare(gap_dist_t *dist, const gap_settings_t *settings);
+
+#ifdef __XC__
+}
+#endif
+
+#ifndef __XC__
+static inline unsigned gap_dist_sample(const gap_dist_t *dist, unsigned random)
+{
+  if (dist->mode == GAP_TABLE)
+    return dist->multiplier[alias_table_sample(dist->table_alias, dist->count, random)];
+  return dist->multiplier[((unsigned long long)random * dist->count) >> 32];
+}
+#endif
+
+#endif // __GAP_DISTRIBUTION_H__
@@ -0,0 +1,138 @@
+/*
+ * The settings, the two configurations of the generator and how the next one is
+ * published, see generator_config.h. Only the packet controller publishes and only
+ * the producers acquire.
+ */
+#include <string.h>
+#include "generator_config.h"
+
+static generator_settings_t g_settings;
+static generator_config_t g_configs[2];
+
+/* The version published last, its low bit is the index of its configuration */
+static volatile unsigned g_config_version = 0;
+
+/* The version each producer has moved onto, none until it first asks */
+static volatile unsigned g_config_acquired[GENERATOR_PRODUCERS];
+static unsigned g_producers = 1;
+
+/* The frame sizes and weight of each packet type in the two configurations prepared at the start */
+static const unsigned default_types[2][TRAFFIC_GEN_TYPES][3] = {
+  {
+    { 64, 64,   35 },
+    { 64, 1500, 0  },
+    { 64, 1500, 0  },
+  },
+  {
+    { 64, 1500, 35 },
+    { 64, 1500, 30 },
+    { 64, 1500, 40 },
+  },
+};
+
+static const unsigned char default_unicast_mac[MAC_ADDRESS_BYTES] = { 0x00, 0x22, 0x97, 0x00, 0x42, 0xa2 };
+static const unsigned char default_multicast_mac[MAC_ADDRESS_BYTES] = { 0x01, 0x22, 0x97, 0x00, 0x42, 0xa6 };
+
+/* Point the states of a configuration at its own packet types and states */
+static void link_config(generator_config_t *config)
+{
+  for (unsigned i = 0; i < TRAFFIC_GEN_TYPES; i++)
+    config->directed_types[i] = &config->types[i];
+  config->directed_types[TRAFFIC_GEN_TYPES] = NULL;
+  config->directed_next[0] = &config->directed;
+  config->directed_next[1] = NULL;
+  config->directed.packet_types = config->directed_types;
+  config->directed.weight = 1;
+  config->directed.next = config->directed_next;
+
+  config->random_none[0] = NULL;
+  config->random_next[0] = &config->random_initial;
+  config->random_next[1] = NULL;
+  for (unsigned i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    config->random_type[i][0] = &config->random_types[i];
+    config->random_type[i][1] = NULL;
+    config->random_only[i].packet_types = config->random_type[i];
+    config->random_only[i].weight = 1;
+    config->random_only[i].next = config->random_next;
+    config->random_choice[i] = &config->random_only[i];
+  }
+  config->random_choice[TRAFFIC_GEN_TYPES] = NULL;
+  config->random_initial.packet_types = config->random_none;
+  config->random_initial.weight = 1;
+  config->random_initial.next = config->random_choice;
+}
+
+/* Set the settings to the defaults of one of the configurations prepared at the start */
+static void default_settings(unsigned index)
+{
+  memset(&g_settings, 0, sizeof(g_settings));
+  for (unsigned i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    pkt_settings_t *type = &g_settings.types[i];
+    type->type = (pkt_type_t)i;
+    type->size_min = default_types[index][i][0];
+    type->size_max = default_types[index][i][1];
+    type->weight = default_types[index][i][2];
+  }
+  memcpy(g_settings.unicast_mac, default_unicast_mac, MAC_ADDRESS_BYTES);
+  memcpy(g_settings.multicast_mac, default_multicast_mac, MAC_ADDRESS_BYTES);
+  g_settings.line_rate.mode = RATE_PER_BIT;
+  g_settings.line_rate.ticks_hi = 1;
+  g_settings.line_rate.ticks_lo = 0;
+  gap_dist_set_constant(&g_settings.gap_dist);
+}
+
+void config_init(unsigned producers)
+{
+  g_producers = producers;
+  for (unsigned i = 0; i < GENERATOR_PRODUCERS; i++)
+    g_config_acquired[i] = ~0u;
+
+  // The settings are left as those of the configuration published
+  for (int i = 1; i >= 0; i--) {
+    default_settings(i);
+    link_config(&g_configs[i]);
+    prepare_config(&g_configs[i], &g_settings);
+  }
+  g_config_version = 0;
+}
+
+generator_settings_t *config_settings(void)
+{
+  return &g_settings;
+}
+
+const generator_config_t *config_current(void)
+{
+  return &g_configs[g_config_version & 1];
+}
+
+generator_config_t *config_next(void)
+{
+  unsigned version = g_config_version;
+
+  // The producers move onto a new configuration between frames, so this is short
+  for (unsigned i = 0; i < g_producers; i++) {
+    while (g_config_acquired[i] != version)
+      ;
+  }
+  CONFIG_ACQUIRE();
+  return &g_configs[(version + 1) & 1];
+}
+
+void config_publish(void)
+{
+  // The configuration must be complete before it is published
+  CONFIG_RELEASE();
+  g_config_version = g_config_version + 1;
+}
+
+const generator_config_t *config_acquire(unsigned producer)
+{
+  unsigned version = g_config_version;
+  if (version == g_config_acquired[producer])
+    return NULL;
+
+  CONFIG_ACQUIRE();
+  g_config_acquired[producer] = version;
+  return &g_configs[version & 1];
+}
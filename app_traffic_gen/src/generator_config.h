@@ -0,0 +1,107 @@
+#ifndef __GENERATOR_CONFIG_H__
+#define __GENERATOR_CONFIG_H__
+
+#include "packet_generator.h"
+#include "flow_table.h"
+#include "gap_distribution.h"
+
+/*
+ * The settings the host has made, which only the packet controller reads and
+ * writes. There is one copy: changes are made to it and it is prepared into the
+ * next configuration when that is swapped in.
+ */
+typedef struct generator_settings_t {
+  pkt_settings_t types[TRAFFIC_GEN_TYPES];
+
+  unsigned char unicast_mac[MAC_ADDRESS_BYTES];
+  unsigned char multicast_mac[MAC_ADDRESS_BYTES];
+
+  // Used by packet types without their own rate
+  rate_t line_rate;
+
+  gap_settings_t gap_dist;
+} generator_settings_t;
+
+/*
+ * Everything the generator reads of a configuration, prepared from the settings
+ * and held in one object so that a configuration changes as a whole. There are
+ * two: the one published for the generator and the one before it, which the
+ * packet controller prepares the next one in.
+ *
+ * A published configuration is not changed while it is in use. Publishing the
+ * next one advances a version number whose low bit says which of the two it is,
+ * so one word written tells the generator both that there is a new configuration
+ * and where it is. Each producer looks at the version between frames and
+ * acknowledges it when it moves over, with no lock and no copy. Until they all
+ * have the configuration they moved off may still be in use, so the controller
+ * waits for every acknowledgement before it prepares it again, which is never
+ * longer than one frame.
+ *
+ * The per-frame state each producer keeps for each packet type, the positions of
+ * its address sweeps, its next VLAN tag and chosen flow, is held by the producer
+ * rather than here and starts again with every configuration. So are the sequence
+ * numbers, which carry on for as long as the packet type or flow is the same.
+ */
+typedef struct generator_config_t {
+  // Directed mode: a single state choosing between the packet types by weight
+  pkt_ctrl_t types[TRAFFIC_GEN_TYPES];
+  pkt_tables_t tables[TRAFFIC_GEN_TYPES];
+  pkt_ctrl_t *directed_types[TRAFFIC_GEN_TYPES + 1];
+  pkt_gen_ctrl_t directed;
+  pkt_gen_ctrl_t *directed_next[2];
+
+  // Random mode: a state sending nothing chooses with equal weights between a state
+  // for each packet type, each of which goes back to it. Its packet types are fixed
+  // and have no tables.
+  pkt_ctrl_t random_types[TRAFFIC_GEN_TYPES];
+  pkt_ctrl_t *random_type[TRAFFIC_GEN_TYPES][2];
+  pkt_gen_ctrl_t random_only[TRAFFIC_GEN_TYPES];
+  pkt_gen_ctrl_t *random_choice[TRAFFIC_GEN_TYPES + 1];
+  pkt_ctrl_t *random_none[1];
+  pkt_gen_ctrl_t random_initial;
+  pkt_gen_ctrl_t *random_next[2];
+
+  gap_dist_t gap_dist;
+
+  // The flows each packet type uses, see flow_table.h
+  flow_selection_t flows;
+} generator_config_t;
+
+#ifdef __xcore__
+// Memory on a tile is not cached and accesses complete in order, so only the compiler needs fencing
+#define CONFIG_RELEASE() asm volatile("" ::: "memory")
+#define CONFIG_ACQUIRE() asm volatile("" ::: "memory")
+#else
+#define CONFIG_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define CONFIG_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+/*
+ * Set the settings to the defaults, prepare both configurations and publish the
+ * first to the given number of producers. The other is prepared with the
+ * defaults of the second configuration, which the first 's' swaps to.
+ */
+void config_init(unsigned producers);
+
+/* The settings, for the packet controller to change */
+generator_settings_t *config_settings(void);
+
+/* The configuration published last, which the producers are or will soon be using */
+const generator_config_t *config_current(void);
+
+/*
+ * The configuration to prepare the next one in, which holds the one published
+ * before the current one. Waits for the producers to move off it.
+ */
+generator_config_t *config_next(void);
+
+/* Publish the next configuration, which must have been prepared with prepare_config() */
+void config_publish(void);
+
+/*
+ * Called by each producer between frames. Returns the configuration published
+ * since it last asked, which it moves onto, or NULL if there is none.
+ */
+const generator_config_t *config_acquire(unsigned producer);
+
+#endif // __GENERATOR_CONFIG_H__
@@ -0,0 +1,189 @@
+#ifndef __HOST_PROTOCOL_H__
+#define __HOST_PROTOCOL_H__
+
+#include <stdint.h>
+#include "traffic_ctlr_host_cmds.h"
+
+/*
+ * The binary messages the host controller sends to the device. The host turns
+ * console commands into records, so the device does no text parsing, and the
+ * layout is shared with the host controller. Both ends are little endian.
+ *
+ * Every message starts with a protocol_header_t. A command message holds whole
+ * records which take effect at once. The records that change the next
+ * configuration are instead sent as one upload: the host streams them in data
+ * messages of up to PROTOCOL_MAX_MESSAGE_BYTES, each giving its offset in the
+ * upload, and a commit message then gives their length, count and checksum. The
+ * device checks the whole upload before any of it is used and applies it when
+ * the next configuration is swapped in, either as part of the commit or at the
+ * next 'e' or 's', so the generator never sees a partly changed configuration.
+ *
+ * A record is a protocol_record_t and the number of 32-bit arguments it gives:
+ *
+ *   cmd sub  type      arguments
+ *   'a' -    u|m       mac (PROTOCOL_MAC_WORDS)
+ *   'c' -|i|p|r|c u|m|b  weight, size_min, size_max[, constant payload value]
+ *   'z' c|a  u|m|b     <size, weight>...
+ *   'v' d|e|q|c|t u|m|b  e: vlan prio, q: svlan sprio vlan prio,
+ *                      c: vlan_min vlan_max prio_min prio_max, t: <vlan prio weight>...
+ *   'w' d|s  u|m|b     mode o|s|r, count or mask, stride
+ *   'r' b|f|l *|u|m|b  ticks_hi, ticks_lo
+ *   'g' c|e|u|t -      u: jitter percent, t: <percent weight>...
+ *   'f' c|a  a: u|m|b  a: see PROTOCOL_FLOW_ARGS
+ *   'k' c    u|m|b     class a|b|e
+ *
+ * A scenario (see scenario.h) is uploaded the same way and may also hold:
+ *
+ *   'n' p    -         phase duration ms, starts a phase
+ *   'm' s|r|d|b -      b: frames, gap ticks
+ *
+ * and, only in command messages:
+ *
+ *   'm' s|r|d|b -      b: frames, gap ticks
+ *   'i' -    -         interval ticks
+ *   't' r|c  -         c: bucket shift
+ *   'x' e|d  -
+ *   'l' -    -         catch-up ticks
+ *   'k' s    a|b       idle slope
+ *   'f' p    -
+ *   'n' r|l|s -
+ *   'u' s    -         stream id
+ *   'p' 'e' 's' -  -
+ *
+ * A capture is played by streaming its frames in blocks, see pcap_player.h. Each
+ * block is sent in data messages giving its number in the stream and the offset
+ * of the data in it, and a commit message then gives its length, frames and
+ * checksum. A block holds whole frames, each a length in bytes and the period in
+ * ticks from its start to that of the next frame, followed by its bytes in the
+ * order they are sent.
+ */
+#define PROTOCOL_MAGIC 0xa5 // Never the first byte of a text command
+#define PROTOCOL_VERSION 1
+
+// The most the device reads from the host at once
+#define PROTOCOL_MAX_MESSAGE_BYTES 256
+#define PROTOCOL_MAX_MESSAGE_WORDS (PROTOCOL_MAX_MESSAGE_BYTES / 4)
+
+typedef enum {
+  MSG_COMMANDS,
+  MSG_UPLOAD_DATA,   // Followed by the word offset of the data in the upload
+  MSG_UPLOAD_COMMIT, // Followed by protocol_commit_t
+  MSG_PCAP_DATA,     // Followed by the number of the block in the stream and the word offset of the data
+  MSG_PCAP_COMMIT,   // Followed by protocol_pcap_commit_t
+} protocol_message_t;
+
+typedef struct protocol_header_t {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t message;
+  uint8_t reserved;
+} protocol_header_t;
+
+typedef struct protocol_commit_t {
+  uint32_t words;
+  uint32_t records;
+  uint32_t checksum;
+  uint32_t swap;     // CMD_APPLY_CFG or CMD_SWAP_CFG to swap at once, 0 to wait for the next,
+                     // or CMD_SCENARIO to keep the records as the scenario
+} protocol_commit_t;
+
+typedef struct protocol_pcap_commit_t {
+  uint32_t block;
+  uint32_t words;
+  uint32_t frames;
+  uint32_t checksum;
+  uint32_t last;     // The last block of the capture
+} protocol_pcap_commit_t;
+
+typedef struct protocol_record_t {
+  uint8_t cmd;
+  uint8_t sub;
+  uint8_t type;
+  uint8_t args;      // The number of 32-bit arguments that follow
+} protocol_record_t;
+
+// The most arguments of any record, a full table of frame sizes
+#define PROTOCOL_MAX_ARGS 64
+
+// MAC addresses are packed in order, first byte at the top of the first word
+#define PROTOCOL_MAC_WORDS 2
+
+/*
+ * A flow is its destination and source addresses packed together in 3 words, then
+ * tagged << 16 | tag control, ethertype << 16 | weight and size_min << 16 | size_max.
+ */
+#define PROTOCOL_FLOW_ARGS 6
+
+/*
+ * The most flows the device holds, see flow_table.h. Each takes SRAM on the
+ * generation tile, so the default is kept small; the host and device must agree on it.
+ */
+#ifndef MAX_FLOWS
+#define MAX_FLOWS 32
+#endif
+
+/*
+ * The records of an upload are held by the device until they are applied, so this
+ * takes SRAM on the generation tile. The default has room for a full table of
+ * MAX_FLOWS flows, 7 words each, and nearly 300 words of other records. A build
+ * with a larger MAX_FLOWS needs a larger upload too; the host and device must
+ * agree on it.
+ */
+#ifndef PROTOCOL_UPLOAD_WORDS
+#define PROTOCOL_UPLOAD_WORDS 512
+#endif
+
+#if MAX_FLOWS * (1 + PROTOCOL_FLOW_ARGS) > PROTOCOL_UPLOAD_WORDS
+#error "PROTOCOL_UPLOAD_WORDS is too small to upload a full table of MAX_FLOWS flows"
+#endif
+
+/*
+ * The device keeps the records of a scenario after its upload, see scenario.h, so
+ * this also takes SRAM on the generation tile. The default has room for 32
+ * phases of a few changes each; the host and device must agree on it.
+ */
+#ifndef SCENARIO_WORDS
+#define SCENARIO_WORDS 256
+#endif
+
+#ifndef SCENARIO_MAX_PHASES
+#define SCENARIO_MAX_PHASES 32
+#endif
+
+#if SCENARIO_WORDS > PROTOCOL_UPLOAD_WORDS
+#error "SCENARIO_WORDS cannot be more than PROTOCOL_UPLOAD_WORDS, a scenario is sent in one upload"
+#endif
+
+/*
+ * The device holds two blocks of a capture stream, one played while the host
+ * fills the other, so this takes twice as much SRAM on the generation tile. The
+ * default holds one frame of the largest size; larger blocks ride out longer
+ * delays from the host. The host and device must agree on it.
+ */
+#ifndef PCAP_BLOCK_WORDS
+#define PCAP_BLOCK_WORDS 384
+#endif
+
+// A frame of a capture block starts with its length in bytes and its period
+#define PCAP_RECORD_WORDS 2
+
+static inline void protocol_pack_bytes(uint32_t words[], const unsigned char bytes[], unsigned count)
+{
+  for (unsigned i = 0; i < count; i += 4)
+    words[i / 4] = 0;
+  for (unsigned i = 0; i < count; i++)
+    words[i / 4] |= (uint32_t)bytes[i] << (24 - 8 * (i % 4));
+}
+
+static inline void protocol_unpack_bytes(unsigned char bytes[], const uint32_t words[], unsigned count)
+{
+  for (unsigned i = 0; i < count; i++)
+    bytes[i] = words[i / 4] >> (24 - 8 * (i % 4));
+}
+
+static inline uint32_t protocol_checksum(uint32_t checksum, uint32_t word)
+{
+  return ((checksum << 1) | (checksum >> 31)) + word;
+}
+
+#endif // __HOST_PROTOCOL_H__
@@ -0,0 +1,120 @@
+/*
+ * Latency histograms. Only the receiving task writes them; a clear asked for by
+ * another task is picked up with the next frame, as for the receive analyzer.
+ */
+#include <string.h>
+#include <xscope.h>
+#include "latency.h"
+
+typedef struct latency_hist_t {
+  unsigned frames;
+  unsigned overflows;
+  unsigned min;
+  unsigned max;
+  unsigned long long total;
+  unsigned buckets[LATENCY_BUCKETS];
+} latency_hist_t;
+
+static latency_hist_t g_latency[LATENCY_TYPES];
+static unsigned g_shift = LATENCY_DEFAULT_SHIFT;
+
+/* Incremented to ask the receiving task to clear, which it does when it sees a change */
+static volatile unsigned g_clear_requests = 0;
+static volatile unsigned g_requested_shift = LATENCY_DEFAULT_SHIFT;
+static unsigned g_clears_done = 0;
+
+void latency_record(int type, unsigned tx_time, unsigned rx_time)
+{
+  latency_hist_t *hist = &g_latency[type];
+  unsigned latency = rx_time - tx_time;
+
+  if (g_clears_done != g_clear_requests) {
+    g_clears_done = g_clear_requests;
+    g_shift = g_requested_shift;
+    memset(g_latency, 0, sizeof(g_latency));
+  }
+
+  if (!hist->frames || latency < hist->min)
+    hist->min = latency;
+  if (latency > hist->max)
+    hist->max = latency;
+  hist->total += latency;
+
+  unsigned bucket = latency >> g_shift;
+  if (bucket < LATENCY_BUCKETS)
+    hist->buckets[bucket]++;
+  else
+    hist->overflows++;
+
+  hist->frames++;
+}
+
+void latency_clear(unsigned shift)
+{
+  if (shift > LATENCY_MAX_SHIFT)
+    shift = LATENCY_MAX_SHIFT;
+  g_requested_shift = shift;
+  g_clear_requests++;
+}
+
+unsigned latency_get_shift(void)
+{
+  return g_requested_shift;
+}
+
+/*
+ * The top of the bucket holding the given fraction (in thousandths) of the frames,
+ * kept within the exact minimum and maximum.
+ */
+static unsigned percentile(const latency_hist_t *hist, unsigned frames, unsigned thousandths)
+{
+  unsigned target = ((unsigned long long)frames * thousandths + 999) / 1000;
+  unsigned count = 0;
+  unsigned value = hist->max;
+
+  for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+    count += hist->buckets[i];
+    if (count >= target) {
+      value = ((i + 1) << g_shift) - 1;
+      break;
+    }
+  }
+
+  if (value < hist->min)
+    value = hist->min;
+  if (value > hist->max)
+    value = hist->max;
+  return value;
+}
+
+int latency_get_report(int type, latency_report_t *report)
+{
+  // Work on a copy as the receiving task carries on recording
+  static latency_hist_t hist;
+  hist = g_latency[type];
+
+  if (!hist.frames)
+    return 0;
+
+  report->type = type;
+  report->frames = hist.frames;
+  report->bucket_ticks = 1 << g_shift;
+  report->overflows = hist.overflows;
+  report->min = hist.min;
+  report->max = hist.max;
+  report->mean = hist.total / hist.frames;
+  report->p50 = percentile(&hist, hist.frames, 500);
+  report->p99 = percentile(&hist, hist.frames, 990);
+  report->p999 = percentile(&hist, hist.frames, 999);
+  return 1;
+}
+
+void latency_send(void)
+{
+  latency_report_t report;
+
+  for (int i = 0; i < LATENCY_TYPES; i++) {
+    if (latency_get_report(i, &report))
+      xscope_bytes(LATENCY_PROBE, sizeof(report), (const unsigned char *)&report);
+  }
+}
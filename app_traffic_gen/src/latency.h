@@ -0,0 +1,68 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+/*
+ * Latency measurement from the transmit time the transmitter writes into each
+ * frame and the time the MAC received it. Each packet type has a histogram of
+ * LATENCY_BUCKETS buckets, each 2^shift reference timer ticks wide, as well as
+ * exact minimum, maximum and mean. The host asks for a report, which the device
+ * sends over xscope with the percentiles worked out from the histogram.
+ *
+ * The latency is only absolute when the frame is received by the board that sent
+ * it, over a loopback or reflected back by another board (round trip). Between
+ * two boards it is offset by the difference between their timers, so only the
+ * spread is meaningful. The layout of the report is shared with the host.
+ */
+#define LATENCY_TYPES 3 // One for each pkt_type_t
+
+#ifndef LATENCY_BUCKETS
+#define LATENCY_BUCKETS 256
+#endif
+
+// The default buckets are 128 ticks (1.28us) wide, covering 327us
+#define LATENCY_DEFAULT_SHIFT 7
+#define LATENCY_MAX_SHIFT 20
+
+// The xscope probe the reports are sent on
+#define LATENCY_PROBE 1
+#define LATENCY_PROBE_NAME "Latency"
+
+typedef struct latency_report_t {
+  unsigned type;
+  unsigned frames;
+  unsigned bucket_ticks;
+  unsigned overflows; // Frames beyond the last bucket, counted in the percentiles as the maximum
+  unsigned min;
+  unsigned max;
+  unsigned mean;
+  unsigned p50;
+  unsigned p99;
+  unsigned p999;
+} latency_report_t;
+
+#ifndef LATENCY_HOST
+
+#ifdef __XC__
+extern "C" {
+#endif
+
+/* Record the latency of a frame, called by the task that receives the frames */
+void latency_record(int type, unsigned tx_time, unsigned rx_time);
+
+/* Clear the histograms and set the bucket width, can be called from any task */
+void latency_clear(unsigned shift);
+unsigned latency_get_shift(void);
+
+/* Work out the report for one packet type, returns 0 if it has had no frames */
+int latency_get_report(int type, latency_report_t *report);
+
+/* Send a report for each packet type that has had frames to the host */
+void latency_send(void);
+
+#ifdef __XC__
+}
+#endif
+
+#endif // LATENCY_HOST
+
+#endif // __LATENCY_H__
@@ -3,8 +3,22 @@
 // University of Illinois/NCSA Open Source License posted in
 // LICENSE.txt and at <http://github.xcore.com/>
 
-/* The traffic generator doesn't need to receive any traffic */
+#include "packet_generator.h"
+
+/* Only pass traffic generator frames, possibly VLAN or double tagged, on to the analyzer */
 static inline int mac_custom_filter(unsigned int data[])
 {
-  return 0;
+  // The ethertype is in bytes 12 and 13, moving on a word after each tag
+  unsigned word = 3;
+  unsigned ether_type = ((data[word] & 0xff) << 8) | ((data[word] >> 8) & 0xff);
+  if (ether_type == ETHERTYPE_QINQ) {
+    word++;
+    ether_type = ((data[word] & 0xff) << 8) | ((data[word] >> 8) & 0xff);
+  }
+  if (ether_type == ETHERTYPE_VLAN) {
+    word++;
+    ether_type = ((data[word] & 0xff) << 8) | ((data[word] >> 8) & 0xff);
+  }
+
+  return (ether_type - TRAFFIC_GEN_ETHERTYPE) < TRAFFIC_GEN_TYPES;
 }
@@ -0,0 +1,55 @@
+/*
+ * Absolute-time pacing of frames for the transmitter.
+ */
+#include <xccompat.h>
+#include "pacer.h"
+
+/* Written by the host command handler, read by the transmitter */
+static volatile unsigned g_max_catchup = PACER_DEFAULT_MAX_CATCHUP;
+
+void pacer_init(REFERENCE_PARAM(pacer_t, pacer))
+{
+  pacer->running = 0;
+  pacer->next_time = 0;
+  pacer->period = 0;
+  pacer->late_frames = 0;
+}
+
+void pacer_set_max_catchup(unsigned ticks)
+{
+  g_max_catchup = ticks;
+}
+
+unsigned pacer_get_max_catchup(void)
+{
+  return g_max_catchup;
+}
+
+unsigned pacer_departure_time(REFERENCE_PARAM(pacer_t, pacer), unsigned now, unsigned period)
+{
+  unsigned departure = pacer->next_time;
+  unsigned anchor = period & PACER_ANCHOR;
+  period &= ~PACER_ANCHOR;
+
+  // Timer values wrap, so compare using the signed difference
+  int lateness = (int)(now - departure);
+
+  // The next departure is never more than one period after the previous one was
+  // sent, so if it appears to be then the transmitter has been idle long enough for
+  // the timer to wrap and the schedule has to start again
+  if (!pacer->running || (-lateness > (int)pacer->period)) {
+    pacer->running = 1;
+    departure = now;
+  } else if (lateness > 0) {
+    pacer->late_frames++;
+    if (lateness > (int)g_max_catchup)
+      departure = now - g_max_catchup;
+  }
+
+  if (anchor && (int)(now - departure) > 0)
+    pacer->next_time = now + period;
+  else
+    pacer->next_time = departure + period;
+  pacer->period = period;
+  return departure;
+}
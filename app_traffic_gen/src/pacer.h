@@ -0,0 +1,43 @@
+#ifndef __PACER_H__
+#define __PACER_H__
+
+#include <xccompat.h>
+
+/*
+ * The furthest, in reference timer ticks, that transmission may fall behind its
+ * schedule before the lost time is dropped rather than made up by sending frames
+ * back-to-back. Can be changed at run time with pacer_set_max_catchup().
+ */
+#ifndef PACER_DEFAULT_MAX_CATCHUP
+#define PACER_DEFAULT_MAX_CATCHUP 10000 // 100us
+#endif
+
+/*
+ * Set in a period to schedule the next frame from when this frame actually starts
+ * rather than from when it was due, so that lateness is not made up afterwards.
+ */
+#define PACER_ANCHOR 0x80000000
+
+/*
+ * Keeps a running absolute departure time so that the time spent sending each
+ * frame and handing buffers over does not add to the gap between frames.
+ */
+typedef struct pacer_t {
+  int running;
+  unsigned next_time;
+  unsigned period;
+  unsigned late_frames;
+} pacer_t;
+
+void pacer_init(REFERENCE_PARAM(pacer_t, pacer));
+void pacer_set_max_catchup(unsigned ticks);
+unsigned pacer_get_max_catchup(void);
+
+/*
+ * Returns the time at which the frame should start, given the current time and
+ * the period (in timer ticks) from the start of this frame to the start of the next,
+ * optionally combined with PACER_ANCHOR.
+ */
+unsigned pacer_departure_time(REFERENCE_PARAM(pacer_t, pacer), unsigned now, unsigned period);
+
+#endif // __PACER_H__
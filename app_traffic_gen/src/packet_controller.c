@@ -4,7 +4,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <xccompat.h>
-#include <ctype.h>
+#include <string.h>
 
 #include "xassert.h"
 
@@ -13,41 +13,29 @@
 #include "packet_controller.h"
 #include "common.h"
 #include "packet_generator.h"
-#include "c_utils.h"
+#include "pacer.h"
+#include "shaper.h"
+#include "buffers.h"
+#include "traffic_stats.h"
+#include "rx_analyzer.h"
+#include "latency.h"
+#include "flow_table.h"
+#include "host_protocol.h"
+#include "config_upload.h"
+#include "scenario.h"
+#include "pcap_player.h"
+#include "generator_config.h"
 
 extern unsigned char g_src_mac[];
-extern pkt_gen_ctrl_t initial;
-extern pkt_gen_ctrl_t directed[];
 
-/* The multiplier used to control the line rate */
-volatile unsigned g_rate_factor[2] = {0, 0};
-
-/* The index into the table of configurations - start on second entry */
-unsigned int g_directed_write_index = 1;
-
-static void copy_over_config(int read_index)
+static tx_class_t get_class_from_char(unsigned char c)
 {
-  int write_index = read_index ? 0 : 1;
-  pkt_ctrl_t *read = get_packet_control(TYPE_UNICAST, read_index);
-  pkt_ctrl_t *write = get_packet_control(TYPE_UNICAST, write_index);
-  *write = *read;
-
-  read = get_packet_control(TYPE_MULTICAST, read_index);
-  write = get_packet_control(TYPE_MULTICAST, write_index);
-  *write = *read;
-
-  read = get_packet_control(TYPE_BROADCAST, read_index);
-  write = get_packet_control(TYPE_BROADCAST, write_index);
-  *write = *read;
-
-  g_rate_factor[write_index] = g_rate_factor[read_index];
-
-  unsigned char mac_address[6];
-  get_unicast_mac_address(read_index, mac_address);
-  set_unicast_mac_address(write_index, mac_address);
-
-  get_multicast_mac_address(read_index, mac_address);
-  set_multicast_mac_address(write_index, mac_address);
+  switch (c) {
+    case 'a': return TX_CLASS_A;
+    case 'b': return TX_CLASS_B;
+    default : break;
+  }
+  return TX_CLASS_BEST_EFFORT;
 }
 
 static pkt_type_t get_type_from_char(unsigned char c)
@@ -61,159 +49,808 @@ static pkt_type_t get_type_from_char(unsigned char c)
   return TYPE_UNICAST;
 }
 
-/**
- * \brief   A function that processes data being sent from the host and
- *          informs the analysis engine of any changes
+static void print_rate(const rate_t *rate)
+{
+  unsigned long long ticks = ((unsigned long long)rate->ticks_hi << 32) | rate->ticks_lo;
+
+  switch (rate->mode) {
+    case RATE_LINE:
+      debug_printf("line rate");
+      break;
+    case RATE_PER_BIT: {
+      // Thousandths of a percent of line rate
+      unsigned milli_percent = ticks ? (100000ULL << 32) / ticks : 0;
+      debug_printf("%d.%d%d%d%s", milli_percent / 1000, (milli_percent / 100) % 10,
+          (milli_percent / 10) % 10, milli_percent % 10, "%");
+      break;
+    }
+    case RATE_PER_FRAME: {
+      unsigned frames_per_sec = ticks ? (100000000ULL << 32) / ticks : 0;
+      debug_printf("%d frames/s", frames_per_sec);
+      break;
+    }
+  }
+}
+
+/* Idle slopes are shown as a percentage of the line rate, like rates */
+static void print_idle_slope(unsigned slope)
+{
+  unsigned milli_percent = ((unsigned long long)slope * 100000 + SHAPER_SLOPE_ONE / 2) / SHAPER_SLOPE_ONE;
+  debug_printf("%d.%d%d%d%s", milli_percent / 1000, (milli_percent / 100) % 10,
+      (milli_percent / 10) % 10, milli_percent % 10, "%");
+}
+
+static const char *payload_names[] = { "incrementing", "prbs31", "constant", "random" };
+static const char *class_names[] = { "best effort", "B", "A" };
+
+static void print_sweep(const char *name, const mac_sweep_t *sweep)
+{
+  switch (sweep->mode) {
+    case SWEEP_OFF:
+      break;
+    case SWEEP_STEP:
+      debug_printf(", %s sweep of %d by %d", name, sweep->count, sweep->stride);
+      break;
+    case SWEEP_RANDOM:
+      debug_printf(", %s sweep random in %x", name, sweep->mask);
+      break;
+  }
+}
+
+static void print_tags(const pkt_settings_t *pkt_ctrl)
+{
+  if (!pkt_ctrl->vlan_tag_enabled) {
+    debug_printf(", tag disabled");
+    return;
+  }
+
+  if (pkt_ctrl->vlan_tag_enabled == VLAN_TAG_DOUBLE)
+    debug_printf(", service tag vlan %d prio %d", pkt_ctrl->outer_vlan, pkt_ctrl->outer_prio);
+
+  switch (pkt_ctrl->tag_mode) {
+    case TAG_FIXED:
+      debug_printf(", tag enabled vlan %d prio %d", pkt_ctrl->vlan, pkt_ctrl->prio);
+      break;
+    case TAG_CYCLE:
+      debug_printf(", tag cycling vlan %d-%d prio %d-%d", pkt_ctrl->vlan_min, pkt_ctrl->vlan_max,
+          pkt_ctrl->prio_min, pkt_ctrl->prio_max);
+      break;
+    case TAG_TABLE:
+      debug_printf(", tag table");
+      for (unsigned i = 0; i < pkt_ctrl->tag_count; i++)
+        debug_printf(" %d/%d:%d", pkt_ctrl->tag_table[i] & 0xfff, pkt_ctrl->tag_table[i] >> 13,
+            pkt_ctrl->tag_weight[i]);
+      break;
+  }
+}
+
+static void print_packet_control(const char *name, const generator_settings_t *settings, pkt_type_t pkt_type)
+{
+  const pkt_settings_t *pkt_ctrl = &settings->types[pkt_type];
+
+  if (pkt_ctrl->size_count) {
+    debug_printf("%s weight %d, packet bytes", name, pkt_ctrl->weight);
+    for (unsigned i = 0; i < pkt_ctrl->size_count; i++)
+      debug_printf(" %d:%d", pkt_ctrl->size_table[i], pkt_ctrl->size_weight[i]);
+  } else {
+    debug_printf("%s weight %d, packet bytes %d-%d", name, pkt_ctrl->weight, pkt_ctrl->size_min, pkt_ctrl->size_max);
+  }
+
+  if (pkt_type != TYPE_BROADCAST) {
+    const unsigned char *mac_address = (pkt_type == TYPE_UNICAST) ? settings->unicast_mac : settings->multicast_mac;
+    debug_printf(" [%x:%x:%x:%x:%x:%x]",
+        mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4], mac_address[5]);
+  }
+
+  print_sweep("destination", &pkt_ctrl->dest_sweep);
+  print_sweep("source", &pkt_ctrl->src_sweep);
+
+  print_tags(pkt_ctrl);
+  debug_printf(", payload %s", payload_names[pkt_ctrl->payload_pattern]);
+  if (pkt_ctrl->payload_pattern == PAYLOAD_CONSTANT)
+    debug_printf(" %x", pkt_ctrl->payload_value);
+  debug_printf(", rate ");
+  print_rate(&pkt_ctrl->rate);
+  if (pkt_ctrl->tx_class != TX_CLASS_BEST_EFFORT)
+    debug_printf(", class %s", class_names[pkt_ctrl->tx_class]);
+  debug_printf("\n");
+}
+
+static void print_gap_distribution(const gap_settings_t *dist)
+{
+  switch (dist->mode) {
+    case GAP_CONSTANT:
+      debug_printf("constant");
+      break;
+    case GAP_EXPONENTIAL:
+      debug_printf("exponential");
+      break;
+    case GAP_UNIFORM:
+      debug_printf("uniform +/-%d%s", dist->jitter_percent, "%");
+      break;
+    case GAP_TABLE:
+      debug_printf("table");
+      for (unsigned i = 0; i < dist->count; i++)
+        debug_printf(" %d%s:%d", dist->table_percent[i], "%", dist->table_weight[i]);
+      break;
+  }
+}
+
+static void print_config(const generator_settings_t *settings)
+{
+  debug_printf("(line rate ");
+  print_rate(&settings->line_rate);
+  debug_printf(", gaps ");
+  print_gap_distribution(&settings->gap_dist);
+  debug_printf(")\n");
+
+  print_packet_control("Unicast  ", settings, TYPE_UNICAST);
+  print_packet_control("Multicast", settings, TYPE_MULTICAST);
+  print_packet_control("Broadcast", settings, TYPE_BROADCAST);
+}
+
+static const char *mode_names[] = { "silent", "random", "directed", "burst", "replay", "capture" };
+static const char *type_names[] = { "unicast", "multicast", "broadcast" };
+
+/* The records of the last upload from the host, applied at the next swap */
+static config_upload_t g_upload;
+
+/* Set when 's' went back to the configuration before, which the settings are not of */
+static int g_swapped_back = 0;
+
+static int valid_pkt_type(unsigned char c)
+{
+  return (c == 'u') || (c == 'm') || (c == 'b');
+}
+
+static int valid_frame_size(uint32_t size)
+{
+  return (size >= MIN_FRAME_BYTES) && (size <= MAX_FRAME_BYTES);
+}
+
+static int valid_tag(uint32_t vlan, uint32_t prio)
+{
+  return (vlan <= 0xfff) && (prio <= 7);
+}
+
+/*
+ * Check a record of an upload, as none of the upload is used unless all of it is
+ * valid. The host has already checked the values it was given, so this only has to
+ * stop a damaged or mismatched upload from corrupting the configuration.
  */
-void handle_host_data(unsigned char buffer[], int bytes_read, generator_mode_t *generator_mode,
-    uintptr_t *ctrl_ptr, unsigned *rate_factor)
+static int config_record_valid(const protocol_record_t *record)
 {
-  tester_command_t cmd = buffer[0];
-  const unsigned char *ptr = &buffer[1]; // Skip command
-  switch (cmd) {
-    case CMD_SET_GENERATOR_MODE:
-      {
-        unsigned char c = get_next_char(&ptr);
-        switch (c) {
-          case 's': *generator_mode = GENERATOR_SILENT;   break;
-          case 'r': *generator_mode = GENERATOR_RANDOM;   break;
-          case 'd': *generator_mode = GENERATOR_DIRECTED; break;
-          default : break;
+  const uint32_t *args = config_record_args(record);
+  unsigned n = record->args;
+
+  switch (record->cmd) {
+    case CMD_SET_MAC_ADDRESS:
+      return ((record->type == 'u') || (record->type == 'm')) && (n == PROTOCOL_MAC_WORDS);
+
+    case CMD_PKT_CONTROL:
+      // A weight of zero leaves the sizes and payload as they are
+      if (!valid_pkt_type(record->type))
+        return 0;
+      if (n == 1)
+        return (record->sub == '-') && (args[0] == 0);
+      switch (record->sub) {
+        case '-': case 'i': case 'p': case 'r': if (n != 3) return 0; break;
+        case 'c': if (n != 4) return 0; break;
+        default : return 0;
+      }
+      return valid_frame_size(args[1]) && valid_frame_size(args[2]) && (args[1] <= args[2]);
+
+    case CMD_SIZE_TABLE:
+      if (!valid_pkt_type(record->type))
+        return 0;
+      if (record->sub == 'c')
+        return n == 0;
+      if ((record->sub != 'a') || (n % 2) || (n > 2 * MAX_SIZE_ENTRIES))
+        return 0;
+      for (unsigned i = 0; i < n; i += 2) {
+        if (!valid_frame_size(args[i]))
+          return 0;
+      }
+      return 1;
+
+    case CMD_VLAN_TAG:
+      if (!valid_pkt_type(record->type))
+        return 0;
+      switch (record->sub) {
+        case 'd': return n == 0;
+        case 'e': return (n == 2) && valid_tag(args[0], args[1]);
+        case 'q': return (n == 4) && valid_tag(args[0], args[1]) && valid_tag(args[2], args[3]);
+        case 'c':
+          return (n == 4) && valid_tag(args[0], args[2]) && valid_tag(args[1], args[3]) &&
+              (args[0] <= args[1]) && (args[2] <= args[3]);
+        case 't':
+          if ((n == 0) || (n % 3) || (n > 3 * MAX_TAG_ENTRIES))
+            return 0;
+          for (unsigned i = 0; i < n; i += 3) {
+            if (!valid_tag(args[i], args[i + 1]))
+              return 0;
+          }
+          return 1;
+        default : return 0;
+      }
+
+    case CMD_MAC_SWEEP:
+      if (!valid_pkt_type(record->type) || ((record->sub != 'd') && (record->sub != 's')) || (n != 3))
+        return 0;
+      // Broadcast frames keep the broadcast destination address
+      if ((record->type == 'b') && (record->sub == 'd') && (args[0] != 'o'))
+        return 0;
+      return (args[0] == 'o') || (args[0] == 's') || (args[0] == 'r');
+
+    case CMD_LINE_RATE:
+      if (n != 2)
+        return 0;
+      // The configuration itself always has a rate
+      if (record->type == '*')
+        return (record->sub == 'b') || (record->sub == 'f');
+      return valid_pkt_type(record->type) && ((record->sub == 'b') || (record->sub == 'f') || (record->sub == 'l'));
+
+    case CMD_GAP_DISTRIBUTION:
+      switch (record->sub) {
+        case 'c': case 'e': return n == 0;
+        case 'u': return (n == 1) && (args[0] <= 100);
+        case 't': {
+          int any_weight = 0;
+          if ((n % 2) || (n > 2 * GAP_TABLE_MAX_ENTRIES))
+            return 0;
+          for (unsigned i = 0; i < n; i += 2) {
+            if ((int)args[i + 1] > 0)
+              any_weight = 1;
+          }
+          return any_weight;
         }
+        default : return 0;
+      }
+
+    case CMD_FLOW:
+      if (record->sub == 'c')
+        return n == 0;
+      if ((record->sub != 'a') || !valid_pkt_type(record->type) || (n != PROTOCOL_FLOW_ARGS))
+        return 0;
+      {
+        // Sizes of 0 0 use those of the packet type, see add_flow()
+        uint32_t size_min = args[5] >> 16;
+        uint32_t size_max = args[5] & 0xffff;
+        if (size_min || size_max)
+          return valid_frame_size(size_min) && valid_frame_size(size_max) && (size_min <= size_max);
       }
+      return 1;
+
+    case CMD_SHAPER:
+      return (record->sub == 'c') && valid_pkt_type(record->type) && (n == 1) &&
+          ((args[0] == 'a') || (args[0] == 'b') || (args[0] == 'e'));
+
+    default:
+      return 0;
+  }
+}
+
+static void add_flow(pkt_type_t pkt_type, const uint32_t args[])
+{
+  flow_params_t params;
+  unsigned char macs[2 * MAC_ADDRESS_BYTES];
+
+  protocol_unpack_bytes(macs, args, sizeof(macs));
+  params.type = pkt_type;
+  memcpy(params.dest_mac, &macs[0], MAC_ADDRESS_BYTES);
+  memcpy(params.src_mac, &macs[MAC_ADDRESS_BYTES], MAC_ADDRESS_BYTES);
+  params.vlan_tag_enabled = args[3] >> 16;
+  params.vlan = args[3] & 0xfff;
+  params.prio = (args[3] >> 13) & 0x7;
+  params.ether_type = args[4] >> 16;
+  params.weight = args[4] & 0xffff;
+  params.size_min = args[5] >> 16;
+  params.size_max = args[5] & 0xffff;
+  if (flow_table_add(&params) < 0)
+    debug_printf("Flow not added, %d flows of %d and at most %d source addresses\n", flow_table_count(), MAX_FLOWS,
+        FLOW_SOURCE_MACS);
+}
+
+/* Apply a checked record of an upload to the settings */
+static void apply_config_record(generator_settings_t *settings, const protocol_record_t *record)
+{
+  const uint32_t *args = config_record_args(record);
+  unsigned n = record->args;
+  pkt_settings_t *pkt_ctrl = &settings->types[get_type_from_char(record->type)];
+
+  switch (record->cmd) {
+    case CMD_SET_MAC_ADDRESS:
+      protocol_unpack_bytes((record->type == 'u') ? settings->unicast_mac : settings->multicast_mac, args,
+          MAC_ADDRESS_BYTES);
       break;
 
     case CMD_PKT_CONTROL:
+      pkt_ctrl->weight = args[0];
+      if (n == 1)
+        break;
+      pkt_ctrl->size_min = args[1];
+      pkt_ctrl->size_max = args[2];
+
+      // An explicit size range replaces any table of sizes
+      pkt_ctrl->size_count = 0;
+
+      // The payload pattern is left unchanged unless one is given
+      switch (record->sub) {
+        case 'i': pkt_ctrl->payload_pattern = PAYLOAD_INCREMENT; pkt_ctrl->payload_value = 0; break;
+        case 'p': pkt_ctrl->payload_pattern = PAYLOAD_PRBS31;    pkt_ctrl->payload_value = 0; break;
+        case 'r': pkt_ctrl->payload_pattern = PAYLOAD_RANDOM;    pkt_ctrl->payload_value = 0; break;
+        case 'c': pkt_ctrl->payload_pattern = PAYLOAD_CONSTANT;  pkt_ctrl->payload_value = args[3]; break;
+        default : break;
+      }
+      break;
+
+    case CMD_SIZE_TABLE:
+      // Either (c)lear the table to return to size_min..size_max or (a)dd <size> <weight> pairs
+      if (record->sub == 'c')
+        pkt_ctrl->size_count = 0;
+      for (unsigned i = 0; (i < n) && (pkt_ctrl->size_count < MAX_SIZE_ENTRIES); i += 2) {
+        pkt_ctrl->size_table[pkt_ctrl->size_count] = args[i];
+        pkt_ctrl->size_weight[pkt_ctrl->size_count] = args[i + 1];
+        pkt_ctrl->size_count++;
+      }
+      break;
+
+    case CMD_MAC_SWEEP:
       {
-        unsigned char c = get_next_char(&ptr);
-        pkt_type_t pkt_type = get_type_from_char(c);
-        pkt_ctrl_t *pkt_ctrl = get_packet_control(pkt_type, g_directed_write_index);
-
-        pkt_ctrl->weight = convert_atoi_substr(&ptr);
-        if (pkt_ctrl->weight) {
-          pkt_ctrl->size_min = convert_atoi_substr(&ptr);
-          pkt_ctrl->size_max = convert_atoi_substr(&ptr);
+        // Sweep the (d)estination or (s)ource address: (o)ff, (s)tep <count> <stride>
+        // or (r)andom <mask>
+        mac_sweep_t *sweep = (record->sub == 's') ? &pkt_ctrl->src_sweep : &pkt_ctrl->dest_sweep;
+        switch (args[0]) {
+          case 's':
+            sweep->mode = SWEEP_STEP;
+            sweep->count = args[1];
+            sweep->stride = args[2];
+            sweep->mask = 0xffffffff;
+            break;
+          case 'r':
+            sweep->mode = SWEEP_RANDOM;
+            sweep->mask = args[1];
+            break;
+          default:
+            sweep->mode = SWEEP_OFF;
+            break;
         }
       }
       break;
 
     case CMD_VLAN_TAG:
-      {
-        unsigned char c = get_next_char(&ptr);
-        pkt_type_t pkt_type = get_type_from_char(c);
-        pkt_ctrl_t *pkt_ctrl = get_packet_control(pkt_type, g_directed_write_index);
-
-        unsigned char mode = get_next_char(&ptr);
-        if (mode == 'e') {
-          pkt_ctrl->vlan_tag_enabled = 1;
-          pkt_ctrl->vlan = convert_atoi_substr(&ptr);
-          pkt_ctrl->prio = convert_atoi_substr(&ptr);
-        } else {
+      // (e)nable a fixed tag, (q) a service tag and a fixed tag, (c)ycle the tag through
+      // <vlan_min> <vlan_max> <prio_min> <prio_max>, a (t)able of <vlan> <prio> <weight>
+      // or (d)isable tagging. A cycle or table keeps the tags already enabled.
+      switch (record->sub) {
+        case 'e':
+          pkt_ctrl->vlan_tag_enabled = VLAN_TAG_SINGLE;
+          pkt_ctrl->tag_mode = TAG_FIXED;
+          pkt_ctrl->vlan = args[0];
+          pkt_ctrl->prio = args[1];
+          break;
+        case 'q':
+          pkt_ctrl->vlan_tag_enabled = VLAN_TAG_DOUBLE;
+          pkt_ctrl->tag_mode = TAG_FIXED;
+          pkt_ctrl->outer_vlan = args[0];
+          pkt_ctrl->outer_prio = args[1];
+          pkt_ctrl->vlan = args[2];
+          pkt_ctrl->prio = args[3];
+          break;
+        case 'c':
+          if (!pkt_ctrl->vlan_tag_enabled)
+            pkt_ctrl->vlan_tag_enabled = VLAN_TAG_SINGLE;
+          pkt_ctrl->tag_mode = TAG_CYCLE;
+          pkt_ctrl->vlan_min = args[0];
+          pkt_ctrl->vlan_max = args[1];
+          pkt_ctrl->prio_min = args[2];
+          pkt_ctrl->prio_max = args[3];
+          break;
+        case 't':
+          if (!pkt_ctrl->vlan_tag_enabled)
+            pkt_ctrl->vlan_tag_enabled = VLAN_TAG_SINGLE;
+          pkt_ctrl->tag_mode = TAG_TABLE;
+          pkt_ctrl->tag_count = 0;
+          for (unsigned i = 0; i < n; i += 3) {
+            pkt_ctrl->tag_table[pkt_ctrl->tag_count] = args[i + 1] << 13 | args[i];
+            pkt_ctrl->tag_weight[pkt_ctrl->tag_count] = args[i + 2];
+            pkt_ctrl->tag_count++;
+          }
+          break;
+        default:
           pkt_ctrl->vlan_tag_enabled = 0;
-        }
+          pkt_ctrl->tag_mode = TAG_FIXED;
+          break;
       }
       break;
 
     case CMD_LINE_RATE:
-      g_rate_factor[g_directed_write_index] = convert_atoi_substr(&ptr);
+      {
+        // Either the line rate of the whole configuration (*) or that of one packet type
+        rate_t rate;
+        switch (record->sub) {
+          case 'b': rate.mode = RATE_PER_BIT;   break;
+          case 'f': rate.mode = RATE_PER_FRAME; break;
+          default : rate.mode = RATE_LINE;      break;
+        }
+        rate.ticks_hi = args[0];
+        rate.ticks_lo = args[1];
+
+        if (record->type == '*')
+          settings->line_rate = rate;
+        else
+          pkt_ctrl->rate = rate;
+      }
       break;
 
-    case CMD_SET_MAC_ADDRESS:
+    case CMD_GAP_DISTRIBUTION:
       {
-        unsigned char pkt_type = get_next_char(&ptr);
-        unsigned char mac_address[MAC_ADDRESS_BYTES] = { 0, 0, 0, 0, 0, 0 };
-        int error = parse_mac_address(ptr, mac_address);
-        if (error)
-          break;
-
-        switch (pkt_type) {
-          case 'u': set_unicast_mac_address(g_directed_write_index, mac_address); break;
-          case 'm': set_multicast_mac_address(g_directed_write_index, mac_address); break;
+        gap_settings_t *dist = &settings->gap_dist;
+
+        switch (record->sub) {
+          case 'c': gap_dist_set_constant(dist);    break;
+          case 'e': gap_dist_set_exponential(dist); break;
+          case 'u': gap_dist_set_uniform(dist, args[0]); break;
+          case 't': {
+            // Pairs of <percent of the mean gap> <weight>
+            unsigned percent[GAP_TABLE_MAX_ENTRIES];
+            int weights[GAP_TABLE_MAX_ENTRIES];
+            unsigned count = n / 2;
+            for (unsigned i = 0; i < count; i++) {
+              percent[i] = args[2 * i];
+              weights[i] = args[2 * i + 1];
+            }
+            gap_dist_set_table(dist, percent, weights, count);
+            break;
+          }
           default : break;
         }
       }
       break;
 
-    case CMD_PRINT_PKT_CONFIGURATION:
+    case CMD_FLOW:
+      // Either (c)lear the flow table or (a)dd a flow, see PROTOCOL_FLOW_ARGS
+      if (record->sub == 'c')
+        flow_table_clear();
+      else
+        add_flow(get_type_from_char(record->type), args);
+      break;
+
+    case CMD_SHAPER:
+      // Send a packet type from (c)lass <a|b|e>
+      pkt_ctrl->tx_class = get_class_from_char(args[0]);
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void print_status(void)
+{
+  generator_mode_t generator_mode = get_generator_mode();
+
+  debug_printf("Packet generator is running in %s mode on %x:%x:%x:%x:%x:%x\n",
+      mode_names[generator_mode],
+      g_src_mac[0], g_src_mac[1], g_src_mac[2], g_src_mac[3], g_src_mac[4], g_src_mac[5]);
+
+  if (generator_mode == GENERATOR_BURST) {
+    unsigned frames, gap;
+    get_burst(&frames, &gap);
+    debug_printf("Bursts of %d frames with a gap of %d ticks\n", frames, gap);
+  }
+
+  if (generator_mode == GENERATOR_REPLAY) {
+    unsigned frames;
+    int patch;
+    get_replay(&frames, &patch);
+    debug_printf("Replaying a ring of %d frames %s\n", frames, patch ? "numbered as sent" : "unchanged");
+  }
+
+  if (generator_mode == GENERATOR_PCAP)
+    pcap_player_print();
+
+  debug_printf("Transmitter catches up at most %d ticks after a stall\n", pacer_get_max_catchup());
+
+  debug_printf("Idle slope of class A ");
+  print_idle_slope(shaper_get_idle_slope(TX_CLASS_A));
+  debug_printf(", class B ");
+  print_idle_slope(shaper_get_idle_slope(TX_CLASS_B));
+  debug_printf(" (0 is not shaped)\n");
+
+  if (traffic_stats_get_interval())
+    debug_printf("Counters are sent every %d ticks\n", traffic_stats_get_interval());
+
+  buffers_stats_t stats;
+  buffers_stats_get(&stats);
+  debug_printf("Pool of %d buffers, %d in flight: since the last swap the generator was starved %d times,\n",
+      BUFFER_COUNT, BUFFERS_IN_FLIGHT, stats.generator_starved);
+  debug_printf("the transmitter was starved %d times and at most %d frames were queued\n",
+      stats.transmitter_starved, stats.max_queued);
+
+  for (int i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    if (g_traffic_stats.rx_frames[i])
+      debug_printf("Received %s %d frames: %d lost, %d reordered, %d duplicated, %d with payload errors\n",
+          type_names[i], g_traffic_stats.rx_frames[i], g_traffic_stats.rx_lost[i],
+          g_traffic_stats.rx_reordered[i], g_traffic_stats.rx_duplicates[i],
+          g_traffic_stats.rx_pattern_errors[i]);
+  }
+  if (g_traffic_stats.rx_restarts)
+    debug_printf("The sender restarted %d times\n", g_traffic_stats.rx_restarts);
+  if (rx_analyzer_get_reflect())
+    debug_printf("Received frames are reflected back\n");
+  debug_printf("Latency buckets are %d ticks wide\n", 1 << latency_get_shift());
+  if (flow_table_count())
+    debug_printf("%d flows, in use: %d unicast, %d multicast, %d broadcast\n", flow_table_count(),
+        flow_table_active(TYPE_UNICAST), flow_table_active(TYPE_MULTICAST), flow_table_active(TYPE_BROADCAST));
+
+  debug_printf("Configuration ");
+  print_config(config_settings());
+  if (g_swapped_back)
+    debug_printf("The other configuration is swapped in, 'e' swaps this one in again\n");
+
+  debug_printf("Press 'e' to swap in the changes, 's' with none goes back to the configuration before\n");
+  scenario_print();
+  if (g_upload.pending)
+    debug_printf("An upload of %d words from the host is applied at the next swap\n", g_upload.length);
+}
+
+/*
+ * Hand the next configuration to the generator, which moves onto it between
+ * frames. With apply set, or changes to make, it is prepared from the settings.
+ * Otherwise the configuration before the current one is published again as it
+ * was, so 's' goes back and forth between the last two.
+ */
+static void swap_config(int apply)
+{
+  generator_config_t *next = config_next();
+
+  // The upload is applied to the settings as a whole just before they are used
+  if (g_upload.pending) {
+    unsigned position = 0;
+    const protocol_record_t *record;
+    while ((record = config_records_next(g_upload.words, g_upload.length, &position)) != NULL)
+      apply_config_record(config_settings(), record);
+    g_upload.pending = 0;
+    apply = 1;
+  }
+
+  // Build the tables and headers used by the configuration before it is published
+  if (apply)
+    prepare_config(next, config_settings());
+  g_swapped_back = apply ? 0 : !g_swapped_back;
+  config_publish();
+
+  buffers_stats_reset();
+  rx_analyzer_reset();
+  latency_clear(latency_get_shift());
+}
+
+/* The arguments of a command, those missing are taken as zero */
+static uint32_t command_arg(const protocol_record_t *record, unsigned index)
+{
+  return (index < record->args) ? config_record_args(record)[index] : 0;
+}
+
+/* Handle a record of a command message, which takes effect at once */
+static void handle_command(const protocol_record_t *record)
+{
+  switch (record->cmd) {
+    case CMD_SET_GENERATOR_MODE:
+      switch (record->sub) {
+        case 's': set_generator_mode(GENERATOR_SILENT);   break;
+        case 'r': set_generator_mode(GENERATOR_RANDOM);   break;
+        case 'd': set_generator_mode(GENERATOR_DIRECTED); break;
+        case 'b':
+          // Bursts of <frames> back-to-back frames separated by <gap> ticks
+          set_burst(command_arg(record, 0), command_arg(record, 1));
+          set_generator_mode(GENERATOR_BURST);
+          break;
+        case 'p':
+          // A ring of <frames> replayed by the transmitter, renumbered on each pass if <patch> is set
+          set_replay(command_arg(record, 0), command_arg(record, 1));
+          break;
+        default : break;
+      }
+      break;
+
+    case CMD_STATS_INTERVAL:
+      traffic_stats_set_interval(command_arg(record, 0));
+      break;
+
+    case CMD_LATENCY:
+      // Either (r)eport the latency or (c)lear it with buckets of 2^<shift> ticks
+      switch (record->sub) {
+        case 'r': latency_send(); break;
+        case 'c': latency_clear(command_arg(record, 0)); break;
+        default : break;
+      }
+      break;
+
+    case CMD_REFLECT:
+      rx_analyzer_set_reflect(record->sub == 'e');
+      break;
+
+    case CMD_CATCHUP_LIMIT:
+      pacer_set_max_catchup(command_arg(record, 0));
+      break;
+
+    case CMD_SHAPER:
       {
-        pkt_ctrl_t *pkt_ctrl = NULL;
-        unsigned char mac_address[6];
-
-        debug_printf("Packet generator is running in %s mode on %x:%x:%x:%x:%x:%x\n",
-            (*generator_mode == 0) ? "silent" : (*generator_mode == 1) ? "random" : "directed",
-            g_src_mac[0], g_src_mac[1], g_src_mac[2], g_src_mac[3], g_src_mac[4], g_src_mac[5]);
-
-        int directed_read_index = g_directed_write_index ? 0 : 1;
-
-        get_unicast_mac_address(directed_read_index, mac_address);
-
-        debug_printf("Current configuration (%d rate factor)\n", g_rate_factor[directed_read_index]);
-        pkt_ctrl = get_packet_control(TYPE_UNICAST, directed_read_index);
-        debug_printf("Unicast   weight %d, packet bytes %d-%d [%x:%x:%x:%x:%x:%x], tag %s vlan %d prio %d\n",
-            pkt_ctrl->weight, pkt_ctrl->size_min, pkt_ctrl->size_max,
-            mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4], mac_address[5],
-            pkt_ctrl->vlan_tag_enabled ? "enabled" : "disabled", pkt_ctrl->vlan, pkt_ctrl->prio);
-
-        get_multicast_mac_address(g_directed_write_index, mac_address);
-        pkt_ctrl = get_packet_control(TYPE_MULTICAST, directed_read_index);
-        debug_printf("Multicast weight %d, packet bytes %d-%d [%x:%x:%x:%x:%x:%x], tag %s vlan %d prio %d\n",
-            pkt_ctrl->weight, pkt_ctrl->size_min, pkt_ctrl->size_max,
-            mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4], mac_address[5],
-            pkt_ctrl->vlan_tag_enabled ? "enabled" : "disabled", pkt_ctrl->vlan, pkt_ctrl->prio);
-
-        pkt_ctrl = get_packet_control(TYPE_BROADCAST, directed_read_index);
-        debug_printf("Broadcast weight %d, packet bytes %d-%d, tag %s vlan %d prio %d\n",
-            pkt_ctrl->weight, pkt_ctrl->size_min, pkt_ctrl->size_max,
-            pkt_ctrl->vlan_tag_enabled ? "enabled" : "disabled", pkt_ctrl->vlan, pkt_ctrl->prio);
-        
-
-        debug_printf("Next configuration (%d rate factor):\n", g_rate_factor[g_directed_write_index]);
-
-        get_unicast_mac_address(g_directed_write_index, mac_address);
-        pkt_ctrl = get_packet_control(TYPE_UNICAST, g_directed_write_index);
-        debug_printf("Unicast   weight %d, packet bytes %d-%d [%x:%x:%x:%x:%x:%x], tag %s vlan %d prio %d\n",
-            pkt_ctrl->weight, pkt_ctrl->size_min, pkt_ctrl->size_max,
-            mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4], mac_address[5],
-            pkt_ctrl->vlan_tag_enabled ? "enabled" : "disabled", pkt_ctrl->vlan, pkt_ctrl->prio);
-
-        get_multicast_mac_address(g_directed_write_index, mac_address);
-        pkt_ctrl = get_packet_control(TYPE_MULTICAST, g_directed_write_index);
-        debug_printf("Multicast weight %d, packet bytes %d-%d [%x:%x:%x:%x:%x:%x], tag %s vlan %d prio %d\n",
-            pkt_ctrl->weight, pkt_ctrl->size_min, pkt_ctrl->size_max,
-            mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4], mac_address[5],
-            pkt_ctrl->vlan_tag_enabled ? "enabled" : "disabled", pkt_ctrl->vlan, pkt_ctrl->prio);
-        
-        pkt_ctrl = get_packet_control(TYPE_BROADCAST, g_directed_write_index);
-        debug_printf("Broadcast weight %d, packet bytes %d-%d, tag %s vlan %d prio %d\n",
-            pkt_ctrl->weight, pkt_ctrl->size_min, pkt_ctrl->size_max,
-            pkt_ctrl->vlan_tag_enabled ? "enabled" : "disabled", pkt_ctrl->vlan, pkt_ctrl->prio);
-
-        debug_printf("Press 's' to swap, press 'e' to update and copy\n");
+        // Set the idle slope of class <a|b> as a fraction of the line rate in 0.16 fixed
+        // point, the classes of packet types are part of the configuration
+        tx_class_t tx_class = get_class_from_char(record->type);
+        unsigned slope = command_arg(record, 0);
+        if ((record->sub == 's') && (tx_class != TX_CLASS_BEST_EFFORT) && (slope <= SHAPER_SLOPE_ONE))
+          shaper_set_idle_slope(tx_class, slope);
       }
       break;
 
-    case CMD_APPLY_CFG:
-      // Pass the write index as the read index as it is just about to be swapped
-      copy_over_config(g_directed_write_index);
-      // fall through
+    case CMD_FLOW:
+      if (record->sub == 'p')
+        flow_table_print();
+      break;
+
+    case CMD_SCENARIO:
+      // (r)un the scenario once, or in a (l)oop, or (s)top it where it is
+      switch (record->sub) {
+        case 'r': scenario_start(0); break;
+        case 'l': scenario_start(1); break;
+        case 's': scenario_stop();   break;
+        default : break;
+      }
+      break;
 
-    case CMD_SWAP_CFG: {
-      // The read index is the write index as it will be swapped below
-      int directed_read_index = g_directed_write_index;
-      if (*generator_mode == GENERATOR_RANDOM)
-        *ctrl_ptr = (uintptr_t)&initial;
-      else if (*generator_mode == GENERATOR_DIRECTED)
-        *ctrl_ptr = (uintptr_t)&directed[directed_read_index];
+    case CMD_PCAP:
+      // (s)tart playing a capture the host is about to stream, with the id it gave the stream
+      if (record->sub == 's')
+        pcap_player_start(command_arg(record, 0));
+      break;
 
-      *rate_factor = g_rate_factor[directed_read_index];
+    case CMD_PRINT_PKT_CONFIGURATION:
+      print_status();
+      break;
 
-      set_directed_read_index(g_directed_write_index);
-      g_directed_write_index = g_directed_write_index ? 0 : 1;
+    case CMD_APPLY_CFG:
+    case CMD_SWAP_CFG:
+      swap_config(record->cmd == CMD_APPLY_CFG);
+      break;
+
+    default:
+      debug_printf("Unrecognised command '%c' received from host\n", record->cmd);
       break;
+  }
+}
+
+/* Besides configuration changes a scenario can change the generation mode and start phases */
+static int scenario_record_valid(const protocol_record_t *record)
+{
+  const uint32_t *args = config_record_args(record);
+
+  switch (record->cmd) {
+    case CMD_SCENARIO:
+      return (record->sub == 'p') && (record->args == 1) && (args[0] > 0);
+    case CMD_SET_GENERATOR_MODE:
+      if (record->sub == 'b')
+        return (record->args == 2) && (args[0] > 0) && (args[0] <= MAX_BURST_FRAMES);
+      return ((record->sub == 's') || (record->sub == 'r') || (record->sub == 'd')) && (record->args == 0);
+    default:
+      return config_record_valid(record);
+  }
+}
+
+static void handle_commit(const protocol_commit_t *commit)
+{
+  unsigned position = 0;
+  const protocol_record_t *record;
+  int scenario = (commit->swap == CMD_SCENARIO);
+
+  if (!config_upload_check(&g_upload, commit))
+    return;
+
+  while ((record = config_records_next(g_upload.words, g_upload.length, &position)) != NULL) {
+    if (!(scenario ? scenario_record_valid(record) : config_record_valid(record))) {
+      debug_printf("Upload rejected: command '%c %c %c' with %d arguments is not valid\n",
+          record->cmd, record->sub, record->type, record->args);
+      g_upload.length = 0;
+      return;
     }
+  }
+
+  if (scenario) {
+    // The scenario keeps its own copy, so the upload is free for configuration changes
+    scenario_load(g_upload.words, g_upload.length);
+    g_upload.length = 0;
+    return;
+  }
+
+  g_upload.pending = 1;
+  if ((commit->swap == CMD_APPLY_CFG) || (commit->swap == CMD_SWAP_CFG))
+    swap_config(commit->swap == CMD_APPLY_CFG);
+}
+
+int scenario_step(unsigned *wait_ticks)
+{
+  if (scenario_wait(wait_ticks))
+    return 1;
+
+  unsigned length;
+  const uint32_t *records = scenario_next_phase(&length);
+  if (!records)
+    return 0;
+
+  // Apply the phase's changes to the settings and swap them in as 'e' does
+  unsigned position = 0;
+  const protocol_record_t *record;
+  while ((record = config_records_next(records, length, &position)) != NULL) {
+    if (record->cmd == CMD_SET_GENERATOR_MODE)
+      handle_command(record);
+    else
+      apply_config_record(config_settings(), record);
+  }
+  swap_config(1);
+
+  if (!scenario_wait(wait_ticks))
+    *wait_ticks = 0;
+  return 1;
+}
+
+/**
+ * \brief   A function that processes data being sent from the host and
+ *          informs the analysis engine of any changes
+ *
+ *          The buffer is word aligned and holds one message of host_protocol.h.
+ */
+void handle_host_data(unsigned char buffer[], int bytes_read)
+{
+  const protocol_header_t *header = (const protocol_header_t *)buffer;
+  const uint32_t *words = (const uint32_t *)buffer;
+  unsigned count = bytes_read / 4;
+
+  if ((bytes_read < (int)sizeof(protocol_header_t)) || (bytes_read % 4) ||
+      (header->magic != PROTOCOL_MAGIC) || (header->version != PROTOCOL_VERSION)) {
+    debug_printf("Message of %d bytes received from host not recognised, protocol version %d expected\n",
+        bytes_read, PROTOCOL_VERSION);
+    return;
+  }
+
+  switch (header->message) {
+    case MSG_COMMANDS:
+      {
+        unsigned position = 1;
+        const protocol_record_t *record;
+        while ((record = config_records_next(words, count, &position)) != NULL) {
+          if (position > count) {
+            debug_printf("Command '%c' received from host is incomplete\n", record->cmd);
+            break;
+          }
+          handle_command(record);
+        }
+      }
+      break;
+
+    case MSG_UPLOAD_DATA:
+      if (count >= 2)
+        config_upload_data(&g_upload, words[1], &words[2], count - 2);
+      break;
+
+    case MSG_UPLOAD_COMMIT:
+      if (count >= 1 + sizeof(protocol_commit_t) / 4)
+        handle_commit((const protocol_commit_t *)&words[1]);
+      break;
+
+    case MSG_PCAP_DATA:
+      if (count >= 3)
+        pcap_player_data(words[1], words[2], &words[3], count - 3);
+      break;
+
+    case MSG_PCAP_COMMIT:
+      if (count >= 1 + sizeof(protocol_pcap_commit_t) / 4)
+        pcap_player_commit((const protocol_pcap_commit_t *)&words[1]);
+      break;
 
     default:
-      debug_printf("Unrecognised command '%s' with bytes: %d received from host\n", buffer, bytes_read);
+      debug_printf("Unrecognised message %d received from host\n", header->message);
       break;
-  } //switch (cmd)
+  }
 }
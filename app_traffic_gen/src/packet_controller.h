@@ -7,8 +7,18 @@
 extern "C" {
 #endif
 
-void handle_host_data(unsigned char buffer[], int bytes_read,
-    generator_mode_t *generator_mode, uintptr_t *ctrl_ptr, unsigned *rate_factor);
+/*
+ * Handle a message from the host, in the control task. Configurations swapped in
+ * and changes of mode are taken up by the generator with generator_update().
+ */
+void handle_host_data(unsigned char buffer[], int bytes_read);
+
+/*
+ * Step the scenario at the end of a wait, see scenario.h, moving to its next phase
+ * when the current one is over. Returns 1 with the ticks to wait before the next
+ * step, or 0 when the scenario has ended.
+ */
+int scenario_step(unsigned *wait_ticks);
 
 #ifdef __XC__
 }
@@ -11,230 +11,756 @@
 #include "debug_print.h"
 #include "packet_controller.h"
 #include "packet_generator.h"
+#include "buffers.h"
+#include "pacer.h"
+#include "gap_distribution.h"
+#include "traffic_stats.h"
+#include "payload.h"
+#include "flow_table.h"
+#include "generator_config.h"
+#include "replay.h"
 
-volatile int g_directed_read_index = 0;
-
-unsigned char g_unicast_mac[2][MAC_ADDRESS_BYTES] = {
-  { 0x00, 0x22, 0x97, 0x00, 0x42, 0xa2 },
-  { 0x00, 0x22, 0x97, 0x00, 0x42, 0xa2 },
-};
-unsigned char g_multicast_mac[2][MAC_ADDRESS_BYTES] = {
-  { 0x01, 0x22, 0x97, 0x00, 0x42, 0xa6 },
-  { 0x01, 0x22, 0x97, 0x00, 0x42, 0xa6 },
-};
 unsigned char g_src_mac[MAC_ADDRESS_BYTES] = { 0, 0, 0, 0, 0, 0 };
 unsigned char g_broadcast_addr[MAC_ADDRESS_BYTES] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 
-static void fill_pkt_hdr(char *seq_num_ptr)
+/* Each header template built is given a new id so buffers can tell if they hold it */
+static unsigned g_next_header_id = HEADER_ID_NONE + 1;
+
+typedef struct sweep_position_t {
+  unsigned int index;
+  unsigned int offset;
+} sweep_position_t;
+
+/*
+ * What changes for every frame of each packet type, kept here so the configuration
+ * is only read. Restarted whenever the generator moves onto a new configuration.
+ */
+typedef struct type_state_t {
+  sweep_position_t dest_sweep;
+  sweep_position_t src_sweep;
+  unsigned int next_tci;  // The next tag of a cycle
+  const flow_t *next_flow; // The flow chosen with the frame length, kept for gen_frame()
+} type_state_t;
+
+/*
+ * Everything a producer changes as it fills frames, so that several can fill
+ * frames at once. Only the producer's own task uses it.
+ */
+typedef struct flow_seq_t {
+  unsigned header_id; // The flow numbered, which keeps its id in every configuration
+  unsigned seq_num;
+} flow_seq_t;
+
+typedef struct producer_t {
+  // The configuration in use, only changed between frames by generator_update()
+  const generator_config_t *config;
+
+  type_state_t type_state[TRAFFIC_GEN_TYPES];
+
+  // Each packet type is numbered separately so a receiver can tell which of its
+  // frames were lost. So is each flow, starting again when another is added at its index.
+  unsigned seq_num[TRAFFIC_GEN_TYPES];
+  flow_seq_t flow_seq[MAX_FLOWS];
+  unsigned seq_base; // The producer's index in the top bits of its sequence numbers
+
+  // The fractions of a tick left over from the last frame's period and the last scaled gap
+  unsigned period_fraction;
+  unsigned gap_fraction;
+
+  // Gaps, random payloads and swept addresses are drawn from their own generators
+  // so they do not change the frame choices
+  random_generator_t gap_random;
+  random_generator_t payload_random;
+  random_generator_t sweep_random;
+
+  // Burst mode: the frames in each burst, the gap between bursts and the position in the burst
+  unsigned burst_frames;
+  unsigned burst_gap;
+  unsigned burst_position;
+
+  // Replay mode: the frames of the ring still to fill and the marks they are given
+  unsigned replay_left;
+  unsigned replay_flags;
+
+  // The count of the mode request last taken
+  unsigned mode_taken;
+} producer_t;
+
+static producer_t g_producers[GENERATOR_PRODUCERS];
+
+/*
+ * The mode the controller asks for, with its bursts and replay ring, written under
+ * a sequence lock: the count is odd while the request is changing, so the
+ * generator only keeps a copy read between two even counts that are the same.
+ */
+typedef struct mode_request_t {
+  generator_mode_t mode;
+  unsigned burst_frames;
+  unsigned burst_gap;
+  unsigned replay_frames;
+  int replay_patch;
+} mode_request_t;
+
+static volatile unsigned g_mode_sequence = 0;
+static volatile mode_request_t g_mode_request = { GENERATOR_SILENT, 1, 0, 1, 0 };
+
+static void fill_pkt_hdr(unsigned char *seq_num_ptr, unsigned *next_seq_num, unsigned seq_base)
 {
-  static unsigned seq_num = 1;
+  unsigned seq_num = *next_seq_num;
+  *next_seq_num = (seq_num + 1) & PRODUCER_SEQ_MASK;
+  seq_num |= seq_base;
   seq_num_ptr[3] = seq_num & 0xFF;
   seq_num_ptr[2] = (seq_num >> 8) & 0xFF;
   seq_num_ptr[1] = (seq_num >> 16) & 0xFF;
   seq_num_ptr[0] = (seq_num >> 24) & 0xFF;
-  seq_num++;
 }
 
-void gen_header(packet_data_t *ptr, pkt_ctrl_t *ctrl, unsigned short ether_type)
+unsigned new_header_id(void)
+{
+  return g_next_header_id++;
+}
+
+unsigned flow_seq_num(unsigned producer, unsigned flow, unsigned header_id)
+{
+  const flow_seq_t *flow_seq = &g_producers[producer].flow_seq[flow];
+  return (flow_seq->header_id == header_id) ? flow_seq->seq_num : 1;
+}
+
+unsigned build_header(unsigned header[], const unsigned char dest_mac[], const unsigned char src_mac[],
+    unsigned vlan_tag_enabled, unsigned outer_tci, unsigned vlan_tci, unsigned ether_type, unsigned flow_id)
+{
+  unsigned char *hdr = (unsigned char *)header;
+  unsigned offset = 0;
+
+  memset(header, 0, HEADER_TEMPLATE_WORDS * sizeof(unsigned));
+
+  memcpy(&hdr[0], dest_mac, MAC_ADDRESS_BYTES);
+  memcpy(&hdr[MAC_ADDRESS_BYTES], src_mac, MAC_ADDRESS_BYTES);
+  offset = 2 * MAC_ADDRESS_BYTES;
+
+  if (vlan_tag_enabled == VLAN_TAG_DOUBLE) {
+    hdr[offset++] = ETHERTYPE_QINQ >> 8;
+    hdr[offset++] = ETHERTYPE_QINQ & 0xff;
+    hdr[offset++] = outer_tci >> 8;
+    hdr[offset++] = outer_tci & 0xff;
+  }
+
+  if (vlan_tag_enabled) {
+    hdr[offset++] = ETHERTYPE_VLAN >> 8;
+    hdr[offset++] = ETHERTYPE_VLAN & 0xff;
+    hdr[offset++] = vlan_tci >> 8;
+    hdr[offset++] = vlan_tci & 0xff;
+  }
+
+  hdr[offset++] = ether_type >> 8;
+  hdr[offset++] = ether_type & 0xff;
+
+  hdr[FRAME_FLOW_OFFSET] = flow_id >> 8;
+  hdr[FRAME_FLOW_OFFSET + 1] = flow_id & 0xff;
+
+  return offset;
+}
+
+/*
+ * Build the header template for a packet type. This holds everything up to the
+ * flow id, of which the sequence number and any swept address or changing VLAN
+ * tag are written for every frame.
+ */
+static void prepare_header(pkt_ctrl_t *ctrl, unsigned vlan_tag_enabled, unsigned outer_tci, unsigned vlan_tci,
+    const generator_settings_t *settings)
+{
+  const unsigned char *dest_mac = g_broadcast_addr;
+  const unsigned char *src_mac = g_broadcast_addr;
+
+  switch (ctrl->type) {
+    case TYPE_UNICAST:
+      dest_mac = settings->unicast_mac;
+      src_mac = g_src_mac;
+      break;
+    case TYPE_MULTICAST:
+      dest_mac = settings->multicast_mac;
+      src_mac = g_src_mac;
+      break;
+    case TYPE_BROADCAST:
+      break;
+  }
+
+  ctrl->seq_offset = build_header(ctrl->header, dest_mac, src_mac, vlan_tag_enabled, outer_tci, vlan_tci,
+      TRAFFIC_GEN_ETHERTYPE + ctrl->type, FLOW_NONE);
+  ctrl->header_id = new_header_id();
+}
+
+static inline unsigned get_bits_on_wire(unsigned len)
 {
-  if (ctrl->vlan_tag_enabled) {
-    packet_data_vlan_t *ptr_vlan = (packet_data_vlan_t *)ptr;
-    ptr_vlan->tpid[0] = 0x81;
-    ptr_vlan->tpid[1] = 0x00;
+  const int ifg_bytes = 96/8;
+  const int preamble_bytes = 8;
+  const int crc_bytes = 4;
+  return (len + ifg_bytes + preamble_bytes + crc_bytes) * 8;
+}
 
-    unsigned short vlan_tag = (ctrl->prio & 0x7) << 13 | (ctrl->vlan & 0xfff);
-    ptr_vlan->vlan_prio[0] = vlan_tag >> 8;
-    ptr_vlan->vlan_prio[1] = vlan_tag & 0xff;
+/* Move the sweep on, returning the amount to add to the address of this frame */
+static inline unsigned sweep_next(producer_t *p, const mac_sweep_t *sweep, sweep_position_t *position)
+{
+  if (sweep->mode == SWEEP_RANDOM)
+    return random_get_random_number(&p->sweep_random);
 
-    ptr_vlan->frame_type[0] = ether_type >> 8;
-    ptr_vlan->frame_type[1] = ether_type & 0xff;
-    fill_pkt_hdr(ptr_vlan->seq_num);
+  unsigned offset = position->offset;
+  if (++position->index == sweep->count) {
+    position->index = 0;
+    position->offset = 0;
   } else {
-    ptr->frame_type[0] = ether_type >> 8;
-    ptr->frame_type[1] = ether_type & 0xff;
-    fill_pkt_hdr(ptr->seq_num);
+    position->offset = offset + sweep->stride;
   }
+  return offset;
 }
 
-void gen_unicast_frame(uintptr_t pkt_dptr, pkt_ctrl_t *ctrl)
+/* Write the swept low 32 bits of the template's address over those in the frame */
+static inline void sweep_address(producer_t *p, unsigned char *frame_mac, const unsigned char *header_mac,
+    const mac_sweep_t *sweep, sweep_position_t *position)
 {
-  packet_data_t *ptr = (packet_data_t *)pkt_dptr;
-  memcpy(ptr->dest_mac, g_unicast_mac[g_directed_read_index], MAC_ADDRESS_BYTES);
-  memcpy(ptr->src_mac, g_src_mac, MAC_ADDRESS_BYTES);
-  gen_header(ptr, ctrl, 0x8932);
+  unsigned low = (header_mac[2] << 24) | (header_mac[3] << 16) | (header_mac[4] << 8) | header_mac[5];
+  low = (low & ~sweep->mask) | ((low + sweep_next(p, sweep, position)) & sweep->mask);
+  frame_mac[2] = low >> 24;
+  frame_mac[3] = (low >> 16) & 0xff;
+  frame_mac[4] = (low >> 8) & 0xff;
+  frame_mac[5] = low & 0xff;
 }
 
-void gen_multicast_frame(uintptr_t pkt_dptr, pkt_ctrl_t *ctrl)
+/* The tag control bytes of the next frame of a packet type whose VLAN tag changes */
+static inline unsigned tag_next(producer_t *p, const pkt_ctrl_t *ctrl, type_state_t *state)
 {
+  if (ctrl->tag_alias_count)
+    return ctrl->tables->tag_table[alias_table_sample(ctrl->tables->tag_alias, ctrl->tag_alias_count,
+        random_get_random_number(&p->sweep_random))];
+
+  unsigned tci = state->next_tci;
+  if ((tci & 0xfff) != ctrl->vlan_max)
+    state->next_tci = tci + 1;
+  else if ((tci >> 13) != ctrl->prio_max)
+    state->next_tci = (((tci >> 13) + 1) << 13) | ctrl->vlan_min;
+  else
+    state->next_tci = (ctrl->prio_min << 13) | ctrl->vlan_min;
+  return tci;
+}
+
+/* Write the header and payload into the buffer. Returns the number of bytes used in the buffer. */
+static inline unsigned fill_frame(unsigned producer, uintptr_t pkt_dptr, pkt_ctrl_t *ctrl, unsigned len)
+{
+  producer_t *p = &g_producers[producer];
   packet_data_t *ptr = (packet_data_t *)pkt_dptr;
-  memcpy(ptr->dest_mac, g_multicast_mac[g_directed_read_index], MAC_ADDRESS_BYTES);
-  memcpy(ptr->src_mac, g_src_mac, MAC_ADDRESS_BYTES);
-  gen_header(ptr, ctrl, 0x8933);
+  const unsigned *header = ctrl->header;
+  unsigned header_id = ctrl->header_id;
+  unsigned seq_offset = ctrl->seq_offset;
+  unsigned *seq_num = &p->seq_num[ctrl->type];
+  type_state_t *state = &p->type_state[ctrl->type];
+
+  const flow_t *flow = NULL;
+
+  if (ctrl->flow_count) {
+    flow = state->next_flow;
+    flow_seq_t *flow_seq = &p->flow_seq[flow->index];
+    header_id = flow->header_id;
+    seq_offset = flow->seq_offset;
+    if (flow_seq->header_id != header_id) {
+      flow_seq->header_id = header_id;
+      flow_seq->seq_num = 1;
+    }
+    seq_num = &flow_seq->seq_num;
+  }
+
+  // Only write the header if the buffer doesn't already hold it, clearing up to the payload.
+  // A flow's header is built from the flow as it is not kept as a template.
+  unsigned char *frame = (unsigned char *)(pkt_dptr + BUFFER_OVERHEAD_BYTES);
+  unsigned *dst = (unsigned *)frame;
+  if (ptr->header_id != header_id) {
+    if (flow) {
+      flow_table_header(dst, &p->config->flows, flow);
+    } else {
+      for (unsigned i = 0; i < HEADER_TEMPLATE_WORDS; i++)
+        dst[i] = header[i];
+    }
+    for (unsigned i = HEADER_TEMPLATE_WORDS; i < PAYLOAD_START_WORD; i++)
+      dst[i] = 0;
+    ptr->header_id = header_id;
+  }
+  fill_pkt_hdr(&frame[seq_offset], seq_num, p->seq_base);
+
+  // A changing tag and a swept address differ from those held by the buffer for every frame
+  if (ctrl->tag_offset && !ctrl->flow_count) {
+    unsigned tci = tag_next(p, ctrl, state);
+    frame[ctrl->tag_offset] = tci >> 8;
+    frame[ctrl->tag_offset + 1] = tci & 0xff;
+  }
+  if (ctrl->dest_sweep.mode)
+    sweep_address(p, &frame[0], flow ? flow->dest_mac : (const unsigned char *)header,
+        &ctrl->dest_sweep, &state->dest_sweep);
+  if (ctrl->src_sweep.mode)
+    sweep_address(p, &frame[MAC_ADDRESS_BYTES],
+        flow ? p->config->flows.src_macs[flow->src] : (const unsigned char *)header + MAC_ADDRESS_BYTES,
+        &ctrl->src_sweep, &state->src_sweep);
+
+  // Only write the payload beyond what the buffer already holds of the same pattern. A buffer
+  // that has never been used holds none, whatever its pattern appears to be.
+  unsigned words = (len + sizeof(unsigned) - 1) / sizeof(unsigned);
+  if (ptr->payload_pattern != ctrl->payload_pattern || ptr->payload_value != ctrl->payload_value ||
+      ptr->payload_words < PAYLOAD_START_WORD) {
+    ptr->payload_pattern = ctrl->payload_pattern;
+    ptr->payload_value = ctrl->payload_value;
+    ptr->payload_words = PAYLOAD_START_WORD;
+  }
+  if (ptr->payload_words < words) {
+    payload_fill(dst, ptr->payload_words, words, ctrl->payload_pattern, ctrl->payload_value,
+        &p->payload_random);
+    ptr->payload_words = words;
+  }
+
+  // Random words are kept by the buffer too, only the first is new so that no two frames match
+  if (ctrl->payload_pattern == PAYLOAD_RANDOM && words > PAYLOAD_START_WORD)
+    dst[PAYLOAD_START_WORD] = random_get_random_number(&p->payload_random);
+  ptr->tx_class = ctrl->tx_class;
+  traffic_stats_generated(producer, ctrl->type, len);
+
+  return len + BUFFER_OVERHEAD_BYTES;
 }
 
-void gen_broadcast_frame(uintptr_t pkt_dptr, pkt_ctrl_t *ctrl)
+/*
+ * Fill in the buffer for a frame of the chosen type and length. Returns the number
+ * of bytes used in the buffer, including the overhead used by the transmitter.
+ */
+unsigned gen_frame(unsigned producer, uintptr_t pkt_dptr, pkt_ctrl_t *ctrl, unsigned len)
 {
+  producer_t *p = &g_producers[producer];
   packet_data_t *ptr = (packet_data_t *)pkt_dptr;
-  memcpy(ptr->dest_mac, g_broadcast_addr, MAC_ADDRESS_BYTES);
-  memcpy(ptr->src_mac, g_broadcast_addr, MAC_ADDRESS_BYTES);
-  gen_header(ptr, ctrl, 0x8934);
+  const rate_t *rate = &ctrl->active_rate;
+  unsigned multiplier = (rate->mode == RATE_PER_FRAME) ? 1 : get_bits_on_wire(len);
+
+  // Scale by the 32.32 multiplier in 64 bits so 1518-byte frames cannot overflow. The
+  // fraction of a tick is carried into the next frame so the average is exact.
+  unsigned long long fraction = (unsigned long long)multiplier * rate->ticks_lo + p->period_fraction;
+  unsigned long long period = (unsigned long long)multiplier * rate->ticks_hi + (fraction >> 32);
+  p->period_fraction = (unsigned)fraction;
+
+  // Scale the idle time after the frame by a sample from the gap distribution
+  const gap_dist_t *gap_dist = &p->config->gap_dist;
+  if (gap_dist->mode != GAP_CONSTANT) {
+    unsigned bits_on_wire = get_bits_on_wire(len);
+    if (period > bits_on_wire) {
+      unsigned gap_multiplier = gap_dist_sample(gap_dist, random_get_random_number(&p->gap_random));
+      unsigned long long idle = (period - bits_on_wire) * gap_multiplier + p->gap_fraction;
+      p->gap_fraction = (unsigned)idle & (GAP_MULTIPLIER_ONE - 1);
+      period = bits_on_wire + (idle >> 16);
+    }
+  }
+  if (period > MAX_FRAME_PERIOD)
+    period = MAX_FRAME_PERIOD;
+
+  // The transmitter schedules the start of each frame one period after the last
+  ptr->period = (unsigned)period;
+
+  return fill_frame(producer, pkt_dptr, ctrl, len);
+}
+
+/* Only the controller writes the request, so it reads it without the lock */
+static void request_mode(const mode_request_t *request)
+{
+  g_mode_sequence = g_mode_sequence + 1;
+  CONFIG_RELEASE();
+  g_mode_request.mode = request->mode;
+  g_mode_request.burst_frames = request->burst_frames;
+  g_mode_request.burst_gap = request->burst_gap;
+  g_mode_request.replay_frames = request->replay_frames;
+  g_mode_request.replay_patch = request->replay_patch;
+  CONFIG_RELEASE();
+  g_mode_sequence = g_mode_sequence + 1;
+}
+
+static void current_request(mode_request_t *request)
+{
+  request->mode = g_mode_request.mode;
+  request->burst_frames = g_mode_request.burst_frames;
+  request->burst_gap = g_mode_request.burst_gap;
+  request->replay_frames = g_mode_request.replay_frames;
+  request->replay_patch = g_mode_request.replay_patch;
+}
+
+void set_generator_mode(generator_mode_t mode)
+{
+  mode_request_t request;
+  current_request(&request);
+  request.mode = mode;
+  request_mode(&request);
 }
 
-pkt_ctrl_t unicast =   { TYPE_UNICAST,   64, 1500, 20, 0, 0, 0 };
-pkt_ctrl_t multicast = { TYPE_MULTICAST, 64, 1500, 50, 0, 0, 0 };
-pkt_ctrl_t broadcast = { TYPE_BROADCAST, 64, 1500, 30, 0, 0, 0 };
+generator_mode_t get_generator_mode(void)
+{
+  return g_mode_request.mode;
+}
 
-pkt_ctrl_t *packet_type_none[] = { NULL };
-pkt_ctrl_t *packet_type_all[] = { &unicast, &multicast, &broadcast, NULL };
+void set_burst(unsigned frames, unsigned gap_ticks)
+{
+  if (frames == 0)
+    frames = 1;
+  if (frames > MAX_BURST_FRAMES)
+    frames = MAX_BURST_FRAMES;
+  if (gap_ticks > MAX_FRAME_PERIOD / 2)
+    gap_ticks = MAX_FRAME_PERIOD / 2;
+
+  mode_request_t request;
+  current_request(&request);
+  request.burst_frames = frames;
+  request.burst_gap = gap_ticks;
+  request_mode(&request);
+}
 
-pkt_ctrl_t *packet_type_unicast[] = { &unicast, NULL };
-pkt_ctrl_t *packet_type_multicast[] = { &multicast, NULL };
-pkt_ctrl_t *packet_type_broadcast[] = { &broadcast, NULL };
+void get_burst(unsigned *frames, unsigned *gap_ticks)
+{
+  *frames = g_mode_request.burst_frames;
+  *gap_ticks = g_mode_request.burst_gap;
+}
 
-pkt_gen_ctrl_t unicast_only;
-pkt_gen_ctrl_t multicast_only;
-pkt_gen_ctrl_t broadcast_only;
+void set_replay(unsigned frames, int patch)
+{
+  if (frames == 0)
+    frames = 1;
+  if (frames > REPLAY_MAX_FRAMES)
+    frames = REPLAY_MAX_FRAMES;
+
+  // Asked for again, the ring is filled again
+  mode_request_t request;
+  current_request(&request);
+  request.mode = GENERATOR_REPLAY;
+  request.replay_frames = frames;
+  request.replay_patch = patch;
+  request_mode(&request);
+}
 
-pkt_gen_ctrl_t *choice[] = { &unicast_only, &multicast_only, &broadcast_only, NULL };
+void get_replay(unsigned *frames, int *patch)
+{
+  *frames = g_mode_request.replay_frames;
+  *patch = g_mode_request.replay_patch;
+}
 
-pkt_gen_ctrl_t initial = {
-  packet_type_none, 1, choice
-};
+unsigned get_mode_request(void)
+{
+  return g_mode_sequence;
+}
 
-pkt_gen_ctrl_t *choice_initial[] = { &initial, NULL };
+/* Take a new mode request, a burst or replay ring starts again with any change */
+static int take_mode_request(unsigned producer, generator_mode_t *generator_mode)
+{
+  producer_t *p = &g_producers[producer];
+  unsigned sequence = g_mode_sequence;
+  if (sequence == p->mode_taken)
+    return 0;
+
+  mode_request_t request;
+  do {
+    sequence = g_mode_sequence;
+    CONFIG_ACQUIRE();
+    request.mode = g_mode_request.mode;
+    request.burst_frames = g_mode_request.burst_frames;
+    request.burst_gap = g_mode_request.burst_gap;
+    request.replay_frames = g_mode_request.replay_frames;
+    request.replay_patch = g_mode_request.replay_patch;
+    CONFIG_ACQUIRE();
+  } while ((sequence & 1) || (sequence != g_mode_sequence));
+
+  p->mode_taken = sequence;
+  *generator_mode = request.mode;
+  p->burst_frames = request.burst_frames;
+  p->burst_gap = request.burst_gap;
+  p->burst_position = 0;
+
+  // The first producer fills the whole ring, so it is numbered as one stream
+  p->replay_left = ((request.mode == GENERATOR_REPLAY) && (producer == 0)) ? request.replay_frames : 0;
+  p->replay_flags = BUFFER_REPLAY | (request.replay_patch ? BUFFER_REPLAY_PATCH : 0);
+  return 1;
+}
 
-pkt_gen_ctrl_t unicast_only = {
-  packet_type_unicast, 1, choice_initial
-};
+/*
+ * Fill in the buffer for the next frame of a burst. Frames within a burst are sent
+ * back-to-back at the minimum inter-frame gap and the gap between bursts is timed
+ * from when the last frame of the burst actually started. The length returned
+ * for the first frame of a burst tells the buffer manager how many frames to hold
+ * back so that the whole burst is queued before the transmitter starts on it.
+ */
+unsigned gen_burst_frame(unsigned producer, uintptr_t pkt_dptr, pkt_ctrl_t *ctrl, unsigned len)
+{
+  producer_t *p = &g_producers[producer];
+  packet_data_t *ptr = (packet_data_t *)pkt_dptr;
+  unsigned position = p->burst_position;
+  unsigned length_in_bytes = fill_frame(producer, pkt_dptr, ctrl, len);
 
-pkt_gen_ctrl_t multicast_only = {
-  packet_type_multicast, 1, choice_initial
-};
+  if (position == 0)
+    length_in_bytes |= p->burst_frames << BUFFER_TRAIN_SHIFT;
 
-pkt_gen_ctrl_t broadcast_only = {
-  packet_type_broadcast, 1, choice_initial
-};
+  if (position + 1 == p->burst_frames) {
+    ptr->period = (get_bits_on_wire(len) + p->burst_gap) | PACER_ANCHOR;
+    p->burst_position = 0;
+  } else {
+    ptr->period = get_bits_on_wire(len);
+    p->burst_position = position + 1;
+  }
 
-/* Begin - Directed mode configuration */
-pkt_ctrl_t unicast_directed[2] = {
-  { TYPE_UNICAST, 64, 64, 35, 0, 0, 0 },
-  { TYPE_UNICAST, 64, 1500, 35, 0, 0, 0 }
-};
-pkt_ctrl_t multicast_directed[2] = {
-  { TYPE_MULTICAST, 64, 1500, 0, 0, 0, 0 },
-  { TYPE_MULTICAST, 64, 1500, 30, 0, 0, 0 }
-};
-pkt_ctrl_t broadcast_directed[2] = {
-  { TYPE_BROADCAST, 64, 1500, 0, 0, 0, 0 },
-  { TYPE_BROADCAST, 64, 1500, 40, 0, 0, 0 }
-};
+  return length_in_bytes;
+}
+
+/*
+ * Fill in the buffer for the next frame of the replay ring, as directed mode
+ * would, and mark it for the transmitter to keep, see replay.h.
+ */
+unsigned gen_replay_frame(unsigned producer, uintptr_t pkt_dptr, pkt_ctrl_t *ctrl, unsigned len)
+{
+  producer_t *p = &g_producers[producer];
+  unsigned length_in_bytes = gen_frame(producer, pkt_dptr, ctrl, len) | p->replay_flags;
 
-pkt_ctrl_t *packet_type_directed0[] = { &unicast_directed[0], &multicast_directed[0], &broadcast_directed[0], NULL };
-pkt_ctrl_t *packet_type_directed1[] = { &unicast_directed[1], &multicast_directed[1], &broadcast_directed[1], NULL };
+  if (--p->replay_left == 0)
+    length_in_bytes |= BUFFER_REPLAY_LAST;
+  return length_in_bytes;
+}
 
-pkt_gen_ctrl_t directed[2];
+/*
+ * Build the alias tables used to choose the packet type and next state. Needs to be
+ * called whenever any of the weights used by the control structure change.
+ */
+void prepare_choices(pkt_gen_ctrl_t *ctrl)
+{
+  int weights[MAX_CHOICES];
+  unsigned count = 0;
 
-pkt_gen_ctrl_t *directed_choice0[] = { &directed[0], NULL };
-pkt_gen_ctrl_t *directed_choice1[] = { &directed[1], NULL };
+  for (pkt_ctrl_t **ptr = ctrl->packet_types; *ptr; ptr++) {
+    assert(count < MAX_CHOICES);
+    weights[count++] = (*ptr)->weight;
+  }
+  if (!alias_table_build(ctrl->packet_type_alias, weights, count))
+    count = 0;
+  ctrl->packet_type_count = count;
+
+  count = 0;
+  for (pkt_gen_ctrl_t **ptr = ctrl->next; *ptr; ptr++) {
+    assert(count < MAX_CHOICES);
+    weights[count++] = (*ptr)->weight;
+  }
+  if (!alias_table_build(ctrl->next_alias, weights, count))
+    count = 0;
+  ctrl->next_count = count;
+}
 
-pkt_gen_ctrl_t directed[2] = {
-  { packet_type_directed0, 1, directed_choice0 },
-  { packet_type_directed1, 1, directed_choice1 }
+/* The frame sizes and weight of each packet type in random mode, which cannot be changed */
+static const unsigned random_types[TRAFFIC_GEN_TYPES][3] = {
+  { 64, 1500, 20 },
+  { 64, 1500, 50 },
+  { 64, 1500, 30 },
 };
 
-pkt_ctrl_t *get_packet_control(pkt_type_t pkt_type, int index)
+static void prepare_tags(pkt_ctrl_t *ctrl, pkt_tables_t *tables, const pkt_settings_t *type)
 {
-  switch (pkt_type) {
-    case TYPE_UNICAST:
-      return &unicast_directed[index];
-    case TYPE_MULTICAST:
-      return &multicast_directed[index];
-    case TYPE_BROADCAST:
-      return &broadcast_directed[index];
+  ctrl->tag_offset = 0;
+  ctrl->tag_alias_count = 0;
+  ctrl->vlan_min = type->vlan_min;
+  ctrl->vlan_max = type->vlan_max;
+  ctrl->prio_min = type->prio_min;
+  ctrl->prio_max = type->prio_max;
+  if (!type->vlan_tag_enabled)
+    return;
+
+  // The changing tag is the last one, just before the ethertype
+  switch (type->tag_mode) {
+    case TAG_FIXED:
+      break;
+    case TAG_CYCLE:
+      ctrl->tag_offset = ctrl->seq_offset - 4;
+      break;
+    case TAG_TABLE:
+      if (type->tag_count && alias_table_build(tables->tag_alias, type->tag_weight, type->tag_count)) {
+        for (unsigned i = 0; i < type->tag_count; i++)
+          tables->tag_table[i] = type->tag_table[i];
+        ctrl->tag_alias_count = type->tag_count;
+        ctrl->tag_offset = ctrl->seq_offset - 4;
+      }
+      break;
   }
-  assert(0);
-  return NULL;
 }
-/* End - Directed mode configuration */
 
-void set_directed_read_index(int read_index)
+static void prepare_sizes(pkt_ctrl_t *ctrl, pkt_tables_t *tables, const pkt_settings_t *type)
 {
-  g_directed_read_index = read_index;
+  ctrl->size_min = type->size_min;
+  ctrl->size_max = type->size_max;
+  ctrl->size_alias_count = 0;
+  if (type->size_count && alias_table_build(tables->size_alias, type->size_weight, type->size_count)) {
+    for (unsigned i = 0; i < type->size_count; i++)
+      tables->size_table[i] = type->size_table[i];
+    ctrl->size_alias_count = type->size_count;
+  }
 }
 
-void set_unicast_mac_address(int write_index, unsigned char mac_address[])
+/* Prepare a packet type of directed mode, with its own tables */
+static void prepare_type(pkt_ctrl_t *ctrl, pkt_tables_t *tables, const pkt_settings_t *type,
+    const generator_settings_t *settings)
 {
-  memcpy(g_unicast_mac[write_index], mac_address, MAC_ADDRESS_BYTES);
+  unsigned outer_tci = (type->outer_prio & 0x7) << 13 | (type->outer_vlan & 0xfff);
+  unsigned vlan_tci = (type->prio & 0x7) << 13 | (type->vlan & 0xfff);
+
+  ctrl->type = type->type;
+  ctrl->weight = type->weight;
+  ctrl->active_rate = (type->rate.mode == RATE_LINE) ? settings->line_rate : type->rate;
+  ctrl->payload_pattern = type->payload_pattern;
+  ctrl->payload_value = type->payload_value;
+  ctrl->dest_sweep = type->dest_sweep;
+  ctrl->src_sweep = type->src_sweep;
+  ctrl->tx_class = type->tx_class;
+  ctrl->tables = tables;
+  prepare_header(ctrl, type->vlan_tag_enabled, outer_tci, vlan_tci, settings);
+  prepare_sizes(ctrl, tables, type);
+  prepare_tags(ctrl, tables, type);
 }
 
-void get_unicast_mac_address(int read_index, unsigned char mac_address[])
+/* The random mode packet types use the MAC addresses and line rate of the settings */
+static void prepare_random_type(pkt_ctrl_t *ctrl, pkt_type_t type, const generator_settings_t *settings)
 {
-  memcpy(mac_address, g_unicast_mac[read_index], MAC_ADDRESS_BYTES);
+  memset(ctrl, 0, sizeof(*ctrl));
+  ctrl->type = type;
+  ctrl->size_min = random_types[type][0];
+  ctrl->size_max = random_types[type][1];
+  ctrl->weight = random_types[type][2];
+  ctrl->active_rate = settings->line_rate;
+  prepare_header(ctrl, 0, 0, 0, settings);
 }
 
-void set_multicast_mac_address(int write_index, unsigned char mac_address[])
+void prepare_config(generator_config_t *config, const generator_settings_t *settings)
 {
-  memcpy(g_multicast_mac[write_index], mac_address, MAC_ADDRESS_BYTES);
+  for (unsigned i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    pkt_ctrl_t *ctrl = &config->types[i];
+    prepare_type(ctrl, &config->tables[i], &settings->types[i], settings);
+    flow_table_prepare(&config->flows, ctrl);
+  }
+  prepare_choices(&config->directed);
+
+  for (unsigned i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    prepare_random_type(&config->random_types[i], (pkt_type_t)i, settings);
+    prepare_choices(&config->random_only[i]);
+  }
+  prepare_choices(&config->random_initial);
+
+  gap_dist_prepare(&config->gap_dist, &settings->gap_dist);
 }
 
-void get_multicast_mac_address(int read_index, unsigned char mac_address[])
+void packet_generator_init(unsigned producers)
 {
-  memcpy(mac_address, g_multicast_mac[read_index], MAC_ADDRESS_BYTES);
+  for (unsigned i = 0; i < GENERATOR_PRODUCERS; i++) {
+    producer_t *p = &g_producers[i];
+
+    memset(p, 0, sizeof(*p));
+    for (unsigned j = 0; j < TRAFFIC_GEN_TYPES; j++)
+      p->seq_num[j] = 1;
+    p->seq_base = PRODUCER_SEQ_BITS ? i << ((32 - PRODUCER_SEQ_BITS) & 31) : 0;
+    p->gap_random = random_create_generator_from_seed(PRODUCER_SEED(i, 1));
+    p->payload_random = random_create_generator_from_seed(PRODUCER_SEED(i, 2));
+    p->sweep_random = random_create_generator_from_seed(PRODUCER_SEED(i, 3));
+    p->burst_frames = 1;
+  }
+  payload_init();
+  config_init(producers);
+
+  // Silent until the controller asks for a mode
+  g_mode_request.mode = GENERATOR_SILENT;
+  g_mode_request.burst_frames = 1;
+  g_mode_request.burst_gap = 0;
+  g_mode_request.replay_frames = 1;
+  g_mode_request.replay_patch = 0;
+  g_mode_sequence = 0;
 }
 
-pkt_ctrl_t *choose_packet_type(random_generator_t *r, uintptr_t ctrl_ptr, unsigned int *len)
+/* Move onto a new configuration, sweeps and cycles of tags start again with each one */
+static int take_config(unsigned producer)
 {
-  pkt_ctrl_t **choices = ((pkt_gen_ctrl_t *)ctrl_ptr)->packet_types;
-  int total_weight = 0;
-  pkt_ctrl_t **ptr = choices;
-  while (*ptr) {
-    total_weight += (*ptr)->weight;
-    ptr++;
+  producer_t *p = &g_producers[producer];
+  const generator_config_t *config = config_acquire(producer);
+  if (!config)
+    return 0;
+
+  for (unsigned i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    const pkt_ctrl_t *ctrl = &config->types[i];
+    type_state_t *state = &p->type_state[i];
+    state->dest_sweep.index = 0;
+    state->dest_sweep.offset = 0;
+    state->src_sweep.index = 0;
+    state->src_sweep.offset = 0;
+    state->next_tci = (ctrl->prio_min << 13) | ctrl->vlan_min;
   }
-  if (total_weight == 0)
+  p->config = config;
+  return 1;
+}
+
+int generator_update(unsigned producer, generator_mode_t *generator_mode, uintptr_t *ctrl_ptr)
+{
+  producer_t *p = &g_producers[producer];
+  int changed = take_config(producer);
+  changed |= take_mode_request(producer, generator_mode);
+
+  // Once its part of the replay ring is filled the producer has nothing more to do, and
+  // only the first plays a capture
+  if (((*generator_mode == GENERATOR_REPLAY) && !p->replay_left) ||
+      ((*generator_mode == GENERATOR_PCAP) && (producer != 0))) {
+    *generator_mode = GENERATOR_SILENT;
+    changed = 1;
+  }
+  if (!changed)
+    return 0;
+
+  if (*generator_mode == GENERATOR_RANDOM)
+    *ctrl_ptr = (uintptr_t)&p->config->random_initial;
+  else
+    *ctrl_ptr = (uintptr_t)&p->config->directed;
+  return 1;
+}
+
+pkt_ctrl_t *choose_packet_type(unsigned producer, random_generator_t *r, uintptr_t ctrl_ptr, unsigned int *len)
+{
+  producer_t *p = &g_producers[producer];
+  pkt_gen_ctrl_t *ctrl = (pkt_gen_ctrl_t *)ctrl_ptr;
+  if (ctrl->packet_type_count == 0) {
+    *len = 0;
     return NULL;
+  }
 
-  unsigned choice_weight = random_get_random_number(r) % total_weight;
-  ptr = choices;
-  int cum_weight = 0;
-  while (*ptr) {
-    cum_weight += (*ptr)->weight;
-    if (choice_weight < cum_weight) {
-      /* Choose packet length */
-      *len = random_get_random_number(r);
-      if ((*ptr)->size_max == (*ptr)->size_min)
-        *len = (*ptr)->size_min;
-      else
-        *len = (*len % ((*ptr)->size_max - (*ptr)->size_min)) + (*ptr)->size_min ;
-      return *ptr;
+  unsigned index = 0;
+  if (ctrl->packet_type_count > 1)
+    index = alias_table_sample(ctrl->packet_type_alias, ctrl->packet_type_count,
+        random_get_random_number(r));
+  pkt_ctrl_t *choice = ctrl->packet_types[index];
+
+  if (choice->flow_count) {
+    const flow_t *flow = flow_table_choose(&p->config->flows, choice, random_get_random_number(r));
+    p->type_state[choice->type].next_flow = flow;
+    if (flow->size_max) {
+      unsigned range = flow->size_max - flow->size_min;
+      *len = flow->size_min + (unsigned)(((unsigned long long)random_get_random_number(r) * range) >> 32);
+      return choice;
     }
-    ptr++;
   }
-  *len = 0;
-  return NULL;
+
+  if (choice->size_alias_count) {
+    *len = choice->tables->size_table[alias_table_sample(choice->tables->size_alias, choice->size_alias_count,
+        random_get_random_number(r))];
+    return choice;
+  }
+
+  /* Choose packet length in the range [size_min, size_max) by scaling rather than a modulo */
+  unsigned range = choice->size_max - choice->size_min;
+  *len = choice->size_min + (unsigned)(((unsigned long long)random_get_random_number(r) * range) >> 32);
+  return choice;
 }
 
 uintptr_t choose_next(random_generator_t *r, uintptr_t ctrl_ptr)
 {
-  pkt_gen_ctrl_t **choices = ((pkt_gen_ctrl_t *)ctrl_ptr)->next;
-  int total_weight = 0;
-  pkt_gen_ctrl_t **ptr = choices;
-  while (*ptr) {
-    total_weight += (*ptr)->weight;
-    ptr++;
-  }
-  if (total_weight == 0)
+  pkt_gen_ctrl_t *ctrl = (pkt_gen_ctrl_t *)ctrl_ptr;
+  if (ctrl->next_count == 0)
     return (uintptr_t)NULL;
 
-  unsigned choice_weight = random_get_random_number(r) % total_weight;
-  ptr = choices;
-  int cum_weight = 0;
-  while (*ptr) {
-    cum_weight += (*ptr)->weight;
-    if (choice_weight < cum_weight)
-      return (uintptr_t)*ptr;
-    ptr++;
-  }
-  return (uintptr_t)NULL;
+  unsigned index = 0;
+  if (ctrl->next_count > 1)
+    index = alias_table_sample(ctrl->next_alias, ctrl->next_count,
+        random_get_random_number(r));
+  return (uintptr_t)ctrl->next[index];
 }
-
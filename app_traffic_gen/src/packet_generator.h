@@ -4,17 +4,96 @@
 #include <xccompat.h>
 #include <stdint.h>
 #include "random.h"
+#include "alias_table.h"
+#include "gap_distribution.h"
+#include "payload.h"
+#include "shaper.h"
+#include "buffers.h"
 
 #define MAC_ADDRESS_BYTES 6
 
+/*
+ * Each producer numbers its frames itself, with its index in the top bits of the
+ * sequence number so that a receiver can follow each producer's numbers. None are
+ * used with a single producer. Both boards must be built with the same number.
+ */
+#if GENERATOR_PRODUCERS == 1
+#define PRODUCER_SEQ_BITS 0
+#elif GENERATOR_PRODUCERS == 2
+#define PRODUCER_SEQ_BITS 1
+#else
+#define PRODUCER_SEQ_BITS 2
+#endif
+
+#define PRODUCER_SEQ_MASK (0xffffffff >> PRODUCER_SEQ_BITS)
+
+/* The random generators of each producer are seeded apart from the others' */
+#define PRODUCER_SEED(producer, stream) ((producer) * 4 + (stream))
+
+/*
+ * Rate targets are held as a multiplier of 100MHz reference timer ticks in 32.32
+ * fixed point, so the period of each frame can be calculated without a divide in
+ * the critical loop. At 100Mb/s one tick is one bit time on the wire.
+ */
+typedef enum {
+  RATE_LINE,      // Packet types only: follow the configuration's line rate
+  RATE_PER_BIT,   // Ticks per bit on the wire, set from a percentage or bits/s
+  RATE_PER_FRAME, // Ticks per frame whatever its size, set from frames/s
+} rate_mode_t;
+
+typedef struct rate_t {
+  rate_mode_t mode;
+  unsigned ticks_hi;
+  unsigned ticks_lo;
+} rate_t;
+
+// The longest period a frame can be given, as the transmitter compares times as signed values
+#define MAX_FRAME_PERIOD 0x7fffffff
+
+// The most packet types or next states that can be chosen between in one state
+#define MAX_CHOICES 8
+
 typedef enum {
   GENERATOR_SILENT,
   GENERATOR_RANDOM,
   GENERATOR_DIRECTED,
+  GENERATOR_BURST,
+  GENERATOR_REPLAY,
+  GENERATOR_PCAP,   // Captured frames streamed by the host, see pcap_player.h
 } generator_mode_t;
 
+// The most frames that can be sent in one burst
+#define MAX_BURST_FRAMES 0xffff
+
+// The most entries in a frame size table
+#define MAX_SIZE_ENTRIES 32
+
+// The frame sizes that can be generated, without the CRC
+#define MIN_FRAME_BYTES 60
+#define MAX_FRAME_BYTES 1518
+
+// The number of words in a header template, enough for a double tagged header, its
+// sequence number and the flow id
+#define HEADER_TEMPLATE_WORDS 7
+
+// The two bytes of the frame holding the id of the flow it belongs to, most significant first
+#define FRAME_FLOW_OFFSET 26
+#define FLOW_NONE 0xffff
+
+// The word of the frame the transmitter writes its timer value to, after the largest header
+// and its sequence number. It is written in the device's byte order and is not part of the payload.
+#define FRAME_TIMESTAMP_WORD 7
+
+// The header id of a frame the generator did not build, which the transmitter sends as it is
+#define HEADER_ID_NONE 0
+
 typedef struct packet_data_t {
-  unsigned delay;
+  unsigned period;
+  unsigned header_id;
+  unsigned payload_pattern;
+  unsigned payload_value;
+  unsigned payload_words;
+  unsigned tx_class;
   char dest_mac[MAC_ADDRESS_BYTES];
   char src_mac[MAC_ADDRESS_BYTES];
   char frame_type[2];
@@ -22,7 +101,12 @@ typedef struct packet_data_t {
 } packet_data_t;
 
 typedef struct packet_data_vlan_t {
-  unsigned delay;
+  unsigned period;
+  unsigned header_id;
+  unsigned payload_pattern;
+  unsigned payload_value;
+  unsigned payload_words;
+  unsigned tx_class;
   char dest_mac[MAC_ADDRESS_BYTES];
   char src_mac[MAC_ADDRESS_BYTES];
   char tpid[2];
@@ -37,7 +121,58 @@ typedef enum {
   TYPE_BROADCAST,
 } pkt_type_t;
 
-typedef struct pkt_ctrl_t {
+#define TRAFFIC_GEN_TYPES 3
+
+// Each packet type is sent with its own ethertype, starting with unicast
+#define TRAFFIC_GEN_ETHERTYPE 0x8932
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+
+// Values of vlan_tag_enabled: a VLAN tag, or a service tag (QinQ) followed by a VLAN tag
+#define VLAN_TAG_SINGLE 1
+#define VLAN_TAG_DOUBLE 2
+
+// The most entries in a table of VLAN tags
+#define MAX_TAG_ENTRIES 16
+
+/*
+ * The VLAN tag of a packet type can change for every frame. Cycling steps through
+ * the VLAN IDs of a range, moving on to the next priority of its range each time
+ * the VLAN IDs start again. A table gives a weighted choice of tags. Either way
+ * the tag control bytes are written from a prepared value with no formatting.
+ * With double tagging the VLAN tag after the service tag is the one that changes.
+ */
+typedef enum {
+  TAG_FIXED,
+  TAG_CYCLE,
+  TAG_TABLE,
+} tag_mode_t;
+
+/*
+ * Addresses can be swept through a range by changing their low 32 bits for every
+ * frame. The first two bytes, and so the multicast bit, are always those set.
+ * A step sweep adds count multiples of the stride in turn before starting again,
+ * a random sweep takes new random values for the masked bits.
+ */
+typedef enum {
+  SWEEP_OFF,
+  SWEEP_STEP,
+  SWEEP_RANDOM,
+} sweep_mode_t;
+
+typedef struct mac_sweep_t {
+  sweep_mode_t mode;
+  unsigned int count;
+  unsigned int stride;
+  unsigned int mask;   // The bits of the address that change, carries do not leave them
+} mac_sweep_t;
+
+/*
+ * The settings of a packet type as the host gave them, which only the packet
+ * controller reads and writes. prepare_config() turns them into the pkt_ctrl_t
+ * the generator reads.
+ */
+typedef struct pkt_settings_t {
     pkt_type_t type;
     unsigned int size_min;
     unsigned int size_max;
@@ -46,6 +181,85 @@ typedef struct pkt_ctrl_t {
     unsigned int vlan_tag_enabled;
     unsigned int vlan;
     unsigned int prio;
+    unsigned int outer_vlan;
+    unsigned int outer_prio;
+    rate_t rate;
+
+    // Weighted table of frame sizes used instead of size_min..size_max when it has entries
+    unsigned int size_count;
+    unsigned short size_table[MAX_SIZE_ENTRIES];
+    int size_weight[MAX_SIZE_ENTRIES];
+
+    // Payload written after the header, the value is only used by PAYLOAD_CONSTANT
+    payload_pattern_t payload_pattern;
+    unsigned int payload_value;
+
+    // Applied to the addresses of the header or flow for every frame
+    mac_sweep_t dest_sweep;
+    mac_sweep_t src_sweep;
+
+    // How the VLAN tag of the header changes. Flows keep their own tags.
+    tag_mode_t tag_mode;
+    unsigned int vlan_min;
+    unsigned int vlan_max;
+    unsigned int prio_min;
+    unsigned int prio_max;
+    unsigned int tag_count;
+    unsigned short tag_table[MAX_TAG_ENTRIES];
+    int tag_weight[MAX_TAG_ENTRIES];
+
+    // The transmit queue the frames are sent from, see shaper.h
+    tx_class_t tx_class;
+} pkt_settings_t;
+
+/* The weighted tables of a packet type with a table of sizes or tags, built by prepare_config() */
+typedef struct pkt_tables_t {
+    unsigned short size_table[MAX_SIZE_ENTRIES];
+    alias_entry_t size_alias[MAX_SIZE_ENTRIES];
+    unsigned short tag_table[MAX_TAG_ENTRIES];
+    alias_entry_t tag_alias[MAX_TAG_ENTRIES];
+} pkt_tables_t;
+
+/* A packet type as the generator uses it, all set up by prepare_config() */
+typedef struct pkt_ctrl_t {
+    pkt_type_t type;
+    unsigned int size_min;
+    unsigned int size_max;
+    int weight;
+
+    // The rate with RATE_LINE resolved to the configuration's line rate
+    rate_t active_rate;
+
+    // Frame header up to the sequence number
+    unsigned int header_id;
+    unsigned int seq_offset;
+    unsigned int header[HEADER_TEMPLATE_WORDS];
+
+    // The flows of this type; with none the header above is used
+    unsigned int flow_first;
+    unsigned int flow_count;
+
+    payload_pattern_t payload_pattern;
+    unsigned int payload_value;
+
+    mac_sweep_t dest_sweep;
+    mac_sweep_t src_sweep;
+
+    // Where the tag that changes is in the frame, zero when it does not change, and
+    // the range of a cycle
+    unsigned int tag_offset;
+    unsigned int vlan_min;
+    unsigned int vlan_max;
+    unsigned int prio_min;
+    unsigned int prio_max;
+
+    tx_class_t tx_class;
+
+    // Entries in the alias tables of sizes and tags, a zero count means unused. Only
+    // a packet type with a count has tables.
+    unsigned int size_alias_count;
+    unsigned int tag_alias_count;
+    const pkt_tables_t *tables;
 } pkt_ctrl_t;
 
 #ifdef __XC__
@@ -56,25 +270,81 @@ typedef struct pkt_gen_ctrl_t {
     pkt_ctrl_t **packet_types;
     int weight;
     struct pkt_gen_ctrl_t **next;
+
+    // Alias tables built from the weights by prepare_choices(), a zero count means no choice
+    unsigned packet_type_count;
+    alias_entry_t packet_type_alias[MAX_CHOICES];
+    unsigned next_count;
+    alias_entry_t next_alias[MAX_CHOICES];
 } pkt_gen_ctrl_t;
 
-pkt_ctrl_t *choose_packet_type(random_generator_t *r, uintptr_t ctrl_ptr, unsigned int *len);
+/*
+ * Set up the generator for the given number of producers, at most
+ * GENERATOR_PRODUCERS, before any of them start.
+ */
+void packet_generator_init(unsigned producers);
+void prepare_choices(pkt_gen_ctrl_t *ctrl);
+
+/*
+ * Called by each producer between frames to take up what the controller has
+ * changed: the configuration published last, see generator_config.h, and the mode
+ * and bursts. Returns 1 with the mode and the state of the configuration to start
+ * from if either changed, in which case any packet type already chosen is stale.
+ */
+int generator_update(unsigned producer, generator_mode_t *generator_mode, uintptr_t *ctrl_ptr);
+
+/*
+ * Producers are numbered from 0. Each has its own sequence numbers, address sweeps,
+ * gaps and bursts, and only one task may use each.
+ */
+pkt_ctrl_t *choose_packet_type(unsigned producer, random_generator_t *r, uintptr_t ctrl_ptr, unsigned int *len);
 uintptr_t choose_next(random_generator_t *r, uintptr_t ctrl_ptr);
-void gen_unicast_frame(uintptr_t pkt_dptr, pkt_ctrl_t *ctrl);
-void gen_multicast_frame(uintptr_t pkt_dptr, pkt_ctrl_t *ctrl);
-void gen_broadcast_frame(uintptr_t pkt_dptr, pkt_ctrl_t *ctrl);
+unsigned gen_frame(unsigned producer, uintptr_t pkt_dptr, pkt_ctrl_t *ctrl, unsigned len);
+unsigned gen_burst_frame(unsigned producer, uintptr_t pkt_dptr, pkt_ctrl_t *ctrl, unsigned len);
+unsigned gen_replay_frame(unsigned producer, uintptr_t pkt_dptr, pkt_ctrl_t *ctrl, unsigned len);
+
+/* Called by the controller, the producers take the changes up with generator_update() */
+void set_generator_mode(generator_mode_t mode);
+generator_mode_t get_generator_mode(void);
+void set_burst(unsigned frames, unsigned gap_ticks);
+void get_burst(unsigned *frames, unsigned *gap_ticks);
+
+/* Fill a ring of frames for the transmitter to replay, see replay.h, numbered as they are sent if patch is set */
+void set_replay(unsigned frames, int patch);
+void get_replay(unsigned *frames, int *patch);
+
+/* Changed by every mode request, each of which starts a replay ring again */
+unsigned get_mode_request(void);
 
 #ifdef __XC__
 }
 #endif
 
-void set_directed_read_index(int read_index);
-void set_unicast_mac_address(int write_index, unsigned char mac_address[]);
-void get_unicast_mac_address(int read_index, unsigned char mac_address[]);
-void set_multicast_mac_address(int write_index, unsigned char mac_address[]);
-void get_multicast_mac_address(int read_index, unsigned char mac_address[]);
 #ifndef __XC__
-pkt_ctrl_t *get_packet_control(pkt_type_t pkt_type, int index);
+struct generator_config_t;
+struct generator_settings_t;
+
+/* The producer that numbered a frame */
+static inline unsigned producer_from_seq(unsigned seq_num)
+{
+  return PRODUCER_SEQ_BITS ? seq_num >> ((32 - PRODUCER_SEQ_BITS) & 31) : 0;
+}
+
+/* Build the headers and tables of a configuration from the settings before it is published */
+void prepare_config(struct generator_config_t *config, const struct generator_settings_t *settings);
+
+/*
+ * Build a header template, with the flow id in place and the sequence number left
+ * as zero. Returns the offset of the sequence number.
+ */
+unsigned build_header(unsigned header[], const unsigned char dest_mac[], const unsigned char src_mac[],
+    unsigned vlan_tag_enabled, unsigned outer_tci, unsigned vlan_tci, unsigned ether_type, unsigned flow_id);
+
+/* A new id for a header template, so that buffers can tell if they hold it */
+unsigned new_header_id(void);
+
+/* The next sequence number a producer gives the flow at an index with the given header */
+unsigned flow_seq_num(unsigned producer, unsigned flow, unsigned header_id);
 #endif //__XC__
 
 #endif // __PACKET_GENERATOR_H__
@@ -2,7 +2,12 @@
 #define PACKET_TRANSMITTER_H_
 
 #include <xccompat.h>
+#include "descriptor_ring.h"
 
+#if USE_DESCRIPTOR_RINGS
+void packet_transmitter(chanend c_tx);
+#else
 void packet_transmitter(chanend c_tx, streaming chanend c_con);
+#endif
 
 #endif /* PACKET_TRANSMITTER_H_ */
@@ -0,0 +1,82 @@
+/*
+ * Frame payload patterns. The PRBS-31 sequence is generated once into a table as
+ * it costs a shift and compare per bit; the other patterns are written directly.
+ */
+#include <string.h>
+#include "payload.h"
+
+static unsigned g_prbs31[PAYLOAD_MAX_WORDS];
+
+/* Convert a value to the word which holds its bytes most significant first in memory */
+static unsigned wire_order(unsigned value)
+{
+  unsigned char bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+  unsigned word;
+  memcpy(&word, bytes, sizeof(word));
+  return word;
+}
+
+void payload_init(void)
+{
+  unsigned char *bytes = (unsigned char *)g_prbs31;
+  unsigned state = 0x7fffffff;
+
+  for (unsigned i = 0; i < sizeof(g_prbs31); i++) {
+    unsigned byte = 0;
+    for (unsigned bit = 0; bit < 8; bit++) {
+      unsigned next = ((state >> 30) ^ (state >> 27)) & 1;
+      state = ((state << 1) | next) & 0x7fffffff;
+      byte = (byte << 1) | next;
+    }
+    bytes[i] = byte;
+  }
+}
+
+void payload_fill(unsigned frame[], unsigned start, unsigned end, payload_pattern_t pattern,
+    unsigned value, random_generator_t *r)
+{
+  switch (pattern) {
+    case PAYLOAD_INCREMENT:
+      for (unsigned i = start; i < end; i++)
+        frame[i] = wire_order(i - PAYLOAD_START_WORD);
+      break;
+    case PAYLOAD_PRBS31:
+      memcpy(&frame[start], &g_prbs31[start - PAYLOAD_START_WORD], (end - start) * sizeof(unsigned));
+      break;
+    case PAYLOAD_CONSTANT: {
+      unsigned word = wire_order(value);
+      for (unsigned i = start; i < end; i++)
+        frame[i] = word;
+      break;
+    }
+    case PAYLOAD_RANDOM:
+      for (unsigned i = start; i < end; i++)
+        frame[i] = random_get_random_number(r);
+      break;
+  }
+}
+
+unsigned payload_check(const unsigned frame[], unsigned end, payload_pattern_t pattern, unsigned value)
+{
+  unsigned errors = 0;
+
+  switch (pattern) {
+    case PAYLOAD_INCREMENT:
+      for (unsigned i = PAYLOAD_START_WORD; i < end; i++)
+        errors += frame[i] != wire_order(i - PAYLOAD_START_WORD);
+      break;
+    case PAYLOAD_PRBS31:
+      for (unsigned i = PAYLOAD_START_WORD; i < end; i++)
+        errors += frame[i] != g_prbs31[i - PAYLOAD_START_WORD];
+      break;
+    case PAYLOAD_CONSTANT: {
+      unsigned word = wire_order(value);
+      for (unsigned i = PAYLOAD_START_WORD; i < end; i++)
+        errors += frame[i] != word;
+      break;
+    }
+    case PAYLOAD_RANDOM:
+      break;
+  }
+  return errors;
+}
@@ -0,0 +1,59 @@
+#ifndef __PAYLOAD_H__
+#define __PAYLOAD_H__
+
+#include <xccompat.h>
+#include "random.h"
+#include "buffers.h"
+
+/*
+ * Frame payload patterns. The pattern is keyed by the position in the frame rather
+ * than by the frame so a buffer that already holds the pattern only needs writing
+ * again where a longer frame reaches past what it holds, and full-size frames
+ * cost no more to generate than minimum-size ones.
+ *
+ * The pattern starts at PAYLOAD_OFFSET, after the largest header, its sequence
+ * number and the transmit time, so a receiver can check it without knowing how
+ * the frame was tagged.
+ * Patterns are defined as the bytes on the wire: PRBS-31 bits are sent most
+ * significant bit of each byte first, counters and constants most significant
+ * byte first.
+ */
+typedef enum {
+  PAYLOAD_INCREMENT, // 32-bit count of the payload words
+  PAYLOAD_PRBS31,    // x^31 + x^28 + 1 from the all ones state (ITU-T O.150)
+  PAYLOAD_CONSTANT,  // The same 32-bit value in every word
+  PAYLOAD_RANDOM,    // Random words kept by each buffer, the first new for every frame, so cannot be checked
+} payload_pattern_t;
+
+#define PAYLOAD_OFFSET 32
+#define PAYLOAD_START_WORD (PAYLOAD_OFFSET / sizeof(unsigned))
+
+// The most payload words that fit in a buffer
+#define PAYLOAD_MAX_WORDS ((MAX_BUFFER_SIZE - BUFFER_OVERHEAD_BYTES - PAYLOAD_OFFSET) / sizeof(unsigned))
+
+#ifdef __XC__
+extern "C" {
+#endif
+
+/* Build the PRBS-31 sequence, needs to be called once before payload_fill() */
+void payload_init(void);
+
+/*
+ * Write the pattern into words start..end-1 of the frame, which must not be before
+ * PAYLOAD_START_WORD. The random pattern takes a new number per word from r.
+ * The generator only redraws the first word of a random payload for each frame.
+ */
+void payload_fill(unsigned frame[], unsigned start, unsigned end, payload_pattern_t pattern,
+    unsigned value, REFERENCE_PARAM(random_generator_t, r));
+
+/*
+ * Check words PAYLOAD_START_WORD..end-1 of a received frame against the pattern.
+ * Returns the number of words that differ; random payloads always pass.
+ */
+unsigned payload_check(const unsigned frame[], unsigned end, payload_pattern_t pattern, unsigned value);
+
+#ifdef __XC__
+}
+#endif
+
+#endif // __PAYLOAD_H__
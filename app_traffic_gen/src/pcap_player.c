@@ -0,0 +1,267 @@
+/*
+ * Playback of a capture streamed by the host, see pcap_player.h. The stream and
+ * its blocks are only written by the task that handles the host's messages and
+ * the playback state only by the first generator.
+ */
+#include <string.h>
+#include <xscope.h>
+#include <xccompat.h>
+#include "pcap_player.h"
+#include "packet_generator.h"
+#include "generator_config.h"
+#include "traffic_stats.h"
+#include "debug_print.h"
+
+#if PCAP_BLOCK_WORDS < PCAP_RECORD_WORDS + (MAX_FRAME_BYTES + 3) / 4
+#error "PCAP_BLOCK_WORDS must hold a frame of MAX_FRAME_BYTES"
+#endif
+
+static uint32_t g_blocks[2][PCAP_BLOCK_WORDS];
+
+/* The stream: blocks are numbered from the first of the first stream and each is held in half number & 1 */
+static volatile unsigned g_starts = 0;
+static volatile unsigned g_stream = 0;
+static volatile unsigned g_first = 0;
+static volatile unsigned g_committed = 0;
+static volatile unsigned g_block_words[2];
+static volatile int g_end_known = 0;
+static volatile unsigned g_end = 0;
+static volatile unsigned g_errors = 0;
+
+/* The block being received */
+static unsigned g_receiving = 0;
+static unsigned g_length = 0;
+static int g_broken = 1;
+
+/* The playback, which starts again whenever the generator sees a new start */
+static volatile unsigned g_player_starts = 0;
+static volatile unsigned g_player_stream = 0;
+static volatile unsigned g_played = 0;
+static volatile unsigned g_frames = 0;
+static volatile unsigned g_underruns = 0;
+static unsigned g_position = 0;
+static int g_started = 0;
+static int g_waiting = 0;
+
+static int g_polling = 0;
+static pcap_status_t g_status_sent;
+
+void pcap_player_start(unsigned stream)
+{
+  g_end_known = 0;
+  g_first = g_committed;
+  g_stream = stream;
+  g_errors = 0;
+  g_broken = 1;
+
+  // The stream must be set up before the generator sees it has started
+  CONFIG_RELEASE();
+  g_starts = g_starts + 1;
+  g_polling = 1;
+  memset(&g_status_sent, 0, sizeof(g_status_sent));
+  set_generator_mode(GENERATOR_PCAP);
+}
+
+/* Count a block dropped, which the host sees from the status */
+static void drop_block(const char *reason)
+{
+  debug_printf("Capture block %d dropped: %s\n", g_receiving - g_first, reason);
+  g_errors = g_errors + 1;
+  g_broken = 1;
+}
+
+void pcap_player_data(unsigned block, unsigned offset, const uint32_t words[], unsigned count)
+{
+  unsigned number = g_first + block;
+
+  if (offset == 0) {
+    g_receiving = number;
+    g_length = 0;
+    g_broken = 0;
+
+    // The host sends the next block only once the status says there is room for it
+    if ((number != g_committed) || (number - g_played >= 2)) {
+      drop_block("out of order or no room");
+      return;
+    }
+  }
+
+  if (g_broken || (number != g_receiving) || (offset != g_length) || (count > PCAP_BLOCK_WORDS - offset)) {
+    if (!g_broken)
+      drop_block("data lost or too long");
+    return;
+  }
+
+  uint32_t *data = g_blocks[number & 1];
+  for (unsigned i = 0; i < count; i++)
+    data[offset + i] = words[i];
+  g_length = offset + count;
+}
+
+void pcap_player_commit(const protocol_pcap_commit_t *commit)
+{
+  const uint32_t *data = g_blocks[g_receiving & 1];
+  unsigned number = g_first + commit->block;
+  uint32_t checksum = 0;
+  unsigned position = 0;
+  unsigned frames = 0;
+
+  if (g_broken || (number != g_receiving) || (commit->words != g_length)) {
+    if (!g_broken)
+      drop_block("incomplete");
+    return;
+  }
+
+  for (unsigned i = 0; i < g_length; i++)
+    checksum = protocol_checksum(checksum, data[i]);
+
+  // Every frame must be one the generator could have made and end within the block
+  while (position < g_length) {
+    unsigned nbytes = data[position];
+    if ((nbytes < MIN_FRAME_BYTES) || (nbytes > MAX_FRAME_BYTES))
+      break;
+    position += PCAP_RECORD_WORDS + (nbytes + 3) / 4;
+    frames++;
+  }
+
+  if ((checksum != commit->checksum) || (position != g_length) || !frames || (frames != commit->frames)) {
+    drop_block("the checksum or frames do not match");
+    return;
+  }
+
+  g_block_words[number & 1] = g_length;
+  if (commit->last) {
+    g_end = number + 1;
+    g_end_known = 1;
+  }
+  g_broken = 1;
+
+  // The block must be complete before the generator sees it
+  CONFIG_RELEASE();
+  g_committed = number + 1;
+}
+
+int pcap_player_ready(void)
+{
+  unsigned starts = g_starts;
+  if (starts != g_player_starts) {
+    // Drop what is left of the last stream and start playing the new one
+    CONFIG_ACQUIRE();
+    g_played = g_first;
+    g_player_stream = g_stream;
+    g_frames = 0;
+    g_underruns = 0;
+    g_position = 0;
+    g_started = 0;
+    g_waiting = 0;
+    g_player_starts = starts;
+  }
+
+  unsigned committed = g_committed;
+  CONFIG_ACQUIRE();
+  int last_held = g_end_known && (committed == g_end);
+  unsigned held = committed - g_played;
+
+  // Both blocks are held before starting, so the next is on its way while the first plays
+  if (held && (g_started || (held == 2) || last_held)) {
+    g_started = 1;
+    g_waiting = 0;
+    return 1;
+  }
+
+  if (g_started && !held && !last_held && !g_waiting) {
+    g_underruns = g_underruns + 1;
+    g_waiting = 1;
+  }
+  return 0;
+}
+
+/* The packet type a captured frame is counted as, from its destination address */
+static pkt_type_t frame_type(const unsigned char *frame)
+{
+  static const unsigned char broadcast[MAC_ADDRESS_BYTES] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+  if (!memcmp(frame, broadcast, MAC_ADDRESS_BYTES))
+    return TYPE_BROADCAST;
+  return (frame[0] & 1) ? TYPE_MULTICAST : TYPE_UNICAST;
+}
+
+unsigned pcap_player_fill(unsigned producer, uintptr_t dptr)
+{
+  unsigned half = g_played & 1;
+  const uint32_t *record = &g_blocks[half][g_position];
+  unsigned nbytes = record[0];
+  unsigned char *frame = (unsigned char *)dptr + BUFFER_OVERHEAD_BYTES;
+  packet_data_t *data = (packet_data_t *)dptr;
+
+  // Not a header or payload the generator could reuse, and sent without a transmit time
+  data->period = record[1];
+  data->header_id = HEADER_ID_NONE;
+  data->payload_words = 0;
+  data->tx_class = TX_CLASS_BEST_EFFORT;
+  memcpy(frame, &record[PCAP_RECORD_WORDS], nbytes);
+
+  traffic_stats_generated(producer, frame_type(frame), nbytes);
+  g_frames = g_frames + 1;
+
+  g_position += PCAP_RECORD_WORDS + (nbytes + 3) / 4;
+  if (g_position >= g_block_words[half]) {
+    // Finished with the block, so the host can fill it again
+    g_position = 0;
+    CONFIG_RELEASE();
+    g_played = g_played + 1;
+  }
+  return BUFFER_OVERHEAD_BYTES + nbytes;
+}
+
+int pcap_player_polling(void)
+{
+  return g_polling;
+}
+
+static void get_status(pcap_status_t *status)
+{
+  unsigned starts = g_player_starts;
+
+  status->stream = g_player_stream;
+  status->frames = g_frames;
+  status->underruns = g_underruns;
+  status->errors = g_errors;
+
+  // Until the generator has moved onto the stream there is no room for it
+  if (starts == g_starts) {
+    unsigned played = g_played;
+    status->blocks_played = played - g_first;
+    status->finished = g_end_known && (played == g_end);
+  } else {
+    status->blocks_played = 0;
+    status->finished = 0;
+  }
+}
+
+void pcap_player_poll(void)
+{
+  pcap_status_t status;
+  get_status(&status);
+
+  // Not sent for every frame, the frames played so far go with the next change
+  g_status_sent.frames = status.frames;
+  if (memcmp(&status, &g_status_sent, sizeof(status))) {
+    xscope_bytes(PCAP_STATUS_PROBE, sizeof(status), (const unsigned char *)&status);
+    g_status_sent = status;
+  }
+
+  // Once the host has been told the stream is over there is nothing more to say
+  if (status.finished || (get_generator_mode() != GENERATOR_PCAP))
+    g_polling = 0;
+}
+
+void pcap_player_print(void)
+{
+  pcap_status_t status;
+  get_status(&status);
+
+  debug_printf("Capture stream %d: %d blocks of %d words played, %d frames, %d underruns, %d blocks dropped%s\n",
+      status.stream, status.blocks_played, PCAP_BLOCK_WORDS, status.frames, status.underruns, status.errors,
+      status.finished ? ", finished" : "");
+}
@@ -0,0 +1,91 @@
+#ifndef __PCAP_PLAYER_H__
+#define __PCAP_PLAYER_H__
+
+/*
+ * Playback of captured traffic streamed by the host (GENERATOR_PCAP mode). The
+ * host reads the capture and sends its frames in blocks, see host_protocol.h,
+ * each with the period to the next frame from the capture's timestamps, scaled,
+ * or none for line rate.
+ *
+ * The device holds two blocks. The task that handles the host's messages fills
+ * one while the first generator plays the other, copying each frame into a
+ * buffer of the pool which then goes to the transmitter as a generated frame
+ * would. Playback only starts once both blocks are held, or the capture fits in
+ * one, and the device tells the host over xscope each time a block is played,
+ * so the host always has the next block on its way while the last one it sent
+ * is playing. The time it takes to get there is hidden as long as it is shorter
+ * than a block takes to play. When the generator finds no block to play before
+ * the capture has ended it counts an underrun, which the host reports. The frames
+ * already in the pool keep the line going for a while, so an underrun only delays
+ * frames if it lasts longer than they take to send; those are counted as late by
+ * the transmitter.
+ *
+ * Captured frames are sent as they are, without the transmit time the
+ * transmitter writes into generated frames.
+ */
+
+// The xscope probe the status is sent on
+#define PCAP_STATUS_PROBE 2
+#define PCAP_STATUS_PROBE_NAME "Capture"
+
+// How often the task that handles the host's messages looks at the playback
+#define PCAP_POLL_TICKS 10000 // 100us
+
+/* Sent to the host whenever more than the frames change, the layout is shared with the host controller */
+typedef struct pcap_status_t {
+  unsigned stream;        // The id the host gave the stream when it started it
+  unsigned blocks_played; // The host may send the blocks up to two after this
+  unsigned frames;        // Played so far
+  unsigned underruns;     // Times the generator ran out of blocks before the last had been played
+  unsigned errors;        // Blocks dropped as incomplete, out of order or not matching their commit
+  unsigned finished;      // The last block has been played
+} pcap_status_t;
+
+#ifndef PCAP_PLAYER_HOST
+
+#include <stdint.h>
+#include <xccompat.h>
+#include "host_protocol.h"
+
+#ifdef __XC__
+extern "C" {
+#endif
+
+/* Called by the first generator in GENERATOR_PCAP mode: whether it has a frame to fill a buffer with */
+int pcap_player_ready(void);
+
+/* Copy the next frame into the buffer, as gen_frame(), once pcap_player_ready() has said there is one */
+unsigned pcap_player_fill(unsigned producer, uintptr_t dptr);
+
+/*
+ * Whether the task that handles the host's messages is to call pcap_player_poll()
+ * every PCAP_POLL_TICKS, from when a stream starts until the host has been told it
+ * is over.
+ */
+int pcap_player_polling(void);
+
+/* Send the status to the host if it has changed */
+void pcap_player_poll(void);
+
+#ifdef __XC__
+}
+#endif
+
+#ifndef __XC__
+
+/* Start a new stream with the id the host gave it, dropping anything left of the last */
+void pcap_player_start(unsigned stream);
+
+/* Add the data of a message to the block being received */
+void pcap_player_data(unsigned block, unsigned offset, const uint32_t words[], unsigned count);
+
+/* Check that the block holds exactly what the commit says and hand it to the generator */
+void pcap_player_commit(const protocol_pcap_commit_t *commit);
+
+void pcap_player_print(void);
+
+#endif // __XC__
+
+#endif // PCAP_PLAYER_HOST
+
+#endif // __PCAP_PLAYER_H__
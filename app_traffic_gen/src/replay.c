@@ -0,0 +1,133 @@
+/*
+ * The replay ring kept by the transmitter, see replay.h.
+ */
+#include <xccompat.h>
+#include "replay.h"
+#include "packet_generator.h"
+
+void replay_init(REFERENCE_PARAM(replay_t, replay))
+{
+  replay->count = 0;
+  replay->request = 0;
+  replay->complete = 0;
+  replay->next = 0;
+  replay->head_scheduled = 0;
+  replay->ready_time = 0;
+  pacer_init(&replay->pacer);
+}
+
+/* The offset of the sequence number after any tags, and what it numbers: the flow or the packet type */
+static unsigned frame_stream(const unsigned char *frame, unsigned *seq_offset)
+{
+  unsigned offset = 2 * MAC_ADDRESS_BYTES;
+  unsigned ether_type = (frame[offset] << 8) | frame[offset + 1];
+
+  if (ether_type == ETHERTYPE_QINQ) {
+    offset += 4;
+    ether_type = (frame[offset] << 8) | frame[offset + 1];
+  }
+  if (ether_type == ETHERTYPE_VLAN) {
+    offset += 4;
+    ether_type = (frame[offset] << 8) | frame[offset + 1];
+  }
+  *seq_offset = offset + 2;
+  return (ether_type << 16) | (frame[FRAME_FLOW_OFFSET] << 8) | frame[FRAME_FLOW_OFFSET + 1];
+}
+
+/* Each frame's number goes up by the frames of its stream in the ring on every pass */
+static void complete_ring(replay_t *replay)
+{
+  unsigned streams[REPLAY_MAX_FRAMES];
+
+  for (unsigned i = 0; i < replay->count; i++) {
+    replay_entry_t *entry = &replay->entries[i];
+    const unsigned char *frame = (const unsigned char *)entry->dptr + BUFFER_OVERHEAD_BYTES;
+    unsigned seq_offset;
+
+    streams[i] = frame_stream(frame, &seq_offset);
+    if (entry->seq_offset) {
+      entry->seq_offset = seq_offset;
+      entry->seq_num = (frame[seq_offset] << 24) | (frame[seq_offset + 1] << 16) |
+          (frame[seq_offset + 2] << 8) | frame[seq_offset + 3];
+    }
+  }
+
+  for (unsigned i = 0; i < replay->count; i++) {
+    unsigned step = 0;
+    for (unsigned j = 0; j < replay->count; j++)
+      step += (streams[j] == streams[i]);
+    replay->entries[i].seq_step = step;
+  }
+
+  replay->complete = 1;
+  replay->next = 0;
+  replay->head_scheduled = 0;
+  pacer_init(&replay->pacer);
+}
+
+int replay_add(REFERENCE_PARAM(replay_t, replay), uintptr_t dptr, unsigned length_in_bytes)
+{
+  // Frames of a ring left unfinished when the mode changed are not kept
+  if (replay->complete || (replay->count == REPLAY_MAX_FRAMES) || (get_generator_mode() != GENERATOR_REPLAY))
+    return 0;
+
+  if (replay->count == 0)
+    replay->request = get_mode_request();
+  replay_entry_t *entry = &replay->entries[replay->count++];
+  entry->dptr = dptr;
+  entry->length_in_bytes = length_in_bytes & ~BUFFER_REPLAY_FLAGS;
+  entry->seq_offset = (length_in_bytes & BUFFER_REPLAY_PATCH) != 0;
+
+  if ((length_in_bytes & BUFFER_REPLAY_LAST) || (replay->count == REPLAY_MAX_FRAMES))
+    complete_ring(replay);
+  return 1;
+}
+
+int replay_release(REFERENCE_PARAM(replay_t, replay), int new_ring, REFERENCE_PARAM(uintptr_t, dptr))
+{
+  if (!replay->count)
+    return 0;
+  if (!new_ring && (get_generator_mode() == GENERATOR_REPLAY) && (replay->request == get_mode_request()))
+    return 0;
+
+  *dptr = replay->entries[--replay->count].dptr;
+  replay->complete = 0;
+  return 1;
+}
+
+int replay_next(REFERENCE_PARAM(replay_t, replay), unsigned now, REFERENCE_PARAM(uintptr_t, dptr),
+    REFERENCE_PARAM(unsigned, length_in_bytes), REFERENCE_PARAM(unsigned, tx_class),
+    REFERENCE_PARAM(unsigned, wake_time))
+{
+  if (!replay->complete)
+    return 0;
+
+  replay_entry_t *entry = &replay->entries[replay->next];
+  packet_data_t *data = (packet_data_t *)entry->dptr;
+
+  if (!replay->head_scheduled) {
+    replay->ready_time = pacer_departure_time(&replay->pacer, now, data->period);
+    replay->head_scheduled = 1;
+  }
+  if ((int)(replay->ready_time - now) > 0) {
+    *wake_time = replay->ready_time;
+    return 0;
+  }
+
+  if (entry->seq_offset) {
+    unsigned char *seq = (unsigned char *)entry->dptr + BUFFER_OVERHEAD_BYTES + entry->seq_offset;
+    unsigned seq_num = entry->seq_num;
+    seq[0] = seq_num >> 24;
+    seq[1] = seq_num >> 16;
+    seq[2] = seq_num >> 8;
+    seq[3] = seq_num;
+    entry->seq_num = (seq_num & ~PRODUCER_SEQ_MASK) | ((seq_num + entry->seq_step) & PRODUCER_SEQ_MASK);
+  }
+
+  *dptr = entry->dptr;
+  *length_in_bytes = entry->length_in_bytes;
+  *tx_class = (data->tx_class < TX_CLASSES) ? data->tx_class : TX_CLASS_BEST_EFFORT;
+  replay->head_scheduled = 0;
+  replay->next = (replay->next + 1 == replay->count) ? 0 : replay->next + 1;
+  return 1;
+}
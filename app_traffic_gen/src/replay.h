@@ -0,0 +1,90 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdint.h>
+#include <xccompat.h>
+#include "buffers.h"
+#include "descriptor_ring.h"
+#include "pacer.h"
+
+/*
+ * Replay mode sends a ring of frames over and over with nothing generated per
+ * frame, as a baseline for the highest rate the MAC can take.
+ *
+ * The first generator fills the ring once from the directed configuration, with
+ * the sizes, types and periods it would have sent, and marks each frame in its
+ * length (BUFFER_REPLAY). The transmitter keeps the marked frames instead of
+ * releasing them, so the ring is held in buffers of the pool, and then cycles
+ * through it on the schedule of their periods without the generators or the
+ * buffer manager. Leaving replay mode hands the buffers back, as does asking for
+ * the ring again, which the generator could not otherwise fill when the ring
+ * holds all of its buffers.
+ *
+ * Each frame can be given the next sequence number of its packet type or flow as
+ * it is sent, so a receiver sees the numbers carry on from one pass of the ring
+ * to the next. Otherwise the frames are sent unchanged and it counts duplicates.
+ */
+
+// The most frames in the ring, the buffers the transmitter may hold from the first generator
+#ifndef REPLAY_MAX_FRAMES
+#if USE_DESCRIPTOR_RINGS
+#define REPLAY_MAX_FRAMES (BUFFER_COUNT / GENERATOR_PRODUCERS)
+#else
+#define REPLAY_MAX_FRAMES BUFFERS_IN_FLIGHT
+#endif
+#endif
+
+typedef struct replay_entry_t {
+  uintptr_t dptr;
+  unsigned length_in_bytes;
+  unsigned seq_offset; // Of the sequence number in the frame, 0 when it is sent unchanged
+  unsigned seq_num;    // The number the frame is sent with next
+  unsigned seq_step;   // The frames of its packet type or flow in the ring
+} replay_entry_t;
+
+/* Only used by the transmitter */
+typedef struct replay_t {
+  unsigned count;
+  unsigned request; // The mode request the ring was filled for, see get_mode_request()
+  int complete;
+  unsigned next;
+  int head_scheduled;
+  unsigned ready_time;
+  pacer_t pacer;
+  replay_entry_t entries[REPLAY_MAX_FRAMES];
+} replay_t;
+
+#ifdef __XC__
+extern "C" {
+#endif
+
+void replay_init(REFERENCE_PARAM(replay_t, replay));
+
+/*
+ * Keep a frame marked for the ring. A complete ring must have been released
+ * before a frame of a new one is added. Returns 0 if the frame cannot be kept,
+ * in which case it is released as usual.
+ */
+int replay_add(REFERENCE_PARAM(replay_t, replay), uintptr_t dptr, unsigned length_in_bytes);
+
+/*
+ * Whether the ring is to be handed back, as the generator has left replay mode,
+ * has been asked for a new ring or a new ring is starting, and if so the next of
+ * its buffers. Returns 0 once none are left.
+ */
+int replay_release(REFERENCE_PARAM(replay_t, replay), int new_ring, REFERENCE_PARAM(uintptr_t, dptr));
+
+/*
+ * The next frame of a complete ring, as shaper_next(): returns 1 with the frame
+ * to send at once, numbered if asked, or 0 with the time at which it is due.
+ * Returns 0 with the time unchanged when there is no complete ring.
+ */
+int replay_next(REFERENCE_PARAM(replay_t, replay), unsigned now, REFERENCE_PARAM(uintptr_t, dptr),
+    REFERENCE_PARAM(unsigned, length_in_bytes), REFERENCE_PARAM(unsigned, tx_class),
+    REFERENCE_PARAM(unsigned, wake_time));
+
+#ifdef __XC__
+}
+#endif
+
+#endif // __REPLAY_H__
@@ -0,0 +1,154 @@
+/*
+ * Receive-side analysis: sequence number tracking and payload checking per packet
+ * type. Only the receiving task writes the state and its counters; a reset asked
+ * for by another task is picked up with the next frame.
+ */
+#include <string.h>
+#include "rx_analyzer.h"
+#include "packet_generator.h"
+#include "payload.h"
+#include "traffic_stats.h"
+#include "latency.h"
+#include "flow_table.h"
+#include "generator_config.h"
+
+typedef struct rx_seq_t {
+  unsigned started;
+  unsigned next;           // One more than the highest sequence number seen
+  unsigned long long seen; // Bit i set when next - 1 - i has been received
+  unsigned span;           // The numbers from the first received up to next, at most RX_SEQ_WINDOW
+} rx_seq_t;
+
+/* Each producer of the sender numbers its frames itself, see producer_from_seq() */
+static rx_seq_t g_rx_seq[TRAFFIC_GEN_TYPES][GENERATOR_PRODUCERS];
+
+/* Frames of a flow are numbered by the flow, but counted with the packet type */
+static rx_seq_t g_rx_flow_seq[MAX_FLOWS][GENERATOR_PRODUCERS];
+
+/* Incremented to ask the receiving task to reset, which it does when it sees a change */
+static volatile unsigned g_reset_requests = 0;
+static unsigned g_resets_done = 0;
+
+static volatile int g_reflect = 0;
+
+static void clear_counts(void)
+{
+  memset(g_rx_seq, 0, sizeof(g_rx_seq));
+  memset(g_rx_flow_seq, 0, sizeof(g_rx_flow_seq));
+  for (int i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    g_traffic_stats.rx_frames[i] = 0;
+    g_traffic_stats.rx_lost[i] = 0;
+    g_traffic_stats.rx_reordered[i] = 0;
+    g_traffic_stats.rx_duplicates[i] = 0;
+    g_traffic_stats.rx_pattern_errors[i] = 0;
+  }
+  g_traffic_stats.rx_restarts = 0;
+}
+
+/* Sequence numbers without the producer bits, which wrap at PRODUCER_SEQ_MASK */
+static void track_sequence(rx_seq_t *seq, pkt_type_t type, unsigned seq_num)
+{
+  int ahead = (int)((seq_num - seq->next) << PRODUCER_SEQ_BITS) >> PRODUCER_SEQ_BITS;
+
+  if (!seq->started) {
+    seq->started = 1;
+    seq->next = (seq_num + 1) & PRODUCER_SEQ_MASK;
+    seq->seen = 1;
+    seq->span = 1;
+    return;
+  }
+
+  if (ahead >= 0) {
+    // Anything skipped over is lost until it turns up
+    g_traffic_stats.rx_lost[type] += ahead;
+    seq->seen = (ahead + 1 < RX_SEQ_WINDOW) ? (seq->seen << (ahead + 1)) | 1 : 1;
+    seq->span = (seq->span + ahead + 1 < RX_SEQ_WINDOW) ? seq->span + ahead + 1 : RX_SEQ_WINDOW;
+    seq->next = (seq_num + 1) & PRODUCER_SEQ_MASK;
+    return;
+  }
+
+  unsigned behind = -ahead - 1;
+  if (behind < RX_SEQ_WINDOW) {
+    unsigned long long bit = 1ULL << behind;
+    if (seq->seen & bit) {
+      g_traffic_stats.rx_duplicates[type]++;
+    } else {
+      seq->seen |= bit;
+      g_traffic_stats.rx_reordered[type]++;
+      // Numbers before the first received were never counted as lost
+      if (behind < seq->span)
+        g_traffic_stats.rx_lost[type]--;
+    }
+  } else if (behind >= RX_SEQ_RESTART_DISTANCE) {
+    g_traffic_stats.rx_restarts++;
+    seq->next = (seq_num + 1) & PRODUCER_SEQ_MASK;
+    seq->seen = 1;
+    seq->span = 1;
+  } else {
+    // Too late to tell from a duplicate, so assume it was counted as lost
+    g_traffic_stats.rx_reordered[type]++;
+    if (g_traffic_stats.rx_lost[type])
+      g_traffic_stats.rx_lost[type]--;
+  }
+}
+
+void rx_analyzer_frame(const unsigned frame[], unsigned nbytes, unsigned rx_time)
+{
+  const unsigned char *bytes = (const unsigned char *)frame;
+  unsigned offset = 2 * MAC_ADDRESS_BYTES;
+
+  if (g_resets_done != g_reset_requests) {
+    g_resets_done = g_reset_requests;
+    clear_counts();
+  }
+
+  if (nbytes < PAYLOAD_OFFSET)
+    return;
+
+  unsigned ether_type = (bytes[offset] << 8) | bytes[offset + 1];
+  if (ether_type == ETHERTYPE_QINQ) {
+    offset += 4;
+    ether_type = (bytes[offset] << 8) | bytes[offset + 1];
+  }
+  if (ether_type == ETHERTYPE_VLAN) {
+    offset += 4;
+    ether_type = (bytes[offset] << 8) | bytes[offset + 1];
+  }
+  offset += 2;
+
+  pkt_type_t type = ether_type - TRAFFIC_GEN_ETHERTYPE;
+  if ((unsigned)type >= TRAFFIC_GEN_TYPES)
+    return;
+
+  g_traffic_stats.rx_frames[type]++;
+
+  unsigned seq_num = (bytes[offset] << 24) | (bytes[offset + 1] << 16) | (bytes[offset + 2] << 8) | bytes[offset + 3];
+  unsigned flow = (bytes[FRAME_FLOW_OFFSET] << 8) | bytes[FRAME_FLOW_OFFSET + 1];
+  unsigned producer = producer_from_seq(seq_num);
+  seq_num &= PRODUCER_SEQ_MASK;
+  track_sequence(flow < MAX_FLOWS ? &g_rx_flow_seq[flow][producer] : &g_rx_seq[type][producer], type, seq_num);
+  latency_record(type, frame[FRAME_TIMESTAMP_WORD], rx_time);
+
+  // Only whole words are checked; the pattern is the one configured here for the type
+  const pkt_ctrl_t *ctrl = &config_current()->types[type];
+  unsigned end = nbytes / sizeof(unsigned);
+  if (end > PAYLOAD_START_WORD + PAYLOAD_MAX_WORDS)
+    end = PAYLOAD_START_WORD + PAYLOAD_MAX_WORDS;
+  if (payload_check(frame, end, ctrl->payload_pattern, ctrl->payload_value))
+    g_traffic_stats.rx_pattern_errors[type]++;
+}
+
+void rx_analyzer_reset(void)
+{
+  g_reset_requests++;
+}
+
+void rx_analyzer_set_reflect(int reflect)
+{
+  g_reflect = reflect;
+}
+
+int rx_analyzer_get_reflect(void)
+{
+  return g_reflect;
+}
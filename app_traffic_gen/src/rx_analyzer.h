@@ -0,0 +1,55 @@
+#ifndef __RX_ANALYZER_H__
+#define __RX_ANALYZER_H__
+
+#include <xccompat.h>
+
+/*
+ * Receive-side analysis of the frames sent by another traffic generator. Frames
+ * are matched to their packet type by ethertype and the per-type sequence number
+ * after the header is used to count lost, reordered and duplicate frames. The
+ * payload is checked against the pattern this board has configured for the type,
+ * so configure both boards the same way.
+ *
+ * Frames of a flow carry its id and are numbered by the flow, so their sequence
+ * numbers are tracked per flow and the counts added to the flow's packet type.
+ * Each generator producer numbers its own frames, with its index in the top bits,
+ * so the numbers are also tracked per producer. Both boards must be built with
+ * the same GENERATOR_PRODUCERS.
+ *
+ * Sequence numbers are tracked with a window of the last RX_SEQ_WINDOW numbers
+ * seen below the highest. A frame that is missing when a later one arrives is
+ * counted as lost; if it then turns up within the window it is counted as
+ * reordered instead. A number already seen in the window is a duplicate.
+ * A number far behind the window means the sender was restarted.
+ *
+ * The counts are kept in g_traffic_stats and sent to the host with the other
+ * counters. They run from the last configuration swap. The latency of each frame
+ * from its transmit time to rx_time is recorded by latency.c.
+ */
+#define RX_SEQ_WINDOW 64
+
+// A sequence number at least this far behind the highest is taken as a restart
+#define RX_SEQ_RESTART_DISTANCE 0x10000
+
+#ifdef __XC__
+extern "C" {
+#endif
+
+/* Analyse one received frame, called by the task that receives the frames */
+void rx_analyzer_frame(const unsigned frame[], unsigned nbytes, unsigned rx_time);
+
+/* Restart the analysis, can be called from any task */
+void rx_analyzer_reset(void);
+
+/*
+ * Send received frames back out unchanged, so that the board that sent them can
+ * measure the round trip latency. Set by the host, read by the receiving task.
+ */
+void rx_analyzer_set_reflect(int reflect);
+int rx_analyzer_get_reflect(void);
+
+#ifdef __XC__
+}
+#endif
+
+#endif // __RX_ANALYZER_H__
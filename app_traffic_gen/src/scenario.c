@@ -0,0 +1,148 @@
+/*
+ * Storage and sequencing of the phases of a scenario uploaded by the host.
+ */
+#include <xccompat.h>
+#include "scenario.h"
+#include "config_upload.h"
+#include "traffic_ctlr_host_cmds.h"
+#include "debug_print.h"
+
+typedef struct scenario_phase_t {
+  unsigned start;    // The word after the phase record
+  unsigned length;
+  unsigned duration_ms;
+} scenario_phase_t;
+
+static uint32_t g_words[SCENARIO_WORDS];
+static scenario_phase_t g_phases[SCENARIO_MAX_PHASES];
+static unsigned g_phase_count = 0;
+
+static int g_running = 0;
+static int g_start_requested = 0;
+static int g_loop = 0;
+static int g_starting = 0;
+static unsigned g_phase = 0;        // The phase in use
+static unsigned g_remaining_ms = 0; // Of the phase in use
+static unsigned g_loops = 0;
+
+int scenario_load(const uint32_t words[], unsigned length)
+{
+  unsigned position = 0;
+  const protocol_record_t *record;
+
+  scenario_stop();
+  g_phase_count = 0;
+
+  if (length > SCENARIO_WORDS) {
+    debug_printf("Scenario rejected: %d words, at most %d\n", length, SCENARIO_WORDS);
+    return 0;
+  }
+
+  for (unsigned i = 0; i < length; i++)
+    g_words[i] = words[i];
+
+  while ((record = config_records_next(g_words, length, &position)) != NULL) {
+    if ((record->cmd == CMD_SCENARIO) && (record->sub == 'p')) {
+      if (g_phase_count == SCENARIO_MAX_PHASES) {
+        debug_printf("Scenario rejected: more than %d phases\n", SCENARIO_MAX_PHASES);
+        g_phase_count = 0;
+        return 0;
+      }
+      g_phases[g_phase_count].start = position;
+      g_phases[g_phase_count].length = 0;
+      g_phases[g_phase_count].duration_ms = config_record_args(record)[0];
+      g_phase_count++;
+    } else if (g_phase_count) {
+      g_phases[g_phase_count - 1].length = position - g_phases[g_phase_count - 1].start;
+    } else {
+      debug_printf("Scenario rejected: it does not start with a phase\n");
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void scenario_start(int loop)
+{
+  if (!g_phase_count) {
+    debug_printf("No scenario to start\n");
+    return;
+  }
+  g_loop = loop;
+  g_loops = 0;
+  g_starting = 1;
+  g_phase = 0;
+  g_remaining_ms = 0;
+  g_running = 1;
+  g_start_requested = 1;
+}
+
+void scenario_stop(void)
+{
+  g_running = 0;
+  g_start_requested = 0;
+}
+
+int scenario_start_requested(void)
+{
+  int requested = g_start_requested;
+  g_start_requested = 0;
+  return requested;
+}
+
+int scenario_running(void)
+{
+  return g_running;
+}
+
+int scenario_wait(unsigned *ticks)
+{
+  unsigned ms = g_remaining_ms;
+
+  if (!ms)
+    return 0;
+  if (ms > SCENARIO_MAX_WAIT_MS)
+    ms = SCENARIO_MAX_WAIT_MS;
+  g_remaining_ms -= ms;
+  *ticks = ms * SCENARIO_TICKS_PER_MS;
+  return 1;
+}
+
+const uint32_t *scenario_next_phase(unsigned *length)
+{
+  if (!g_running)
+    return NULL;
+
+  if (g_starting) {
+    g_starting = 0;
+  } else if (++g_phase == g_phase_count) {
+    if (!g_loop) {
+      g_running = 0;
+      return NULL;
+    }
+    g_phase = 0;
+    g_loops++;
+  }
+
+  g_remaining_ms = g_phases[g_phase].duration_ms;
+  *length = g_phases[g_phase].length;
+  return &g_words[g_phases[g_phase].start];
+}
+
+unsigned scenario_get_phase(void)
+{
+  return g_phase;
+}
+
+void scenario_print(void)
+{
+  if (!g_phase_count)
+    return;
+
+  debug_printf("Scenario of %d phases", g_phase_count);
+  if (g_running)
+    debug_printf(", in phase %d%s", g_phase + 1, g_loop ? " looping" : "");
+  if (g_loops)
+    debug_printf(" after %d loops", g_loops);
+  debug_printf("\n");
+}
@@ -0,0 +1,69 @@
+#ifndef __SCENARIO_H__
+#define __SCENARIO_H__
+
+#include <stdint.h>
+#include <xccompat.h>
+#include "host_protocol.h"
+
+/*
+ * A scenario of timed phases which the device steps through on its own reference
+ * timer, so the time between phases does not depend on the host. The host uploads
+ * a scenario as records (see host_protocol.h): each phase starts with a phase
+ * record giving its duration in milliseconds, followed by the changes applied to
+ * the next configuration at its start, which is then swapped in as with 'e'.
+ * Phases therefore build on each other, and a scenario that loops should set in
+ * its first phase everything the later phases change.
+ *
+ * The scenario is kept by the task that handles the host's messages, which also
+ * steps it. Its size is limited by SCENARIO_WORDS and SCENARIO_MAX_PHASES.
+ */
+
+// Timer comparisons only reach 2^31 ticks, so longer phases are waited for in parts
+#define SCENARIO_MAX_WAIT_MS 10000
+#define SCENARIO_TICKS_PER_MS 100000
+
+#ifdef __XC__
+extern "C" {
+#endif
+
+/* Returns 1 once after a scenario is started, for the caller to take its first step */
+int scenario_start_requested(void);
+
+int scenario_running(void);
+
+#ifdef __XC__
+}
+#endif
+
+#ifndef __XC__
+
+/*
+ * Keep the records of a checked upload as the scenario, stopping any that is
+ * running. Returns 0 with the reason printed if it is too big or does not start
+ * with a phase.
+ */
+int scenario_load(const uint32_t words[], unsigned length);
+
+void scenario_start(int loop);
+void scenario_stop(void);
+
+/*
+ * Take the next part of the wait for the current phase to end. Returns 0 when
+ * the phase is over, otherwise 1 with the ticks to wait.
+ */
+int scenario_wait(unsigned *ticks);
+
+/*
+ * Move to the next phase, returning its records after the phase record and their
+ * length in words. Returns NULL when a scenario that does not loop is over.
+ */
+const uint32_t *scenario_next_phase(unsigned *length);
+
+/* The phase in use, counting from zero */
+unsigned scenario_get_phase(void);
+
+void scenario_print(void);
+
+#endif // __XC__
+
+#endif // __SCENARIO_H__
@@ -0,0 +1,158 @@
+/*
+ * Transmit queues per traffic class with credit-based shaping.
+ */
+#include <xccompat.h>
+#include "shaper.h"
+#include "packet_generator.h"
+
+/* Written by the host command handler, read by the transmitter */
+static volatile unsigned g_idle_slope[TX_CLASSES];
+
+/* Preamble, CRC and inter-frame gap in addition to the frame bytes */
+#define WIRE_OVERHEAD_BYTES (8 + 4 + 12)
+
+void shaper_init(REFERENCE_PARAM(shaper_t, shaper))
+{
+  for (int i = 0; i < TX_CLASSES; i++) {
+    shaper_queue_t *q = &shaper->queue[i];
+    q->head = 0;
+    q->tail = 0;
+    q->head_scheduled = 0;
+    q->ready_time = 0;
+    pacer_init(&q->pacer);
+    q->credit = 0;
+    q->credit_time = 0;
+  }
+  shaper->queued = 0;
+}
+
+void shaper_set_idle_slope(tx_class_t tx_class, unsigned slope)
+{
+  g_idle_slope[tx_class] = slope;
+}
+
+unsigned shaper_get_idle_slope(tx_class_t tx_class)
+{
+  return g_idle_slope[tx_class];
+}
+
+static inline unsigned queue_count(const shaper_queue_t *q)
+{
+  return q->head - q->tail;
+}
+
+/*
+ * Credit is gained at the idle slope while the frame at the head is ready and
+ * waiting. When there is nothing waiting negative credit recovers to zero and
+ * positive credit is lost.
+ */
+static void update_credit(shaper_queue_t *q, unsigned slope, unsigned now)
+{
+  int elapsed = (int)(now - q->credit_time);
+  unsigned from = q->credit_time;
+
+  if (!slope) {
+    q->credit = 0;
+    q->credit_time = now;
+    return;
+  }
+  if (elapsed <= 0)
+    return;
+  q->credit_time = now;
+
+  if (queue_count(q) && (int)(now - q->ready_time) > 0) {
+    unsigned waiting = ((int)(q->ready_time - from) > 0) ? now - q->ready_time : (unsigned)elapsed;
+    q->credit += (long long)waiting * slope;
+  } else if (q->credit < 0) {
+    q->credit += (long long)elapsed * slope;
+    if (q->credit > 0)
+      q->credit = 0;
+  } else {
+    q->credit = 0;
+  }
+}
+
+int shaper_enqueue(REFERENCE_PARAM(shaper_t, shaper), uintptr_t dptr, unsigned length_in_bytes, unsigned now)
+{
+  unsigned tx_class = ((packet_data_t *)dptr)->tx_class;
+  if (tx_class >= TX_CLASSES)
+    tx_class = TX_CLASS_BEST_EFFORT;
+
+  shaper_queue_t *q = &shaper->queue[tx_class];
+  if (queue_count(q) == SHAPER_QUEUE_DEPTH)
+    return 0;
+
+  // Bring the credit up to date before the queue stops being empty
+  if (!queue_count(q))
+    update_credit(q, g_idle_slope[tx_class], now);
+
+  unsigned index = q->head % SHAPER_QUEUE_DEPTH;
+  q->dptr[index] = dptr;
+  q->length_in_bytes[index] = length_in_bytes;
+  q->head++;
+  shaper->queued++;
+  return 1;
+}
+
+int shaper_next(REFERENCE_PARAM(shaper_t, shaper), unsigned now, REFERENCE_PARAM(uintptr_t, dptr),
+    REFERENCE_PARAM(unsigned, length_in_bytes), REFERENCE_PARAM(unsigned, tx_class),
+    REFERENCE_PARAM(unsigned, wake_time))
+{
+  int have_wake = 0;
+  int wake = 0;
+
+  if (!shaper->queued)
+    return 0;
+
+  for (int c = TX_CLASSES - 1; c >= 0; c--) {
+    shaper_queue_t *q = &shaper->queue[c];
+    unsigned slope = g_idle_slope[c];
+
+    if (queue_count(q) && !q->head_scheduled) {
+      unsigned period = ((packet_data_t *)q->dptr[q->tail % SHAPER_QUEUE_DEPTH])->period;
+      q->ready_time = pacer_departure_time(&q->pacer, now, period);
+      q->head_scheduled = 1;
+    }
+
+    update_credit(q, slope, now);
+    if (!queue_count(q))
+      continue;
+
+    // Wait for the frame's place in its class's schedule, and then for the credit
+    int wait = (int)(q->ready_time - now);
+    if (wait <= 0 && q->credit < 0)
+      wait = (int)((-q->credit + slope - 1) / slope);
+
+    if (wait <= 0) {
+      unsigned index = q->tail % SHAPER_QUEUE_DEPTH;
+      *dptr = q->dptr[index];
+      *length_in_bytes = q->length_in_bytes[index];
+      *tx_class = c;
+      q->tail++;
+      q->head_scheduled = 0;
+      shaper->queued--;
+
+      if (slope) {
+        unsigned bits = (*length_in_bytes - BUFFER_OVERHEAD_BYTES + WIRE_OVERHEAD_BYTES) * 8;
+        q->credit -= (long long)bits * SHAPER_SLOPE_ONE;
+      }
+      return 1;
+    }
+
+    if (!have_wake || wait < wake) {
+      wake = wait;
+      have_wake = 1;
+    }
+  }
+
+  *wake_time = now + wake;
+  return 0;
+}
+
+unsigned shaper_late_frames(REFERENCE_PARAM(shaper_t, shaper))
+{
+  unsigned late_frames = 0;
+  for (int i = 0; i < TX_CLASSES; i++)
+    late_frames += shaper->queue[i].pacer.late_frames;
+  return late_frames;
+}
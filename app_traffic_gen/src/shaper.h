@@ -0,0 +1,88 @@
+#ifndef __SHAPER_H__
+#define __SHAPER_H__
+
+#include <stdint.h>
+#include <xccompat.h>
+#include "buffers.h"
+#include "pacer.h"
+
+/*
+ * Transmit queues per traffic class with credit-based shaping (IEEE 802.1Qav).
+ *
+ * Each packet type is sent in one of the classes. Frames of a class keep their own
+ * schedule, from the periods the generator gives them, so a stream of class A
+ * frames is paced independently of the best effort load around it. A frame is
+ * ready once its time in its class's schedule has come.
+ *
+ * When the transmitter is free it sends the ready frame of the highest class
+ * whose credit is not negative. A class with a reservation (its idle slope) gains
+ * credit at that rate while it has a frame waiting, and loses the bits of each
+ * frame it sends, so it cannot take more than its reservation however much it is
+ * given. Without frames waiting, positive credit is lost and negative credit
+ * recovers to zero. A class without a reservation is not shaped.
+ *
+ * Times and credit are in 100MHz reference timer ticks, which is one bit at 100Mb/s.
+ */
+typedef enum {
+  TX_CLASS_BEST_EFFORT,
+  TX_CLASS_B,
+  TX_CLASS_A,
+} tx_class_t;
+
+// Classes are served in strict priority, highest first
+#define TX_CLASSES 3
+
+// Idle slopes are fractions of the line rate in 0.16 fixed point
+#define SHAPER_SLOPE_ONE 0x10000
+
+/*
+ * Each class can queue every buffer the transmitter may hold, so one class cannot
+ * block another's frames from reaching the transmitter.
+ */
+#define SHAPER_QUEUE_DEPTH BUFFER_COUNT
+
+typedef struct shaper_queue_t {
+  unsigned head;
+  unsigned tail;
+  uintptr_t dptr[SHAPER_QUEUE_DEPTH];
+  unsigned length_in_bytes[SHAPER_QUEUE_DEPTH];
+
+  // The time the frame at the head is ready, set the first time the transmitter
+  // looks at it as it would have been when the frame was handed straight over
+  int head_scheduled;
+  unsigned ready_time;
+  pacer_t pacer;
+
+  // In ticks scaled by SHAPER_SLOPE_ONE, and the time it was last brought up to date
+  long long credit;
+  unsigned credit_time;
+} shaper_queue_t;
+
+typedef struct shaper_t {
+  shaper_queue_t queue[TX_CLASSES];
+  unsigned queued;
+} shaper_t;
+
+void shaper_init(REFERENCE_PARAM(shaper_t, shaper));
+
+/* Set by the host command handler and used by the transmitter from its next frame */
+void shaper_set_idle_slope(tx_class_t tx_class, unsigned slope);
+unsigned shaper_get_idle_slope(tx_class_t tx_class);
+
+/* Add a buffer from the generator, returns 0 if its class's queue is full */
+int shaper_enqueue(REFERENCE_PARAM(shaper_t, shaper), uintptr_t dptr, unsigned length_in_bytes, unsigned now);
+
+/*
+ * Choose the frame to send at the given time. Returns 1 with the frame and its
+ * class, which the caller sends at once, or 0 with the time at which to try again
+ * when frames are queued but none can be sent yet. Returns 0 with the time
+ * unchanged when empty.
+ */
+int shaper_next(REFERENCE_PARAM(shaper_t, shaper), unsigned now, REFERENCE_PARAM(uintptr_t, dptr),
+    REFERENCE_PARAM(unsigned, length_in_bytes), REFERENCE_PARAM(unsigned, tx_class),
+    REFERENCE_PARAM(unsigned, wake_time));
+
+/* The frames sent late to their class's schedule, for the traffic counters */
+unsigned shaper_late_frames(REFERENCE_PARAM(shaper_t, shaper));
+
+#endif // __SHAPER_H__
@@ -12,6 +12,17 @@ enum {
   CMD_SWAP_CFG                 = 's',
   CMD_LINE_RATE                = 'r',
   CMD_VLAN_TAG                 = 'v',
+  CMD_CATCHUP_LIMIT            = 'l',
+  CMD_GAP_DISTRIBUTION         = 'g',
+  CMD_SIZE_TABLE               = 'z',
+  CMD_STATS_INTERVAL           = 'i',
+  CMD_LATENCY                  = 't',
+  CMD_REFLECT                  = 'x',
+  CMD_FLOW                     = 'f',
+  CMD_MAC_SWEEP                = 'w',
+  CMD_SHAPER                   = 'k',
+  CMD_SCENARIO                 = 'n',
+  CMD_PCAP                     = 'u',
   CMD_QUIT                     = 'q'
 };
 
@@ -0,0 +1,62 @@
+/*
+ * Traffic counters and their transfer to the host.
+ */
+#include <xscope.h>
+#include "traffic_stats.h"
+#include "buffers.h"
+
+volatile traffic_stats_t g_traffic_stats;
+volatile traffic_generated_t g_traffic_generated[GENERATOR_PRODUCERS];
+
+/* Written by the host command handler, read by the control task */
+static volatile unsigned g_interval = 0;
+
+void traffic_stats_sent(unsigned tx_class, unsigned bytes, unsigned late_frames)
+{
+  g_traffic_stats.sent_frames++;
+  g_traffic_stats.sent_bytes += bytes;
+  g_traffic_stats.class_frames[tx_class]++;
+  g_traffic_stats.class_bytes[tx_class] += bytes;
+  g_traffic_stats.late_frames = late_frames;
+}
+
+void traffic_stats_received(unsigned bytes)
+{
+  g_traffic_stats.received_frames++;
+  g_traffic_stats.received_bytes += bytes;
+}
+
+void traffic_stats_set_interval(unsigned ticks)
+{
+  g_interval = ticks;
+}
+
+unsigned traffic_stats_get_interval(void)
+{
+  return g_interval;
+}
+
+void traffic_stats_send(unsigned now)
+{
+  traffic_stats_t stats;
+  buffers_stats_t buffers_stats;
+
+  // Read each counter once; the tasks carry on counting while they are sent
+  stats = *(traffic_stats_t *)&g_traffic_stats;
+  stats.time = now;
+
+  for (unsigned i = 0; i < TRAFFIC_STATS_TYPES; i++) {
+    stats.generated_frames[i] = 0;
+    stats.generated_bytes[i] = 0;
+    for (unsigned j = 0; j < GENERATOR_PRODUCERS; j++) {
+      stats.generated_frames[i] += g_traffic_generated[j].frames[i];
+      stats.generated_bytes[i] += g_traffic_generated[j].bytes[i];
+    }
+  }
+
+  buffers_stats_get(&buffers_stats);
+  stats.generator_starved = buffers_stats.generator_starved;
+  stats.transmitter_starved = buffers_stats.transmitter_starved;
+
+  xscope_bytes(TRAFFIC_STATS_PROBE, sizeof(stats), (const unsigned char *)&stats);
+}
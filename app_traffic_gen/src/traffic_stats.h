@@ -0,0 +1,83 @@
+#ifndef __TRAFFIC_STATS_H__
+#define __TRAFFIC_STATS_H__
+
+/*
+ * Counters of the traffic generated, sent and received, which the device sends to
+ * the host over xscope at an interval set by the host. The layout is shared with
+ * the host controller. The traffic counts run freely and wrap; the host works on
+ * the difference between one set and the next. The receive analysis counts are
+ * totals since the last configuration swap.
+ *
+ * Each counter is only written by one task: each generator counts the frames it
+ * fills per packet type, which are added together when they are sent, the
+ * transmitter those it sends and how many were late, and the ethernet client
+ * those it receives and their analysis.
+ */
+#define TRAFFIC_STATS_TYPES 3 // One for each pkt_type_t
+#define TRAFFIC_STATS_CLASSES 3 // One for each tx_class_t
+
+// The xscope probe the counters are sent on
+#define TRAFFIC_STATS_PROBE 0
+#define TRAFFIC_STATS_PROBE_NAME "Traffic stats"
+
+// The longest interval, so that the device timer cannot wrap within one
+#define TRAFFIC_STATS_MAX_INTERVAL_MS 20000
+
+typedef struct traffic_stats_t {
+  unsigned time; // Reference timer ticks when the counters were read
+  unsigned generated_frames[TRAFFIC_STATS_TYPES];
+  unsigned generated_bytes[TRAFFIC_STATS_TYPES];
+  unsigned sent_frames;
+  unsigned sent_bytes;
+  unsigned received_frames;
+  unsigned received_bytes;
+  unsigned late_frames;
+  unsigned generator_starved;
+  unsigned transmitter_starved;
+
+  // Receive analysis per packet type since the last configuration swap, see rx_analyzer.h
+  unsigned rx_frames[TRAFFIC_STATS_TYPES];
+  unsigned rx_lost[TRAFFIC_STATS_TYPES];
+  unsigned rx_reordered[TRAFFIC_STATS_TYPES];
+  unsigned rx_duplicates[TRAFFIC_STATS_TYPES];
+  unsigned rx_pattern_errors[TRAFFIC_STATS_TYPES];
+  unsigned rx_restarts;
+
+  // Frames sent from each transmit queue, see shaper.h
+  unsigned class_frames[TRAFFIC_STATS_CLASSES];
+  unsigned class_bytes[TRAFFIC_STATS_CLASSES];
+} traffic_stats_t;
+
+#ifndef TRAFFIC_STATS_HOST
+
+#include "buffers.h"
+
+#ifndef __XC__
+typedef struct traffic_generated_t {
+  unsigned frames[TRAFFIC_STATS_TYPES];
+  unsigned bytes[TRAFFIC_STATS_TYPES];
+} traffic_generated_t;
+
+extern volatile traffic_stats_t g_traffic_stats;
+extern volatile traffic_generated_t g_traffic_generated[GENERATOR_PRODUCERS];
+
+static inline void traffic_stats_generated(unsigned producer, int type, unsigned bytes)
+{
+  g_traffic_generated[producer].frames[type]++;
+  g_traffic_generated[producer].bytes[type] += bytes;
+}
+#endif
+
+void traffic_stats_sent(unsigned tx_class, unsigned bytes, unsigned late_frames);
+void traffic_stats_received(unsigned bytes);
+
+// An interval of zero stops the counters being sent
+void traffic_stats_set_interval(unsigned ticks);
+unsigned traffic_stats_get_interval(void);
+
+// Send the counters to the host, stamped with the current time
+void traffic_stats_send(unsigned now);
+
+#endif // TRAFFIC_STATS_HOST
+
+#endif // __TRAFFIC_STATS_H__
@@ -0,0 +1,547 @@
+/*
+ * Encoding of console commands as the binary records the device reads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "command_encoder.h"
+
+#define MAC_ADDRESS_BYTES 6
+
+// The most entries of the tables the device holds
+#define MAX_SIZE_ENTRIES 32
+#define MAX_TAG_ENTRIES 16
+#define MAX_GAP_TABLE_ENTRIES 16
+
+static char get_next_char(const unsigned char **buffer)
+{
+  const unsigned char *ptr = *buffer;
+  while (*ptr && isspace(*ptr))
+    ptr++;
+
+  if (!*ptr) {
+    *buffer = ptr;
+    return '\0';
+  }
+  *buffer = ptr + 1;
+  return *ptr;
+}
+
+/* Returns 1 if there is another value before the end of the command */
+static int more_values(const unsigned char *ptr)
+{
+  while (isspace(*ptr))
+    ptr++;
+  return *ptr != '\0';
+}
+
+static int convert_atoi_substr(const unsigned char **buffer)
+{
+  const unsigned char *ptr = *buffer;
+  unsigned int value = 0;
+  while (*ptr && isspace(*ptr))
+    ptr++;
+
+  if (*ptr == '\0')
+    return 0;
+
+  value = atoi((char*)ptr);
+
+  while (*ptr && !isspace(*ptr))
+    ptr++;
+
+  *buffer = ptr;
+  return value;
+}
+
+/* Unsigned equivalent of convert_atoi_substr() for hex values of up to 32 bits */
+static unsigned convert_hex_substr(const unsigned char **buffer)
+{
+  const unsigned char *ptr = *buffer;
+  unsigned int value = 0;
+  while (*ptr && isspace(*ptr))
+    ptr++;
+
+  if (*ptr == '\0')
+    return 0;
+
+  value = strtoul((char*)ptr, NULL, 16);
+
+  while (*ptr && !isspace(*ptr))
+    ptr++;
+
+  *buffer = ptr;
+  return value;
+}
+
+/* Parse a MAC address of the form aa:bb:cc:dd:ee:ff
+ * Returns 0 on successful parsing, 1 otherwise */
+static int parse_mac_address(const unsigned char *ptr, unsigned char mac_address[])
+{
+  int index = 0;
+
+  while (*ptr && index < MAC_ADDRESS_BYTES) {
+    char *end = NULL;
+    while (isspace(*ptr))
+      ptr++;
+
+    // Assume the bytes are hex
+    int byte = strtol((const char *)ptr, &end, 16);
+
+    // If the pointer hasn't moved then there is an error
+    if ((unsigned char *)end == ptr)
+      return 1;
+
+    mac_address[index] = byte;
+
+    ptr = (unsigned char *)end;
+    while (isspace(*ptr))
+      ptr++;
+
+    if (*ptr) {
+      if (*ptr == ':') {
+        index++;
+        ptr++;
+      } else {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Parse a MAC address of the form aa:bb:cc:dd:ee:ff from the next word of the buffer
+ * and move past it. Returns 0 on successful parsing, 1 otherwise */
+static int convert_mac_substr(const unsigned char **buffer, unsigned char mac_address[])
+{
+  unsigned char word[3 * MAC_ADDRESS_BYTES];
+  const unsigned char *ptr = *buffer;
+  unsigned len = 0;
+
+  while (*ptr && isspace(*ptr))
+    ptr++;
+
+  while (*ptr && !isspace(*ptr)) {
+    if (len == sizeof(word) - 1)
+      return 1;
+    word[len++] = *ptr++;
+  }
+  word[len] = '\0';
+
+  *buffer = ptr;
+  if (len == 0)
+    return 1;
+  return parse_mac_address(word, mac_address);
+}
+
+/* A record as it is sent, its arguments straight after it */
+typedef struct encoded_record_t {
+  protocol_record_t header;
+  uint32_t args[PROTOCOL_MAX_ARGS];
+} encoded_record_t;
+
+static protocol_record_t *start_record(encoded_record_t *record, unsigned char cmd, unsigned char sub,
+    unsigned char type)
+{
+  record->header.cmd = cmd;
+  record->header.sub = sub;
+  record->header.type = type;
+  record->header.args = 0;
+  return &record->header;
+}
+
+static void add_arg(encoded_record_t *record, uint32_t value)
+{
+  if (record->header.args < PROTOCOL_MAX_ARGS)
+    record->args[record->header.args++] = value;
+}
+
+/* Add the values up to the end of the command, at most max of them */
+static void add_values(encoded_record_t *record, const unsigned char **ptr, unsigned max)
+{
+  for (unsigned i = 0; (i < max) && more_values(*ptr); i++)
+    add_arg(record, convert_atoi_substr(ptr));
+}
+
+static void add_mac(encoded_record_t *record, const unsigned char mac_address[])
+{
+  uint32_t words[PROTOCOL_MAC_WORDS];
+  protocol_pack_bytes(words, mac_address, MAC_ADDRESS_BYTES);
+  for (int i = 0; i < PROTOCOL_MAC_WORDS; i++)
+    add_arg(record, words[i]);
+}
+
+/* See PROTOCOL_FLOW_ARGS */
+static int encode_flow(encoded_record_t *record, const unsigned char *ptr)
+{
+  unsigned char macs[2 * MAC_ADDRESS_BYTES];
+  uint32_t words[3];
+
+  start_record(record, CMD_FLOW, 'a', get_next_char(&ptr));
+  if (convert_mac_substr(&ptr, &macs[0]) || convert_mac_substr(&ptr, &macs[MAC_ADDRESS_BYTES]))
+    return 0;
+
+  unsigned tagged = convert_atoi_substr(&ptr);
+  unsigned vlan = convert_atoi_substr(&ptr);
+  unsigned prio = convert_atoi_substr(&ptr);
+  unsigned ether_type = convert_hex_substr(&ptr);
+  unsigned size_min = convert_atoi_substr(&ptr);
+  unsigned size_max = convert_atoi_substr(&ptr);
+  unsigned weight = convert_atoi_substr(&ptr);
+
+  protocol_pack_bytes(words, macs, sizeof(macs));
+  for (int i = 0; i < 3; i++)
+    add_arg(record, words[i]);
+  add_arg(record, tagged << 16 | (prio & 0x7) << 13 | (vlan & 0xfff));
+  add_arg(record, ether_type << 16 | (weight & 0xffff));
+  add_arg(record, size_min << 16 | (size_max & 0xffff));
+  return 1;
+}
+
+/*
+ * Encode a command as a record, with its arguments following. Sets staged if it
+ * changes the next configuration. Returns 0 if the command is not recognised.
+ */
+static int encode_command(const unsigned char *command, encoded_record_t *record, int *staged)
+{
+  unsigned char cmd = command[0];
+  const unsigned char *ptr = &command[1]; // Skip command
+
+  *staged = 1;
+  switch (cmd) {
+    case CMD_SET_MAC_ADDRESS:
+      {
+        unsigned char mac_address[MAC_ADDRESS_BYTES] = { 0, 0, 0, 0, 0, 0 };
+        start_record(record, cmd, '-', get_next_char(&ptr));
+        if (parse_mac_address(ptr, mac_address))
+          return 0;
+        add_mac(record, mac_address);
+      }
+      return 1;
+
+    case CMD_PKT_CONTROL:
+      {
+        protocol_record_t *header = start_record(record, cmd, '-', get_next_char(&ptr));
+        int weight = convert_atoi_substr(&ptr);
+        add_arg(record, weight);
+        if (!weight)
+          return 1;
+
+        add_arg(record, convert_atoi_substr(&ptr));
+        add_arg(record, convert_atoi_substr(&ptr));
+        switch (get_next_char(&ptr)) {
+          case 'i': header->sub = 'i'; break;
+          case 'p': header->sub = 'p'; break;
+          case 'r': header->sub = 'r'; break;
+          case 'c': header->sub = 'c'; add_arg(record, convert_hex_substr(&ptr)); break;
+          default : break;
+        }
+      }
+      return 1;
+
+    case CMD_SIZE_TABLE:
+      {
+        unsigned char type = get_next_char(&ptr);
+        unsigned char sub = get_next_char(&ptr);
+        start_record(record, cmd, sub, type);
+        if (sub == 'a')
+          add_values(record, &ptr, 2 * MAX_SIZE_ENTRIES);
+      }
+      return 1;
+
+    case CMD_MAC_SWEEP:
+      {
+        unsigned char type = get_next_char(&ptr);
+        unsigned char sub = (get_next_char(&ptr) == 's') ? 's' : 'd';
+        start_record(record, cmd, sub, type);
+        switch (get_next_char(&ptr)) {
+          case 's':
+            add_arg(record, 's');
+            add_arg(record, convert_hex_substr(&ptr));
+            add_arg(record, convert_hex_substr(&ptr));
+            break;
+          case 'r':
+            add_arg(record, 'r');
+            add_arg(record, convert_hex_substr(&ptr));
+            add_arg(record, 0);
+            break;
+          default:
+            add_arg(record, 'o');
+            add_arg(record, 0);
+            add_arg(record, 0);
+            break;
+        }
+      }
+      return 1;
+
+    case CMD_VLAN_TAG:
+      {
+        unsigned char type = get_next_char(&ptr);
+        unsigned char sub = get_next_char(&ptr);
+        switch (sub) {
+          case 'e':
+            start_record(record, cmd, sub, type);
+            add_arg(record, convert_atoi_substr(&ptr));
+            add_arg(record, convert_atoi_substr(&ptr));
+            break;
+          case 'q':
+          case 'c':
+            start_record(record, cmd, sub, type);
+            for (int i = 0; i < 4; i++)
+              add_arg(record, convert_atoi_substr(&ptr));
+            break;
+          case 't':
+            start_record(record, cmd, sub, type);
+            add_values(record, &ptr, 3 * MAX_TAG_ENTRIES);
+            break;
+          default:
+            start_record(record, cmd, 'd', type);
+            break;
+        }
+      }
+      return 1;
+
+    case CMD_LINE_RATE:
+      {
+        unsigned char type = get_next_char(&ptr);
+        unsigned char sub = get_next_char(&ptr);
+        start_record(record, cmd, ((sub == 'b') || (sub == 'f')) ? sub : 'l', type);
+        add_arg(record, convert_hex_substr(&ptr));
+        add_arg(record, convert_hex_substr(&ptr));
+      }
+      return 1;
+
+    case CMD_GAP_DISTRIBUTION:
+      {
+        unsigned char sub = get_next_char(&ptr);
+        start_record(record, cmd, sub, '-');
+        switch (sub) {
+          case 'c': case 'e': break;
+          case 'u': add_arg(record, convert_atoi_substr(&ptr)); break;
+          case 't': add_values(record, &ptr, 2 * MAX_GAP_TABLE_ENTRIES); break;
+          default : return 0;
+        }
+      }
+      return 1;
+
+    case CMD_FLOW:
+      {
+        unsigned char sub = get_next_char(&ptr);
+        switch (sub) {
+          case 'c': start_record(record, cmd, sub, '-'); return 1;
+          case 'p': start_record(record, cmd, sub, '-'); *staged = 0; return 1;
+          case 'a': return encode_flow(record, ptr);
+          default : return 0;
+        }
+      }
+
+    case CMD_SCENARIO:
+      {
+        // A phase of a scenario, the rest (r)un, (l)oop or (s)top it
+        unsigned char sub = get_next_char(&ptr);
+        start_record(record, cmd, sub, '-');
+        if (sub == 'p')
+          add_arg(record, convert_atoi_substr(&ptr));
+        else
+          *staged = 0;
+      }
+      return 1;
+
+    case CMD_SHAPER:
+      {
+        unsigned char sub = get_next_char(&ptr);
+        unsigned char type = get_next_char(&ptr);
+        start_record(record, cmd, sub, type);
+        if (sub == 'c') {
+          add_arg(record, get_next_char(&ptr));
+        } else {
+          add_arg(record, convert_hex_substr(&ptr));
+          *staged = 0;
+        }
+      }
+      return 1;
+
+    default:
+      break;
+  }
+
+  // The rest take effect as soon as the device receives them
+  *staged = 0;
+  switch (cmd) {
+    case CMD_SET_GENERATOR_MODE:
+      {
+        unsigned char sub = get_next_char(&ptr);
+        start_record(record, cmd, sub, '-');
+        if ((sub == 'b') || (sub == 'p')) {
+          add_arg(record, convert_atoi_substr(&ptr));
+          add_arg(record, convert_atoi_substr(&ptr));
+        }
+      }
+      return 1;
+
+    case CMD_LATENCY:
+      {
+        unsigned char sub = get_next_char(&ptr);
+        start_record(record, cmd, sub, '-');
+        if (sub == 'c')
+          add_arg(record, convert_atoi_substr(&ptr));
+      }
+      return 1;
+
+    case CMD_PCAP:
+      {
+        // The (s)tart of a capture stream with the id the host gave it
+        unsigned char sub = get_next_char(&ptr);
+        if (sub != 's')
+          return 0;
+        start_record(record, cmd, sub, '-');
+        add_arg(record, convert_atoi_substr(&ptr));
+      }
+      return 1;
+
+    case CMD_REFLECT:
+      start_record(record, cmd, (get_next_char(&ptr) == 'e') ? 'e' : 'd', '-');
+      return 1;
+
+    case CMD_STATS_INTERVAL:
+    case CMD_CATCHUP_LIMIT:
+      start_record(record, cmd, '-', '-');
+      add_arg(record, convert_atoi_substr(&ptr));
+      return 1;
+
+    case CMD_PRINT_PKT_CONFIGURATION:
+    case CMD_APPLY_CFG:
+    case CMD_SWAP_CFG:
+      start_record(record, cmd, '-', '-');
+      return 1;
+
+    default:
+      return 0;
+  }
+}
+
+static uint32_t header_word(protocol_message_t message)
+{
+  protocol_header_t header = { PROTOCOL_MAGIC, PROTOCOL_VERSION, message, 0 };
+  uint32_t word;
+  memcpy(&word, &header, sizeof(word));
+  return word;
+}
+
+static int add_record(command_batch_t *batch, const encoded_record_t *record)
+{
+  unsigned words = 1 + record->header.args;
+
+  if (batch->length + words > PROTOCOL_UPLOAD_WORDS) {
+    printf("Too many changes to send at once, at most %d words\n", PROTOCOL_UPLOAD_WORDS);
+    return 0;
+  }
+  memcpy(&batch->words[batch->length], record, words * sizeof(uint32_t));
+  batch->length += words;
+  batch->records++;
+  return 1;
+}
+
+void command_batch_clear(command_batch_t *batch)
+{
+  batch->length = 0;
+  batch->records = 0;
+}
+
+int command_stage(command_batch_t *batch, const unsigned char *command)
+{
+  encoded_record_t record;
+  int staged = 0;
+
+  if (!encode_command(command, &record, &staged)) {
+    printf("Unable to encode the command '%s' for the device\n", command);
+    return 0;
+  }
+  return add_record(batch, &record);
+}
+
+void command_upload(command_batch_t *batch, unsigned char target, protocol_send_t send, void *context)
+{
+  uint32_t message[PROTOCOL_MAX_MESSAGE_WORDS];
+  protocol_commit_t commit = { batch->length, batch->records, 0, target };
+
+  // As many data messages as it takes, then the commit
+  for (unsigned offset = 0; offset < batch->length; ) {
+    unsigned count = batch->length - offset;
+    if (count > PROTOCOL_MAX_MESSAGE_WORDS - 2)
+      count = PROTOCOL_MAX_MESSAGE_WORDS - 2;
+
+    message[0] = header_word(MSG_UPLOAD_DATA);
+    message[1] = offset;
+    memcpy(&message[2], &batch->words[offset], count * sizeof(uint32_t));
+    send(context, message, (2 + count) * sizeof(uint32_t));
+    offset += count;
+  }
+
+  for (unsigned i = 0; i < batch->length; i++)
+    commit.checksum = protocol_checksum(commit.checksum, batch->words[i]);
+
+  message[0] = header_word(MSG_UPLOAD_COMMIT);
+  memcpy(&message[1], &commit, sizeof(commit));
+  send(context, message, sizeof(uint32_t) + sizeof(commit));
+  command_batch_clear(batch);
+}
+
+void pcap_send_block(unsigned block, const uint32_t words[], unsigned length, unsigned frames, int last,
+    protocol_send_t send, void *context)
+{
+  uint32_t message[PROTOCOL_MAX_MESSAGE_WORDS];
+  protocol_pcap_commit_t commit = { block, length, frames, 0, last };
+
+  for (unsigned offset = 0; offset < length; ) {
+    unsigned count = length - offset;
+    if (count > PROTOCOL_MAX_MESSAGE_WORDS - 3)
+      count = PROTOCOL_MAX_MESSAGE_WORDS - 3;
+
+    message[0] = header_word(MSG_PCAP_DATA);
+    message[1] = block;
+    message[2] = offset;
+    memcpy(&message[3], &words[offset], count * sizeof(uint32_t));
+    send(context, message, (3 + count) * sizeof(uint32_t));
+    offset += count;
+  }
+
+  for (unsigned i = 0; i < length; i++)
+    commit.checksum = protocol_checksum(commit.checksum, words[i]);
+
+  message[0] = header_word(MSG_PCAP_COMMIT);
+  memcpy(&message[1], &commit, sizeof(commit));
+  send(context, message, sizeof(uint32_t) + sizeof(commit));
+}
+
+int command_send(command_batch_t *batch, const unsigned char *command, protocol_send_t send, void *context)
+{
+  encoded_record_t record;
+  int staged = 0;
+
+  if (!encode_command(command, &record, &staged)) {
+    printf("Unable to encode the command '%s' for the device\n", command);
+    return 0;
+  }
+
+  if (staged) {
+    if (!add_record(batch, &record)) {
+      printf("Use '%c' or '%c' to send the changes made so far\n", CMD_APPLY_CFG, CMD_SWAP_CFG);
+      return 0;
+    }
+    return 1;
+  }
+
+  if (((command[0] == CMD_APPLY_CFG) || (command[0] == CMD_SWAP_CFG)) && batch->records) {
+    command_upload(batch, command[0], send, context);
+    return 1;
+  }
+
+  uint32_t message[1 + 1 + PROTOCOL_MAX_ARGS];
+  message[0] = header_word(MSG_COMMANDS);
+  memcpy(&message[1], &record, (1 + record.header.args) * sizeof(uint32_t));
+  send(context, message, (2 + record.header.args) * sizeof(uint32_t));
+  return 1;
+}
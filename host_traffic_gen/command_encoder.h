@@ -0,0 +1,52 @@
+#ifndef __COMMAND_ENCODER_H__
+#define __COMMAND_ENCODER_H__
+
+#include <stdint.h>
+#include "host_protocol.h"
+
+/*
+ * Turns console commands, in the text form the controller's checks leave them in,
+ * into the binary records of host_protocol.h. Commands that change the next
+ * configuration are held in a batch which is uploaded along with the next 'e' or
+ * 's', the others are sent at once. Also used by the host bench to drive the
+ * device's command handler.
+ */
+typedef struct command_batch_t {
+  uint32_t words[PROTOCOL_UPLOAD_WORDS];
+  unsigned length;
+  unsigned records;
+} command_batch_t;
+
+/* Send one message of at most PROTOCOL_MAX_MESSAGE_BYTES to the device */
+typedef void (*protocol_send_t)(void *context, const uint32_t message[], unsigned bytes);
+
+void command_batch_clear(command_batch_t *batch);
+
+/*
+ * Encode a command and either add it to the batch or send it, with the batch for
+ * 'e' and 's'. Returns 0 with the reason printed if the command cannot be encoded
+ * or there is no room left in the batch.
+ */
+int command_send(command_batch_t *batch, const unsigned char *command, protocol_send_t send, void *context);
+
+/*
+ * Encode any command into the batch, as for a scenario whose records the device
+ * applies itself. Returns 0 with the reason printed if it cannot be encoded or
+ * there is no room left.
+ */
+int command_stage(command_batch_t *batch, const unsigned char *command);
+
+/*
+ * Upload the batch and empty it. The target is CMD_APPLY_CFG or CMD_SWAP_CFG for
+ * changes to the next configuration, or CMD_SCENARIO for a scenario.
+ */
+void command_upload(command_batch_t *batch, unsigned char target, protocol_send_t send, void *context);
+
+/*
+ * Send a block of a capture stream as data messages and a commit, as
+ * command_upload(). Blocks are numbered from zero in each stream.
+ */
+void pcap_send_block(unsigned block, const uint32_t words[], unsigned length, unsigned frames, int last,
+    protocol_send_t send, void *context);
+
+#endif // __COMMAND_ENCODER_H__
@@ -0,0 +1,168 @@
+/*
+ * Reading of capture files into the blocks the device plays, see pcap_stream.h.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "pcap_stream.h"
+
+#define PCAP_MAGIC_MICROSECONDS 0xa1b2c3d4
+#define PCAP_MAGIC_NANOSECONDS  0xa1b23c4d
+#define PCAP_MAGIC_PCAPNG       0x0a0d0d0a
+#define PCAP_LINKTYPE_ETHERNET  1
+
+#define PCAP_FILE_HEADER_BYTES   24
+#define PCAP_RECORD_HEADER_BYTES 16
+
+// Larger than any capture tool writes, so the file is taken to be corrupt
+#define PCAP_MAX_RECORD_BYTES 0x40000
+
+// The device's timer ticks every 10ns
+#define NS_PER_TICK 10
+#define MAX_PERIOD_TICKS 0x7fffffff
+
+static uint32_t swap32(uint32_t value)
+{
+  return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+
+static uint32_t get_word(const pcap_reader_t *reader, const unsigned char *bytes)
+{
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return reader->swapped ? swap32(value) : value;
+}
+
+/* Read ahead to the next frame that can be sent, skipping those too long */
+static void read_frame(pcap_reader_t *reader)
+{
+  unsigned char header[PCAP_RECORD_HEADER_BYTES];
+
+  reader->have_frame = 0;
+  while (fread(header, 1, sizeof(header), reader->fp) == sizeof(header)) {
+    uint32_t seconds = get_word(reader, &header[0]);
+    uint32_t fraction = get_word(reader, &header[4]);
+    uint32_t captured = get_word(reader, &header[8]);
+
+    if (captured > PCAP_MAX_RECORD_BYTES) {
+      printf("Capture corrupt after %u frames\n", reader->frames);
+      return;
+    }
+
+    if (captured > PCAP_MAX_FRAME_BYTES) {
+      if (fseek(reader->fp, captured, SEEK_CUR))
+        return;
+      reader->skipped++;
+      continue;
+    }
+
+    if (fread(reader->frame, 1, captured, reader->fp) != captured)
+      return;
+
+    // Frames captured before they were padded are sent at the minimum size
+    if (captured < PCAP_MIN_FRAME_BYTES) {
+      memset(&reader->frame[captured], 0, PCAP_MIN_FRAME_BYTES - captured);
+      captured = PCAP_MIN_FRAME_BYTES;
+    }
+
+    reader->length = captured;
+    reader->time_ns = (uint64_t)seconds * 1000000000 + (uint64_t)fraction * (reader->nanoseconds ? 1 : 1000);
+    reader->have_frame = 1;
+    return;
+  }
+}
+
+int pcap_reader_open(pcap_reader_t *reader, FILE *fp, pcap_timing_t timing, double speed)
+{
+  unsigned char header[PCAP_FILE_HEADER_BYTES];
+  uint32_t magic;
+
+  memset(reader, 0, sizeof(*reader));
+  reader->fp = fp;
+  reader->timing = timing;
+  reader->speed = (timing == PCAP_TIMING_SCALED) ? speed : 1.0;
+
+  if (fread(header, 1, sizeof(header), fp) != sizeof(header)) {
+    printf("Capture too short\n");
+    return 0;
+  }
+
+  memcpy(&magic, header, sizeof(magic));
+  if ((magic == PCAP_MAGIC_MICROSECONDS) || (magic == PCAP_MAGIC_NANOSECONDS)) {
+    reader->swapped = 0;
+  } else if ((swap32(magic) == PCAP_MAGIC_MICROSECONDS) || (swap32(magic) == PCAP_MAGIC_NANOSECONDS)) {
+    reader->swapped = 1;
+    magic = swap32(magic);
+  } else if (magic == PCAP_MAGIC_PCAPNG) {
+    printf("Capture is pcapng, save it in pcap format\n");
+    return 0;
+  } else {
+    printf("Not a pcap capture\n");
+    return 0;
+  }
+  reader->nanoseconds = (magic == PCAP_MAGIC_NANOSECONDS);
+
+  if (get_word(reader, &header[20]) != PCAP_LINKTYPE_ETHERNET) {
+    printf("Capture is not of Ethernet frames\n");
+    return 0;
+  }
+
+  if (reader->speed <= 0) {
+    printf("Speed must be more than zero\n");
+    return 0;
+  }
+
+  read_frame(reader);
+  return 1;
+}
+
+void pcap_reader_close(pcap_reader_t *reader)
+{
+  if (reader->fp)
+    fclose(reader->fp);
+  reader->fp = NULL;
+  reader->have_frame = 0;
+}
+
+/* The device's period for the time between two frames */
+static uint32_t period_ticks(const pcap_reader_t *reader, uint64_t from_ns, uint64_t to_ns)
+{
+  if ((reader->timing == PCAP_TIMING_LINE) || (to_ns <= from_ns))
+    return 0;
+
+  double ticks = (double)(to_ns - from_ns) / NS_PER_TICK / reader->speed + 0.5;
+  return (ticks >= MAX_PERIOD_TICKS) ? MAX_PERIOD_TICKS : (uint32_t)ticks;
+}
+
+unsigned pcap_reader_fill(pcap_reader_t *reader, uint32_t words[], unsigned *length)
+{
+  unsigned frames = 0;
+
+  *length = 0;
+  while (reader->have_frame) {
+    unsigned record_words = PCAP_RECORD_WORDS + (reader->length + 3) / 4;
+    if (*length + record_words > PCAP_BLOCK_WORDS)
+      break;
+
+    uint32_t *record = &words[*length];
+    uint64_t time_ns = reader->time_ns;
+
+    record[0] = reader->length;
+    record[record_words - 1] = 0;
+    memcpy(&record[PCAP_RECORD_WORDS], reader->frame, reader->length);
+
+    // The last frame has no period, there is nothing to wait for after it
+    read_frame(reader);
+    record[1] = reader->have_frame ? period_ticks(reader, time_ns, reader->time_ns) : 0;
+
+    *length += record_words;
+    reader->frames++;
+    frames++;
+  }
+  return frames;
+}
+
+int pcap_reader_done(const pcap_reader_t *reader)
+{
+  return !reader->have_frame;
+}
@@ -0,0 +1,58 @@
+#ifndef __PCAP_STREAM_H__
+#define __PCAP_STREAM_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "host_protocol.h"
+
+/*
+ * Reads a capture file (libpcap format, Ethernet frames) and packs its frames into
+ * the blocks the device plays, see pcap_player.h. Each frame is given the period
+ * to the next from the capture's timestamps, those divided by a speed-up, or none
+ * so the device sends the frames back-to-back at line rate. Frames shorter than
+ * the minimum are padded and longer ones skipped. Also used by the host bench.
+ */
+typedef enum {
+  PCAP_TIMING_ORIGINAL,
+  PCAP_TIMING_SCALED,
+  PCAP_TIMING_LINE,
+} pcap_timing_t;
+
+// The blocks the device holds: the host sends the next once fewer than this are waiting to be played
+#define PCAP_BLOCKS_AHEAD 2
+
+// The frames the device sends, without the CRC
+#define PCAP_MIN_FRAME_BYTES 60
+#define PCAP_MAX_FRAME_BYTES 1518
+
+typedef struct pcap_reader_t {
+  FILE *fp;
+  int swapped;
+  int nanoseconds;
+  pcap_timing_t timing;
+  double speed;
+
+  // The next frame is read ahead, as its period needs the time of the one after it
+  int have_frame;
+  unsigned length;
+  uint64_t time_ns;
+  unsigned char frame[PCAP_MAX_FRAME_BYTES];
+
+  unsigned frames;
+  unsigned skipped;
+} pcap_reader_t;
+
+/*
+ * Start reading a capture from an open file, which is closed with the reader.
+ * Returns 0 with the reason printed if it is not a capture of Ethernet frames.
+ */
+int pcap_reader_open(pcap_reader_t *reader, FILE *fp, pcap_timing_t timing, double speed);
+void pcap_reader_close(pcap_reader_t *reader);
+
+/* Pack the next frames into a block. Returns the frames packed, zero once none are left. */
+unsigned pcap_reader_fill(pcap_reader_t *reader, uint32_t words[], unsigned *length);
+
+/* Whether every frame of the capture has been packed */
+int pcap_reader_done(const pcap_reader_t *reader);
+
+#endif // __PCAP_STREAM_H__
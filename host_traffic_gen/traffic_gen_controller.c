@@ -9,6 +9,16 @@
  */
 #include "xscope_host_shared.h"
 #include "traffic_ctlr_host_cmds.h"
+#include "command_encoder.h"
+#include "pcap_stream.h"
+
+// Only the layout of the counters is needed from the device header
+#define TRAFFIC_STATS_HOST
+#include "traffic_stats.h"
+#define LATENCY_HOST
+#include "latency.h"
+#define PCAP_PLAYER_HOST
+#include "pcap_player.h"
 
 /*
  * Includes for thread support
@@ -17,32 +27,263 @@
   #include <winsock.h>
 #else
   #include <pthread.h>
+  #include <unistd.h>
 #endif
 
 #include <ctype.h>
 
 const char *g_prompt = " > ";
 
+/* The device's 100MHz reference timer and the wire overhead of each frame */
+#define STATS_TICKS_PER_SEC 100000000.0
+#define STATS_WIRE_OVERHEAD_BYTES (8 + 4 + 12)
+
+static int g_stats_probe = TRAFFIC_STATS_PROBE;
+static int g_latency_probe = LATENCY_PROBE;
+static int g_pcap_probe = PCAP_STATUS_PROBE;
+static FILE *g_stats_log = NULL;
+
+static traffic_stats_t g_last_stats;
+static int g_have_last_stats = 0;
+static double g_stats_elapsed = 0;
+
+static const char *stats_type_names[TRAFFIC_STATS_TYPES] = { "u", "m", "b" };
+static const char *stats_class_names[TRAFFIC_STATS_CLASSES] = { "be", "b", "a" };
+
+/* Rates on the wire, including preamble, CRC and inter-frame gap */
+static double stats_mbps(unsigned frames, unsigned bytes, double seconds)
+{
+  return ((double)bytes + (double)frames * STATS_WIRE_OVERHEAD_BYTES) * 8 / seconds / 1e6;
+}
+
+/*
+ * Turn the difference between this set of counters and the last into rates,
+ * print them and log them to the CSV file if one was given.
+ */
+static void handle_traffic_stats(const traffic_stats_t *stats)
+{
+  if (g_have_last_stats) {
+    const traffic_stats_t *last = &g_last_stats;
+    double seconds = (unsigned)(stats->time - last->time) / STATS_TICKS_PER_SEC;
+    unsigned frames, bytes;
+
+    if (seconds <= 0)
+      return;
+    g_stats_elapsed += seconds;
+
+    printf("%8.1fs", g_stats_elapsed);
+    if (g_stats_log)
+      fprintf(g_stats_log, "%.3f", g_stats_elapsed);
+
+    for (int i = 0; i < TRAFFIC_STATS_TYPES; i++) {
+      frames = stats->generated_frames[i] - last->generated_frames[i];
+      bytes = stats->generated_bytes[i] - last->generated_bytes[i];
+      printf(" %s %7.2fMb/s %7.0ff/s", stats_type_names[i], stats_mbps(frames, bytes, seconds), frames / seconds);
+      if (g_stats_log)
+        fprintf(g_stats_log, ",%.0f,%.3f", frames / seconds, stats_mbps(frames, bytes, seconds));
+    }
+
+    frames = stats->sent_frames - last->sent_frames;
+    bytes = stats->sent_bytes - last->sent_bytes;
+    printf(" | tx %7.2fMb/s %7.0ff/s", stats_mbps(frames, bytes, seconds), frames / seconds);
+    if (g_stats_log)
+      fprintf(g_stats_log, ",%.0f,%.3f", frames / seconds, stats_mbps(frames, bytes, seconds));
+
+    frames = stats->received_frames - last->received_frames;
+    bytes = stats->received_bytes - last->received_bytes;
+    printf(" | rx %7.2fMb/s %7.0ff/s", stats_mbps(frames, bytes, seconds), frames / seconds);
+    if (g_stats_log)
+      fprintf(g_stats_log, ",%.0f,%.3f", frames / seconds, stats_mbps(frames, bytes, seconds));
+
+    printf(" | late %u starved gen %u tx %u\n", stats->late_frames - last->late_frames,
+        stats->generator_starved, stats->transmitter_starved);
+    if (g_stats_log)
+      fprintf(g_stats_log, ",%u,%u,%u", stats->late_frames - last->late_frames,
+          stats->generator_starved, stats->transmitter_starved);
+
+    // The rate sent from each transmit class, only shown once a shaped class is used
+    unsigned class_frames[TRAFFIC_STATS_CLASSES], class_bytes[TRAFFIC_STATS_CLASSES];
+    int shaped = 0;
+    for (int i = 0; i < TRAFFIC_STATS_CLASSES; i++) {
+      class_frames[i] = stats->class_frames[i] - last->class_frames[i];
+      class_bytes[i] = stats->class_bytes[i] - last->class_bytes[i];
+      if (i != 0 && class_frames[i])
+        shaped = 1;
+    }
+    if (shaped) {
+      printf("%9s", "");
+      for (int i = TRAFFIC_STATS_CLASSES - 1; i >= 0; i--)
+        printf(" %s %7.2fMb/s %7.0ff/s", stats_class_names[i], stats_mbps(class_frames[i], class_bytes[i], seconds),
+            class_frames[i] / seconds);
+      printf("\n");
+    }
+
+    // The receive analysis totals, only shown once frames have been analysed
+    int analysed = 0;
+    for (int i = 0; i < TRAFFIC_STATS_TYPES; i++) {
+      if (stats->rx_frames[i]) {
+        if (!analysed)
+          printf("%9s", "");
+        printf(" %s rx %u lost %u reord %u dup %u err %u", stats_type_names[i], stats->rx_frames[i],
+            stats->rx_lost[i], stats->rx_reordered[i], stats->rx_duplicates[i], stats->rx_pattern_errors[i]);
+        analysed = 1;
+      }
+      if (g_stats_log)
+        fprintf(g_stats_log, ",%u,%u,%u,%u,%u", stats->rx_frames[i], stats->rx_lost[i],
+            stats->rx_reordered[i], stats->rx_duplicates[i], stats->rx_pattern_errors[i]);
+    }
+    if (analysed) {
+      if (stats->rx_restarts)
+        printf(" restarts %u", stats->rx_restarts);
+      printf("\n");
+    }
+
+    if (g_stats_log) {
+      fprintf(g_stats_log, ",%u", stats->rx_restarts);
+      for (int i = 0; i < TRAFFIC_STATS_CLASSES; i++)
+        fprintf(g_stats_log, ",%.0f,%.3f", class_frames[i] / seconds, stats_mbps(class_frames[i], class_bytes[i], seconds));
+      fprintf(g_stats_log, "\n");
+      fflush(g_stats_log);
+    }
+  }
+
+  g_last_stats = *stats;
+  g_have_last_stats = 1;
+}
+
+static void open_stats_log(const char *filename)
+{
+  g_stats_log = fopen(filename, "w");
+  if (!g_stats_log)
+    print_and_exit("ERROR: Unable to open '%s'\n", filename);
+
+  fprintf(g_stats_log, "time_s");
+  for (int i = 0; i < TRAFFIC_STATS_TYPES; i++)
+    fprintf(g_stats_log, ",%s_fps,%s_mbps", stats_type_names[i], stats_type_names[i]);
+  fprintf(g_stats_log, ",tx_fps,tx_mbps,rx_fps,rx_mbps,late_frames,generator_starved,transmitter_starved");
+  for (int i = 0; i < TRAFFIC_STATS_TYPES; i++)
+    fprintf(g_stats_log, ",%s_rx_frames,%s_lost,%s_reordered,%s_duplicates,%s_pattern_errors",
+        stats_type_names[i], stats_type_names[i], stats_type_names[i], stats_type_names[i], stats_type_names[i]);
+  fprintf(g_stats_log, ",rx_restarts");
+  for (int i = 0; i < TRAFFIC_STATS_CLASSES; i++)
+    fprintf(g_stats_log, ",class_%s_fps,class_%s_mbps", stats_class_names[i], stats_class_names[i]);
+  fprintf(g_stats_log, "\n");
+}
+
+/* Latencies are reported in reference timer ticks of 10ns */
+static void handle_latency_report(const latency_report_t *report)
+{
+  const char *name = (report->type < TRAFFIC_STATS_TYPES) ? stats_type_names[report->type] : "?";
+
+  printf("Latency %s: %u frames, min %.2fus mean %.2fus max %.2fus, 50%% %.2fus 99%% %.2fus 99.9%% %.2fus",
+      name, report->frames, report->min / 100.0, report->mean / 100.0, report->max / 100.0,
+      report->p50 / 100.0, report->p99 / 100.0, report->p999 / 100.0);
+  printf(" (%.2fus buckets", report->bucket_ticks / 100.0);
+  if (report->overflows)
+    printf(", %u beyond the last", report->overflows);
+  printf(")\n");
+}
+
+/* The capture stream last started and what the device last said of it */
+static volatile unsigned g_pcap_stream = 0;
+static pcap_status_t g_pcap_status;
+static pcap_reader_t g_pcap_reader;
+
+static void handle_pcap_status(const pcap_status_t *status)
+{
+  // Anything still to come from an earlier stream is of no interest
+  if (status->stream != g_pcap_stream)
+    return;
+
+  if (status->underruns > g_pcap_status.underruns)
+    printf("Capture underrun: the device ran out of blocks, %u times so far\n", status->underruns);
+  if (status->errors > g_pcap_status.errors)
+    printf("Capture: the device dropped %u blocks, stopping\n", status->errors);
+  if (status->finished && !g_pcap_status.finished)
+    printf("Capture played: %u frames, %u skipped as too long, %u underruns\n",
+        status->frames, g_pcap_reader.skipped, status->underruns);
+  g_pcap_status = *status;
+}
+
 void hook_registration_received(int sockfd, int xscope_probe, char *name)
 {
-  // Ignore
+  if (!strcmp(name, TRAFFIC_STATS_PROBE_NAME))
+    g_stats_probe = xscope_probe;
+  else if (!strcmp(name, LATENCY_PROBE_NAME))
+    g_latency_probe = xscope_probe;
+  else if (!strcmp(name, PCAP_STATUS_PROBE_NAME))
+    g_pcap_probe = xscope_probe;
 }
 
 void hook_data_received(int sockfd, int xscope_probe, void *data, int data_len)
 {
-  // Ignore
+  if ((xscope_probe == g_stats_probe) && (data_len == sizeof(traffic_stats_t)))
+    handle_traffic_stats((const traffic_stats_t *)data);
+  else if ((xscope_probe == g_latency_probe) && (data_len == sizeof(latency_report_t)))
+    handle_latency_report((const latency_report_t *)data);
+  else if ((xscope_probe == g_pcap_probe) && (data_len == sizeof(pcap_status_t)))
+    handle_pcap_status((const pcap_status_t *)data);
 }
 
 void hook_exiting()
 {
-  // Ignore
+  if (g_stats_log)
+    fclose(g_stats_log);
+}
+
+/* Changes to the next configuration waiting for the next 'e' or 's' */
+static command_batch_t g_batch;
+
+/* Messages are sent from the console and from the thread streaming a capture */
+#ifdef _WIN32
+static CRITICAL_SECTION g_send_lock;
+#else
+static pthread_mutex_t g_send_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void send_message(void *context, const uint32_t message[], unsigned bytes)
+{
+#ifdef _WIN32
+  EnterCriticalSection(&g_send_lock);
+  xscope_ep_request_upload(*(int *)context, bytes, (const unsigned char *)message);
+  LeaveCriticalSection(&g_send_lock);
+#else
+  pthread_mutex_lock(&g_send_lock);
+  xscope_ep_request_upload(*(int *)context, bytes, (const unsigned char *)message);
+  pthread_mutex_unlock(&g_send_lock);
+#endif
+}
+
+/* Send a checked command, in the text form the device used to take, as binary records */
+static int send_command(int sockfd, const unsigned char *command)
+{
+  return command_send(&g_batch, command, send_message, &sockfd);
 }
 
+/* The most entries the device accepts in a table of VLAN tags */
+#define MAX_TAG_ENTRIES 16
+
+/* The most of the line rate either shaped class may reserve, as in IEEE 802.1Qav */
+#define MAX_RESERVED_PERCENT 75
+#define SHAPER_SLOPE_ONE 0x10000
+
 static void print_pkt_ctrl_usage()
 {
   printf("  %c <type> <wt> <min> <max> : tell traffic generator to apply specified\n", CMD_PKT_CONTROL);
   printf("               weight (wt) and packet sizes (min/max in the range 60->1518)\n");
-  printf("               for a (u)nicast, (m)ulticast or a (b)roadcast packet type (type)\n");
+  printf("               for a (u)nicast, (m)ulticast or a (b)roadcast packet type (type).\n");
+  printf("               This replaces any table of sizes set with '%c'\n", CMD_SIZE_TABLE);
+  printf("  %c <type> <wt> <min> <max> <payload> : as above and also set the payload to an\n", CMD_PKT_CONTROL);
+  printf("               (i)ncrementing count, (p)rbs31, (c)onstant <hex value> or (r)andom data\n");
+}
+
+static void print_size_table_usage()
+{
+  printf("  %c <type> <profile> : set the frame sizes of (u)nicast, (m)ulticast or (b)roadcast\n", CMD_SIZE_TABLE);
+  printf("               packets (type) from a profile, one of: imix (64/570/1518 in 7:4:1),\n");
+  printf("               bimodal [<small> <large> <percent small>] (default 64 1518 50),\n");
+  printf("               file <name> (lines of <size> <cumulative>), <size> <weight> pairs,\n");
+  printf("               or uniform to return to the min/max sizes set with '%c'\n", CMD_PKT_CONTROL);
 }
 
 static void print_vlan_tag_usage()
@@ -50,6 +291,11 @@ static void print_vlan_tag_usage()
   printf("  %c <type> <e|d> <vlan> <prio> : configure VLAN tagging for\n", CMD_VLAN_TAG);
   printf("               (u)nicast, (m)ulticast or a (b)roadcast packets (type). Either\n");
   printf("               (e)nable VLAN tagging with specified (vlan) / (prio), or (d)isable it\n");
+  printf("  %c <type> q <svlan> <sprio> <vlan> <prio> : double tag (QinQ) with a service tag\n", CMD_VLAN_TAG);
+  printf("  %c <type> c <vlan_min> <vlan_max> <prio_min> <prio_max> : change the VLAN tag for\n", CMD_VLAN_TAG);
+  printf("               every frame, cycling through the VLAN IDs at each priority in turn\n");
+  printf("  %c <type> t <vlan> <prio> <weight> ... : choose the VLAN tag of every frame from a\n", CMD_VLAN_TAG);
+  printf("               weighted table of up to %d tags\n", MAX_TAG_ENTRIES);
 }
 
 static void print_set_mac_usage()
@@ -57,16 +303,110 @@ static void print_set_mac_usage()
   printf("  %c <u|m> a:b:c:d:e:f       : set the destination MAC address for (u)nicast/(m)ulticast traffic\n", CMD_SET_MAC_ADDRESS);
 }
 
+static void print_mac_sweep_usage()
+{
+  printf("  %c <type> <d|s> <o|s|r> : sweep the (d)estination or (s)ource address of (u)nicast,\n", CMD_MAC_SWEEP);
+  printf("               (m)ulticast or (b)roadcast packets (type) by changing its low 32 bits for\n");
+  printf("               every frame: (o)ff, (s)tep <count> [stride] through count addresses from the\n");
+  printf("               one set, or (r)andom <hex mask> for new random values of the masked bits\n");
+}
+
+static void print_flow_usage()
+{
+  printf("  %c a <type> <dst> <src|-> <vlan|-> <prio> <ethertype|-> <min> <max> <weight>\n", CMD_FLOW);
+  printf("            : add a flow to (u)nicast, (m)ulticast or (b)roadcast packets (type), which\n");
+  printf("              then send each frame on one of their flows chosen by weight. A '-' uses\n");
+  printf("              the board's address, no VLAN tag or the type's ethertype (hex), and sizes\n");
+  printf("              of 0 0 the type's frame sizes. Flows are used from the next '%c' or '%c'\n",
+      CMD_APPLY_CFG, CMD_SWAP_CFG);
+  printf("  %c file <name> : replace the flows with those in a file, one per line as above\n", CMD_FLOW);
+  printf("  %c <c|p>   : (c)lear or (p)rint the flows\n", CMD_FLOW);
+}
+
+static void print_scenario_usage()
+{
+  printf("  %c file <name> : send a scenario of timed phases which the device steps through\n", CMD_SCENARIO);
+  printf("               itself. Each phase starts with a line 'phase <seconds>', followed by\n");
+  printf("               the '%c', '%c', '%c', '%c', '%c', '%c', '%c %c' and '%c' commands to\n",
+      CMD_PKT_CONTROL, CMD_VLAN_TAG, CMD_SET_MAC_ADDRESS, CMD_MAC_SWEEP, CMD_LINE_RATE,
+      CMD_GAP_DISTRIBUTION, CMD_SHAPER, 'c', CMD_SET_GENERATOR_MODE);
+  printf("               apply at its start, which the phases after it build on\n");
+  printf("  %c <r|l|s> : (r)un the scenario once, in a (l)oop, or (s)top it\n", CMD_SCENARIO);
+}
+
+static void print_shaper_usage()
+{
+  printf("  %c c <type> <a|b|e> : send (u)nicast, (m)ulticast or (b)roadcast packets (type) from\n", CMD_SHAPER);
+  printf("               transmit class (a), (b) or (e) best effort. Classes are sent in strict\n");
+  printf("               priority, A first, and each keeps the rate of its own packet types\n");
+  printf("  %c s <a|b> <rate> : reserve a rate for class A or B (a percentage of the line rate or\n", CMD_SHAPER);
+  printf("               bps, kbps or mbps, up to %d%%) which credit-based shaping keeps it within,\n",
+      MAX_RESERVED_PERCENT);
+  printf("               or 0 to leave the class unshaped\n");
+}
+
+static void print_gap_usage()
+{
+  printf("  %c <c|e|u|t> : set the distribution of the gaps between frames, which keep\n", CMD_GAP_DISTRIBUTION);
+  printf("               the configured rate on average: (c)onstant, (e)xponential (Poisson\n");
+  printf("               arrivals), (u)niform <percent> either side of the mean, or a (t)able of\n");
+  printf("               <percent of mean gap> <weight> pairs\n");
+}
+
+static void print_latency_usage()
+{
+  printf("  %c <r|c> [ns] : (r)eport the latency of received frames from when they were sent,\n", CMD_LATENCY);
+  printf("               or (c)lear it, optionally with histogram buckets of about [ns] wide\n");
+  printf("  %c <e|d>   : (e)nable or (d)isable sending received frames back out, so the\n", CMD_REFLECT);
+  printf("              board that sent them can measure the round trip latency\n");
+}
+
+static void print_line_rate_usage()
+{
+  printf("  %c [type] <rate> : set the rate for traffic generation, either of the whole\n", CMD_LINE_RATE);
+  printf("               configuration or of (u)nicast, (m)ulticast or (b)roadcast packets\n");
+  printf("               (type). The rate is a percentage of the 100Mb/s line rate (e.g. 99.995\n");
+  printf("               or 50%%), or has units of bps, kbps, mbps or fps (frames/s). Use 'l' as\n");
+  printf("               the rate of a packet type to return it to the line rate\n");
+}
+
+static void print_pcap_usage()
+{
+  printf("  %c file <name> [o|x <speed>|l] : play the Ethernet frames of a capture (pcap) file,\n", CMD_PCAP);
+  printf("               streamed to the device as it plays, with the (o)riginal gaps between\n");
+  printf("               frames, those sped up (x) by a factor, or back-to-back at (l)ine rate\n");
+  printf("  %c s       : stop playing the capture, leaving the generator silent\n", CMD_PCAP);
+}
+
 static void print_console_usage()
 {
   printf("Supported commands:\n");
   print_pkt_ctrl_usage();
+  print_size_table_usage();
   print_vlan_tag_usage();
   print_set_mac_usage();
-  printf("  %c <ln_rt> : set the line rate for traffic generation\n", CMD_LINE_RATE);
+  print_mac_sweep_usage();
+  print_flow_usage();
+  print_line_rate_usage();
+  print_shaper_usage();
+  print_gap_usage();
+  print_scenario_usage();
+  print_pcap_usage();
+  printf("  %c <ms>    : show the achieved rates every <ms> milliseconds, 0 to stop\n", CMD_STATS_INTERVAL);
+  print_latency_usage();
+  printf("  %c <us>    : limit how far (in microseconds) transmission can fall behind schedule\n", CMD_CATCHUP_LIMIT);
+  printf("              before the lost time is dropped rather than made up\n");
   printf("  %c <s|r|d> : set the generation mode to one of (s)ilent, (r)andom mode or (d)irected\n", CMD_SET_GENERATOR_MODE);
-  printf("  %c         : apply the next configuration state and then copy current configuration to next\n", CMD_APPLY_CFG);
-  printf("  %c         : swap current configuration with next configuration\n", CMD_SWAP_CFG);
+  printf("  %c b <frames> <us>\n", CMD_SET_GENERATOR_MODE);
+  printf("            : send the directed configuration in bursts of back-to-back frames\n");
+  printf("              separated by a gap (in microseconds)\n");
+  printf("  %c p <frames> [u]\n", CMD_SET_GENERATOR_MODE);
+  printf("            : fill a ring of frames from the directed configuration and send it over and over,\n");
+  printf("              numbering the frames as they are sent or (u)nchanged. The device keeps at most\n");
+  printf("              as many frames as the first generator has buffers.\n");
+  printf("  %c         : swap in the configuration with the changes made to it\n", CMD_APPLY_CFG);
+  printf("  %c         : as 'e', or with no changes go back to the configuration before\n", CMD_SWAP_CFG);
+  printf("              Changes to the next configuration are sent to the device with 'e' or 's'\n");
   printf("  %c         : tell traffic generator to display 'directed' packet generation configuration details.\n", CMD_PRINT_PKT_CONFIGURATION);
   printf("  h|?       : print this help message\n");
   printf("  %c         : quit\n", CMD_QUIT);
@@ -145,55 +485,163 @@ static int validate_pkt_ctrl_setting(const unsigned char *buffer)
     return 0;
   }
 
+  char payload = get_next_char(&ptr);
+  if (payload == 'c') {
+    char *end = NULL;
+    strtoul((const char *)ptr, &end, 16);
+    if ((const unsigned char *)end == ptr) {
+      printf("Invalid constant payload; specify a hex value of up to 32 bits\n");
+      print_pkt_ctrl_usage();
+      return 0;
+    }
+  } else if (payload && (payload != 'i') && (payload != 'p') && (payload != 'r')) {
+    printf("Invalid payload; specify (i)ncrementing, (p)rbs31, (c)onstant <value> or (r)andom\n");
+    print_pkt_ctrl_usage();
+    return 0;
+  }
+
   return 1;
 }
 
-static int validate_vlan_tag_settings(const unsigned char *buffer)
+static int validate_vlan_prio(unsigned int vlan, unsigned int prio)
 {
-  const unsigned char *ptr = &buffer[1]; // Skip command
-  char pkt_type = get_next_char(&ptr);
-  char enable_disable = get_next_char(&ptr);
-  unsigned int vlan = convert_atoi_substr(&ptr);
-  unsigned int prio = convert_atoi_substr(&ptr);
-
-  if ((pkt_type != 'u') && (pkt_type != 'm') && (pkt_type != 'b')) {
-    printf("Invalid packet type; specify either a (u)nicast, (m)ulticast or a (b)roadcast packet type\n");
+  if (vlan & ~0xfff) {
+    printf("Invalid VLAN ID (must be 12-bit)\n");
     print_vlan_tag_usage();
     return 0;
   }
 
-  if ((enable_disable != 'e') && (enable_disable != 'd')) {
-    printf("Please specify 'e' to enable, 'd' to disable VLAN tagging\n");
+  if (prio > 7) {
+    printf("Invalid priority, must be 0-7\n");
     print_vlan_tag_usage();
     return 0;
   }
+  return 1;
+}
 
-  if (vlan & ~0xfff) {
-    printf("Invalid VLAN ID (must be 12-bit)\n");
+static int validate_vlan_tag_settings(const unsigned char *buffer)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char pkt_type = get_next_char(&ptr);
+  char mode = get_next_char(&ptr);
+  int values[3 * MAX_TAG_ENTRIES + 1] = { 0 };
+  int count = 0;
+
+  if ((pkt_type != 'u') && (pkt_type != 'm') && (pkt_type != 'b')) {
+    printf("Invalid packet type; specify either a (u)nicast, (m)ulticast or a (b)roadcast packet type\n");
     print_vlan_tag_usage();
     return 0;
   }
 
-  if (prio > 7) {
-    printf("Invalid priority, must be 0-7\n");
-    print_vlan_tag_usage();
-    return 0;
+  while (count < sizeof(values) / sizeof(values[0])) {
+    const unsigned char *start = ptr;
+    values[count] = convert_atoi_substr(&ptr);
+    if (ptr == start)
+      break;
+    count++;
   }
 
-  return 1;
+  switch (mode) {
+    case 'd':
+      return 1;
+
+    case 'e':
+      return validate_vlan_prio(values[0], values[1]);
+
+    case 'q':
+      if (count != 4) {
+        printf("Specify the service tag <vlan> <prio> and the VLAN tag <vlan> <prio>\n");
+        return 0;
+      }
+      return validate_vlan_prio(values[0], values[1]) && validate_vlan_prio(values[2], values[3]);
+
+    case 'c':
+      if (count != 4) {
+        printf("Specify the <vlan_min> <vlan_max> <prio_min> <prio_max> to cycle through\n");
+        return 0;
+      }
+      if (!validate_vlan_prio(values[0], values[2]) || !validate_vlan_prio(values[1], values[3]))
+        return 0;
+      if ((values[0] > values[1]) || (values[2] > values[3])) {
+        printf("The minimum VLAN ID and priority must not be more than the maximum\n");
+        return 0;
+      }
+      return 1;
+
+    case 't':
+      if ((count == 0) || (count % 3) || (count > 3 * MAX_TAG_ENTRIES)) {
+        printf("Specify up to %d <vlan> <prio> <weight> entries\n", MAX_TAG_ENTRIES);
+        return 0;
+      }
+      for (int i = 0; i < count; i += 3) {
+        if (!validate_vlan_prio(values[i], values[i + 1]))
+          return 0;
+        if (values[i + 2] < 0) {
+          printf("Invalid weight %d; weights must not be negative\n", values[i + 2]);
+          return 0;
+        }
+      }
+      return 1;
+
+    default:
+      printf("Please specify 'e' to enable, 'd' to disable VLAN tagging\n");
+      print_vlan_tag_usage();
+      return 0;
+  }
 }
 
-static int validate_mode(const unsigned char *buffer)
+/* The longest burst and gap between bursts the device accepts */
+#define MAX_BURST_FRAMES 65535
+#define MAX_BURST_GAP_US 10000000
+
+static int validate_mode(unsigned char *buffer)
 {
   const unsigned char *ptr = &buffer[1]; // Skip command
   char mode = get_next_char(&ptr);
 
-  if ((mode != 's') && (mode != 'r') && (mode != 'd')) {
-    printf("Invalid mode; specify any of (s)ilent, (r)andom mode or (d)irected mode\n");
+  if ((mode != 's') && (mode != 'r') && (mode != 'd') && (mode != 'b') && (mode != 'p')) {
+    printf("Invalid mode; specify any of (s)ilent, (r)andom mode, (d)irected, (b)urst or re(p)lay mode\n");
     return 0;
   }
 
-  return 1;
+  if (mode == 'b') {
+    const unsigned char *start = ptr;
+    int frames = convert_atoi_substr(&ptr);
+    int gap_us = convert_atoi_substr(&ptr);
+
+    if ((ptr == start) || (frames < 1) || (frames > MAX_BURST_FRAMES)) {
+      printf("Invalid burst length; specify between 1 and %d frames\n", MAX_BURST_FRAMES);
+      return 0;
+    }
+    if ((gap_us < 0) || (gap_us > MAX_BURST_GAP_US)) {
+      printf("Invalid burst gap; specify between 0 and %d microseconds\n", MAX_BURST_GAP_US);
+      return 0;
+    }
+
+    // The device works in 100MHz reference timer ticks
+    sprintf((char*)&buffer[1], " b %d %d", frames, gap_us * 100);
+  } else if (mode == 'p') {
+    const unsigned char *start = ptr;
+    int frames = convert_atoi_substr(&ptr);
+    char unchanged = get_next_char(&ptr);
+
+    if ((ptr == start) || (frames < 1)) {
+      printf("Invalid replay length; specify at least 1 frame\n");
+      return 0;
+    }
+    if (unchanged && (unchanged != 'u')) {
+      printf("Invalid replay option; specify (u)nchanged or nothing\n");
+      return 0;
+    }
+
+    // The device numbers the frames as it sends them unless asked not to
+    sprintf((char*)&buffer[1], " p %d %d", frames, !unchanged);
+  } else {
+    sprintf((char*)&buffer[1], " %c", mode);
+  }
+
+  // Returning the length of string + null terminator + command
+  return 2 + strlen((char*)&buffer[1]);
 }
 
 static int validate_set_mac_address(const unsigned char *buffer)
@@ -235,133 +683,1202 @@ static int validate_set_mac_address(const unsigned char *buffer)
   }
 }
 
+/*
+ * The device works in 100MHz reference timer ticks, which at 100Mb/s is one tick
+ * per bit on the wire. Rates are sent as ticks per bit (percentages and bits/s) or
+ * ticks per frame (frames/s) in 32.32 fixed point so the device never has to divide.
+ */
+#define TICKS_PER_SEC 100000000.0
+#define LINE_RATE_BPS 100000000.0
+
+/* Keep the period of a 1518-byte frame (12304 bits on the wire) within 31 bits */
+#define MIN_RATE_BPS 1000.0
+#define MIN_RATE_FPS 1.0
+
 static int validate_line_rate(unsigned char *buffer)
 {
   const unsigned char *ptr = &buffer[1]; // Skip command
-  const unsigned line_rate = convert_atoi_substr(&ptr);
-  const double percent_delay = (100.0f/(double)line_rate) - 1.0f;
-  const unsigned int rate_factor = (int)(percent_delay * 256.0f);
+  char pkt_type = '*';
+  char mode = 'b';
+  double ticks = 0;
+  char *end = NULL;
+
+  while (isspace(*ptr))
+    ptr++;
+
+  // An optional packet type to set the rate for, otherwise it is for all types
+  if (((*ptr == 'u') || (*ptr == 'm') || (*ptr == 'b')) && (isspace(ptr[1]) || !ptr[1])) {
+    pkt_type = *ptr;
+    ptr++;
+    while (isspace(*ptr))
+      ptr++;
 
-  if ((ptr == &buffer[1]) || (line_rate > 100)) {
-    printf("Invalid line_rate: specify a value between 0 and 100\n");
+    if ((*ptr == 'l') && !isalnum(ptr[1])) {
+      sprintf((char*)&buffer[1], " %c l", pkt_type);
+      return 2 + strlen((char*)&buffer[1]);
+    }
+  }
+
+  const double value = strtod((const char *)ptr, &end);
+  if (end == (char *)ptr || value <= 0) {
+    printf("Invalid line_rate: specify a positive value\n");
+    print_line_rate_usage();
     return 0;
   }
-  sprintf((char*)&buffer[1], " %d", rate_factor);
+
+  if (!*end || !strcmp(end, "%")) {
+    if (value > 100 || (value / 100) * LINE_RATE_BPS < MIN_RATE_BPS) {
+      printf("Invalid line_rate: specify a percentage between %g and 100\n", 100 * MIN_RATE_BPS / LINE_RATE_BPS);
+      return 0;
+    }
+    ticks = 100.0 / value;
+  } else {
+    double scale = 0;
+    if (!strcmp(end, "bps"))       scale = 1;
+    else if (!strcmp(end, "kbps")) scale = 1e3;
+    else if (!strcmp(end, "mbps")) scale = 1e6;
+    else if (!strcmp(end, "gbps")) scale = 1e9;
+    else if (!strcmp(end, "fps"))  mode = 'f';
+    else {
+      printf("Invalid line_rate units '%s'\n", end);
+      print_line_rate_usage();
+      return 0;
+    }
+
+    if (mode == 'f') {
+      if (value < MIN_RATE_FPS) {
+        printf("Invalid line_rate: specify at least %g frames/s\n", MIN_RATE_FPS);
+        return 0;
+      }
+      ticks = TICKS_PER_SEC / value;
+    } else {
+      const double bps = value * scale;
+      if (bps > LINE_RATE_BPS || bps < MIN_RATE_BPS) {
+        printf("Invalid line_rate: specify between %g and %g bits/s\n", MIN_RATE_BPS, LINE_RATE_BPS);
+        return 0;
+      }
+      ticks = LINE_RATE_BPS / bps;
+    }
+  }
+
+  const unsigned ticks_hi = (unsigned)ticks;
+  double ticks_lo = (ticks - ticks_hi) * 4294967296.0;
+  if (ticks_lo > 4294967295.0)
+    ticks_lo = 4294967295.0;
+
+  sprintf((char*)&buffer[1], " %c %c %x %x", pkt_type, mode, ticks_hi, (unsigned)ticks_lo);
 
   // Returning the length of string + null terminator + command
   return 2 + strlen((char*)&buffer[1]);
 }
 
-/*
- * A separate thread to handle user commands to control the target.
- */
-#ifdef _WIN32
-DWORD WINAPI console_thread(void *arg)
-#else
-void *console_thread(void *arg)
-#endif
+static int validate_shaper(unsigned char *buffer)
 {
-  int sockfd = *(int *)arg;
-  unsigned char buffer[LINE_LENGTH + 1];
-  do {
-    int i = 0;
-    int j = 0;
-    int c = 0;
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char c = get_next_char(&ptr);
+
+  if (c == 'c') {
+    char pkt_type = get_next_char(&ptr);
+    char tx_class = get_next_char(&ptr);
+    if ((pkt_type != 'u') && (pkt_type != 'm') && (pkt_type != 'b')) {
+      printf("Invalid packet type; specify either a (u)nicast, (m)ulticast or a (b)roadcast packet type\n");
+      return 0;
+    }
+    if ((tx_class != 'a') && (tx_class != 'b') && (tx_class != 'e')) {
+      print_shaper_usage();
+      return 0;
+    }
+    sprintf((char*)&buffer[1], " c %c %c", pkt_type, tx_class);
+    return 2 + strlen((char*)&buffer[1]);
+  }
 
-    printf("%s", g_prompt);
-    for (i = 0; (i < LINE_LENGTH) && ((c = getchar()) != EOF) && (c != '\n'); i++)
-      buffer[i] = tolower(c);
-    buffer[i] = '\0';
+  if (c != 's') {
+    print_shaper_usage();
+    return 0;
+  }
 
-    switch (buffer[0]) {
-      case CMD_SET_GENERATOR_MODE:
-        if (validate_mode(buffer))
-          xscope_ep_request_upload(sockfd, 3, buffer);
-        break;
+  char tx_class = get_next_char(&ptr);
+  if ((tx_class != 'a') && (tx_class != 'b')) {
+    printf("Only classes A and B can be shaped\n");
+    return 0;
+  }
 
-      case CMD_PKT_CONTROL:
-        if (validate_pkt_ctrl_setting(buffer))
-          xscope_ep_request_upload(sockfd, i, buffer);
-        break;
+  char *end = NULL;
+  const double value = strtod((const char *)ptr, &end);
+  double percent = 0;
+  if (end == (char *)ptr || value < 0) {
+    print_shaper_usage();
+    return 0;
+  }
+  if (!*end || !strcmp(end, "%"))
+    percent = value;
+  else if (!strcmp(end, "bps"))
+    percent = 100 * value / LINE_RATE_BPS;
+  else if (!strcmp(end, "kbps"))
+    percent = 100 * value * 1e3 / LINE_RATE_BPS;
+  else if (!strcmp(end, "mbps"))
+    percent = 100 * value * 1e6 / LINE_RATE_BPS;
+  else {
+    printf("Invalid rate units '%s'\n", end);
+    print_shaper_usage();
+    return 0;
+  }
 
-      case CMD_VLAN_TAG:
-        if (validate_vlan_tag_settings(buffer))
-          xscope_ep_request_upload(sockfd, i, buffer);
-        break;
+  if (percent > MAX_RESERVED_PERCENT) {
+    printf("Invalid rate: reserve at most %d%% of the line rate for a class\n", MAX_RESERVED_PERCENT);
+    return 0;
+  }
 
-      case CMD_LINE_RATE:
-        i = validate_line_rate(buffer);
-        if (i)
-          xscope_ep_request_upload(sockfd, i, buffer);
-        break;
+  // The device takes the idle slope as a fraction of the line rate in 0.16 fixed point
+  unsigned slope = (unsigned)(percent / 100 * SHAPER_SLOPE_ONE + 0.5);
+  if (percent > 0 && slope == 0)
+    slope = 1;
+  sprintf((char*)&buffer[1], " s %c %x", tx_class, slope);
 
-      case CMD_SET_MAC_ADDRESS:
-          if (validate_set_mac_address(buffer))
-            xscope_ep_request_upload(sockfd, i, buffer);
-        break;
+  // Returning the length of string + null terminator + command
+  return 2 + strlen((char*)&buffer[1]);
+}
 
-      case CMD_PRINT_PKT_CONFIGURATION:
-      case CMD_SWAP_CFG:
-      case CMD_APPLY_CFG:
-        xscope_ep_request_upload(sockfd, 1, buffer);
-        break;
+static int validate_stats_interval(unsigned char *buffer)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  const int interval_ms = convert_atoi_substr(&ptr);
 
-      case CMD_QUIT:
-        print_and_exit("Done\n");
-        break;
+  if ((ptr == &buffer[1]) || (interval_ms < 0) || (interval_ms > TRAFFIC_STATS_MAX_INTERVAL_MS)) {
+    printf("Invalid interval: specify a value between 0 and %d milliseconds\n", TRAFFIC_STATS_MAX_INTERVAL_MS);
+    return 0;
+  }
 
-      case 'h':
-      case '?':
-        print_console_usage();
-        break;
+  // Start the rates afresh as the counters may have moved on a long way
+  g_have_last_stats = 0;
 
-      default:
-        printf("Unrecognised command '%s'\n", buffer);
-        print_console_usage();
-        break;
-    }
-  } while (1);
+  // The device works in 100MHz reference timer ticks
+  sprintf((char*)&buffer[1], " %d", interval_ms * 100000);
 
-#ifdef _WIN32
-  return 0;
-#else
-  return NULL;
-#endif
+  // Returning the length of string + null terminator + command
+  return 2 + strlen((char*)&buffer[1]);
 }
 
-void usage(char *argv[])
+static int validate_latency(unsigned char *buffer)
 {
-  printf("Usage: %s [-s server_ip] [-p port]\n", argv[0]);
-  printf("  -s server_ip :   The IP address of the xscope server (default %s)\n", DEFAULT_SERVER_IP);
-  printf("  -p port      :   The port of the xscope server (default %s)\n", DEFAULT_PORT);
-  exit(1);
-}
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char c = get_next_char(&ptr);
 
-int main(int argc, char *argv[])
-{
-#ifdef _WIN32
-  HANDLE thread;
-#else
-  pthread_t tid;
-#endif
+  if (c == 'r')
+    return 3;
 
-  char *server_ip = DEFAULT_SERVER_IP;
-  char *port_str = DEFAULT_PORT;
-  int err = 0;
-  int sockfds[1] = {0};
-  int c = 0;
+  if (c != 'c') {
+    print_latency_usage();
+    return 0;
+  }
 
-  // Ensure that stdout is not buffered for the auto-test framework
-  setvbuf(stdout, NULL, _IOLBF, 0);
+  // The device's buckets are a power of two reference timer ticks wide
+  int bucket_ns = convert_atoi_substr(&ptr);
+  unsigned shift = LATENCY_DEFAULT_SHIFT;
+  if (bucket_ns > 0) {
+    shift = 0;
+    while ((shift < LATENCY_MAX_SHIFT) && ((10u << shift) < (unsigned)bucket_ns))
+      shift++;
+  }
+  printf("Latency buckets of %dns cover up to %.0fus\n", 10 << shift, (LATENCY_BUCKETS * 10.0 * (1 << shift)) / 1000);
 
-  while ((c = getopt(argc, argv, "s:p:")) != -1) {
-    switch (c) {
-      case 's':
-        server_ip = optarg;
-        break;
-      case 'p':
-        port_str = optarg;
-        break;
+  sprintf((char*)&buffer[1], " c %d", shift);
+
+  // Returning the length of string + null terminator + command
+  return 2 + strlen((char*)&buffer[1]);
+}
+
+static int validate_reflect(const unsigned char *buffer)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char c = get_next_char(&ptr);
+
+  if ((c != 'e') && (c != 'd')) {
+    print_latency_usage();
+    return 0;
+  }
+  return 1;
+}
+
+static int validate_mac_sweep(unsigned char *buffer)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char pkt_type = get_next_char(&ptr);
+  char address = get_next_char(&ptr);
+  char mode = get_next_char(&ptr);
+  char sweep[LINE_LENGTH];
+
+  if ((pkt_type != 'u') && (pkt_type != 'm') && (pkt_type != 'b')) {
+    printf("Invalid packet type; specify either a (u)nicast, (m)ulticast or a (b)roadcast packet type\n");
+    return 0;
+  }
+  if ((address != 'd') && (address != 's')) {
+    print_mac_sweep_usage();
+    return 0;
+  }
+  if ((pkt_type == 'b') && (address == 'd') && (mode != 'o')) {
+    printf("Broadcast frames must keep the broadcast destination address\n");
+    return 0;
+  }
+
+  switch (mode) {
+    case 'o':
+      sprintf(sweep, " o");
+      break;
+
+    case 's': {
+      unsigned long count = 0, stride = 1;
+      int n = sscanf((const char*)ptr, "%lu %lu", &count, &stride);
+      if ((n < 1) || (count < 1) || (count > 0xffffffffUL) || (stride < 1) || (stride > 0xffffffffUL)) {
+        printf("Invalid step sweep; specify a count of addresses and optionally a stride of at least 1\n");
+        return 0;
+      }
+      sprintf(sweep, " s %lx %lx", count, stride);
+      break;
+    }
+
+    case 'r': {
+      unsigned long mask = 0;
+      if ((sscanf((const char*)ptr, "%lx", &mask) != 1) || (mask == 0) || (mask > 0xffffffffUL)) {
+        printf("Invalid random sweep; specify a hex mask of the low 32 bits of the address to change\n");
+        return 0;
+      }
+      sprintf(sweep, " r %lx", mask);
+      break;
+    }
+
+    default:
+      print_mac_sweep_usage();
+      return 0;
+  }
+
+  sprintf((char*)&buffer[1], " %c %c%s", pkt_type, address, sweep);
+
+  // Returning the length of string + null terminator + command
+  return 2 + strlen((char*)&buffer[1]);
+}
+
+static int validate_catchup_limit(unsigned char *buffer)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  const int limit_us = convert_atoi_substr(&ptr);
+
+  // The device works in 100MHz reference timer ticks
+  if ((ptr == &buffer[1]) || (limit_us < 0) || (limit_us > 1000000)) {
+    printf("Invalid catch-up limit: specify a value between 0 and 1000000 microseconds\n");
+    return 0;
+  }
+  sprintf((char*)&buffer[1], " %d", limit_us * 100);
+
+  // Returning the length of string + null terminator + command
+  return 2 + strlen((char*)&buffer[1]);
+}
+
+/* Keep within the device's table size and the 256 bytes it reads per command */
+#define MAX_GAP_TABLE_ENTRIES 16
+#define MAX_GAP_PERCENT 10000
+#define MAX_COMMAND_BYTES 256
+
+static int validate_gap_distribution(unsigned char *buffer)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char dist = get_next_char(&ptr);
+  char gaps[LINE_LENGTH];
+  int len = 0;
+
+  switch (dist) {
+    case 'c':
+    case 'e':
+      len = sprintf(gaps, " %c", dist);
+      break;
+
+    case 'u': {
+      const unsigned char *start = ptr;
+      int jitter = convert_atoi_substr(&ptr);
+      if ((ptr == start) || (jitter < 0) || (jitter > 100)) {
+        printf("Invalid jitter: specify a value between 0 and 100 percent\n");
+        return 0;
+      }
+      len = sprintf(gaps, " u %d", jitter);
+      break;
+    }
+
+    case 't': {
+      int count = 0;
+      len = sprintf(gaps, " t");
+      while (1) {
+        const unsigned char *start = ptr;
+        int percent = convert_atoi_substr(&ptr);
+        if (ptr == start)
+          break;
+        int weight = convert_atoi_substr(&ptr);
+        if ((percent < 0) || (percent > MAX_GAP_PERCENT) || (weight < 0)) {
+          printf("Invalid gap table entry: percentages are 0-%d and weights must not be negative\n",
+              MAX_GAP_PERCENT);
+          return 0;
+        }
+        if (++count > MAX_GAP_TABLE_ENTRIES) {
+          printf("Too many gap table entries, at most %d are supported\n", MAX_GAP_TABLE_ENTRIES);
+          return 0;
+        }
+        len += sprintf(&gaps[len], " %d %d", percent, weight);
+      }
+      if (count == 0) {
+        printf("Specify the gap table as pairs of <percent of mean gap> <weight>\n");
+        return 0;
+      }
+      break;
+    }
+
+    default:
+      printf("Invalid gap distribution; specify (c)onstant, (e)xponential, (u)niform or (t)able\n");
+      return 0;
+  }
+
+  if (len + 2 > MAX_COMMAND_BYTES) {
+    printf("Gap table is too long to send\n");
+    return 0;
+  }
+  strcpy((char*)&buffer[1], gaps);
+
+  // Returning the length of string + null terminator + command
+  return 2 + len;
+}
+
+/*
+ * Frame size tables are sent to the device a few entries at a time, as all the
+ * entries of a large table do not fit in one command.
+ */
+#define MAX_SIZE_ENTRIES 32
+#define SIZE_ENTRIES_PER_COMMAND 8
+#define MIN_FRAME_BYTES 60
+#define MAX_FRAME_BYTES 1518
+
+/* CDF files are normalised to this total weight */
+#define CDF_TOTAL_WEIGHT 1000000
+
+static void send_size_table(int sockfd, char pkt_type, const int sizes[], const int weights[], int count)
+{
+  unsigned char command[MAX_COMMAND_BYTES];
+  int len = sprintf((char*)command, "%c %c c", CMD_SIZE_TABLE, pkt_type);
+  send_command(sockfd, command);
+
+  for (int i = 0; i < count; i += SIZE_ENTRIES_PER_COMMAND) {
+    len = sprintf((char*)command, "%c %c a", CMD_SIZE_TABLE, pkt_type);
+    for (int j = i; (j < count) && (j < i + SIZE_ENTRIES_PER_COMMAND); j++)
+      len += sprintf((char*)&command[len], " %d %d", sizes[j], weights[j]);
+    send_command(sockfd, command);
+  }
+}
+
+static int validate_size(int size)
+{
+  if ((size < MIN_FRAME_BYTES) || (size > MAX_FRAME_BYTES)) {
+    printf("Invalid frame size %d; specify a value between %d and %d\n", size, MIN_FRAME_BYTES, MAX_FRAME_BYTES);
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * Read a CDF of frame sizes from a file with lines of <size> <cumulative>, where
+ * the cumulative values are in any units (fractions, percentages or counts) and
+ * do not decrease. Lines starting with '#' are ignored. Returns the entry count.
+ */
+static int read_size_cdf(const char *filename, int sizes[], int weights[])
+{
+  FILE *fp = fopen(filename, "r");
+  char line[LINE_LENGTH];
+  double cumulative[MAX_SIZE_ENTRIES];
+  double previous = 0;
+  int count = 0;
+
+  if (!fp) {
+    printf("Unable to open '%s'\n", filename);
+    return 0;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    int size = 0;
+    double value = 0;
+    char *ptr = line;
+    while (isspace(*ptr))
+      ptr++;
+    if ((*ptr == '#') || (*ptr == '\0'))
+      continue;
+
+    if (sscanf(ptr, "%d %lf", &size, &value) != 2) {
+      printf("Unable to parse '%s' in '%s'; expected <size> <cumulative>\n", ptr, filename);
+      count = 0;
+      break;
+    }
+    if (!validate_size(size)) {
+      count = 0;
+      break;
+    }
+    if (value < previous) {
+      printf("The CDF in '%s' decreases at size %d\n", filename, size);
+      count = 0;
+      break;
+    }
+    if (value == previous)
+      continue;
+    if (count == MAX_SIZE_ENTRIES) {
+      printf("The CDF in '%s' has more than %d steps; merge some sizes\n", filename, MAX_SIZE_ENTRIES);
+      count = 0;
+      break;
+    }
+    sizes[count] = size;
+    cumulative[count] = value;
+    previous = value;
+    count++;
+  }
+  fclose(fp);
+
+  previous = 0;
+  for (int i = 0; i < count; i++) {
+    weights[i] = (int)((cumulative[i] - previous) * CDF_TOTAL_WEIGHT / cumulative[count - 1] + 0.5);
+    previous = cumulative[i];
+  }
+  return count;
+}
+
+/*
+ * Handle the frame size table command. The file name is taken from the line as
+ * entered, as the buffer has been converted to lower case.
+ */
+static void handle_size_table(int sockfd, const unsigned char *buffer, const unsigned char *line)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char pkt_type = get_next_char(&ptr);
+  int sizes[MAX_SIZE_ENTRIES];
+  int weights[MAX_SIZE_ENTRIES];
+  char profile[LINE_LENGTH];
+  int count = 0;
+
+  if ((pkt_type != 'u') && (pkt_type != 'm') && (pkt_type != 'b')) {
+    printf("Invalid packet type; specify either a (u)nicast, (m)ulticast or a (b)roadcast packet type\n");
+    print_size_table_usage();
+    return;
+  }
+
+  while (isspace(*ptr))
+    ptr++;
+  if (sscanf((const char*)ptr, "%s", profile) != 1) {
+    print_size_table_usage();
+    return;
+  }
+
+  if (!strcmp(profile, "uniform")) {
+    count = 0;
+
+  } else if (!strcmp(profile, "imix")) {
+    const int imix_sizes[] = { 64, 570, 1518 };
+    const int imix_weights[] = { 7, 4, 1 };
+    count = 3;
+    memcpy(sizes, imix_sizes, sizeof(imix_sizes));
+    memcpy(weights, imix_weights, sizeof(imix_weights));
+
+  } else if (!strcmp(profile, "bimodal")) {
+    int small = 64, large = 1518, percent_small = 50;
+    sscanf((const char*)ptr + strlen(profile), "%d %d %d", &small, &large, &percent_small);
+    if (!validate_size(small) || !validate_size(large))
+      return;
+    if ((percent_small < 0) || (percent_small > 100)) {
+      printf("Invalid percentage of small frames; specify a value between 0 and 100\n");
+      return;
+    }
+    count = 2;
+    sizes[0] = small;
+    weights[0] = percent_small;
+    sizes[1] = large;
+    weights[1] = 100 - percent_small;
+
+  } else if (!strcmp(profile, "file")) {
+    char filename[LINE_LENGTH];
+    const unsigned char *name = &line[ptr - buffer] + strlen(profile);
+    if (sscanf((const char*)name, "%s", filename) != 1) {
+      printf("Specify the name of the file holding the CDF\n");
+      return;
+    }
+    count = read_size_cdf(filename, sizes, weights);
+    if (!count)
+      return;
+
+  } else {
+    while (1) {
+      const unsigned char *start = ptr;
+      int size = convert_atoi_substr(&ptr);
+      if (ptr == start)
+        break;
+      int weight = convert_atoi_substr(&ptr);
+      if (!validate_size(size))
+        return;
+      if (weight < 0) {
+        printf("Invalid weight %d; weights must not be negative\n", weight);
+        return;
+      }
+      if (count == MAX_SIZE_ENTRIES) {
+        printf("Too many sizes, at most %d are supported\n", MAX_SIZE_ENTRIES);
+        return;
+      }
+      sizes[count] = size;
+      weights[count] = weight;
+      count++;
+    }
+    if (!count) {
+      printf("Unknown profile '%s'\n", profile);
+      print_size_table_usage();
+      return;
+    }
+  }
+
+  send_size_table(sockfd, pkt_type, sizes, weights, count);
+}
+
+/*
+ * Flows are sent to the device one per command. A file of flows replaces the whole
+ * table, so it is checked completely before anything is sent. The device holds at
+ * most MAX_FLOWS of host_protocol.h.
+ */
+#define MIN_ETHERTYPE 0x600
+
+static int parse_flow_mac(const char *text, unsigned char mac[])
+{
+  unsigned int bytes[6];
+  int end = 0;
+
+  if (!strcmp(text, "-")) {
+    memset(mac, 0, 6);
+    return 1;
+  }
+  if ((sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x%n", &bytes[0], &bytes[1], &bytes[2],
+          &bytes[3], &bytes[4], &bytes[5], &end) != 6) || text[end]) {
+    printf("Unable to parse the MAC address '%s'. Should be of the form aa:bb:cc:dd:ee:ff\n", text);
+    return 0;
+  }
+  for (int i = 0; i < 6; i++)
+    mac[i] = bytes[i];
+  return 1;
+}
+
+/*
+ * Convert a flow given as <type> <dst> <src|-> <vlan|-> <prio> <ethertype|-> <min> <max> <weight>
+ * to the command that adds it. Returns the length of the command or 0 if it is not valid.
+ */
+static int parse_flow(const char *text, char *command)
+{
+  char type[LINE_LENGTH], dst[LINE_LENGTH], src[LINE_LENGTH], vlan[LINE_LENGTH], ethertype[LINE_LENGTH];
+  unsigned char dst_mac[6], src_mac[6];
+  int prio = 0, size_min = 0, size_max = 0, weight = 0;
+  int tagged = 0, vlan_id = 0;
+  unsigned ether_type = 0;
+
+  if (sscanf(text, "%s %s %s %s %d %s %d %d %d", type, dst, src, vlan, &prio, ethertype,
+          &size_min, &size_max, &weight) != 9) {
+    printf("Unable to parse the flow '%s'\n", text);
+    return 0;
+  }
+
+  if (strlen(type) != 1 || ((type[0] != 'u') && (type[0] != 'm') && (type[0] != 'b'))) {
+    printf("Invalid packet type; specify either a (u)nicast, (m)ulticast or a (b)roadcast packet type\n");
+    return 0;
+  }
+
+  if (!strcmp(dst, "-")) {
+    printf("A flow needs a destination MAC address\n");
+    return 0;
+  }
+  if (!parse_flow_mac(dst, dst_mac) || !parse_flow_mac(src, src_mac))
+    return 0;
+
+  if (strcmp(vlan, "-")) {
+    tagged = 1;
+    vlan_id = atoi(vlan);
+    if ((vlan_id < 0) || (vlan_id > 4095)) {
+      printf("Invalid VLAN %d; specify a value between 0 and 4095\n", vlan_id);
+      return 0;
+    }
+  }
+  if ((prio < 0) || (prio > 7)) {
+    printf("Invalid priority %d; specify a value between 0 and 7\n", prio);
+    return 0;
+  }
+
+  if (strcmp(ethertype, "-")) {
+    ether_type = strtoul(ethertype, NULL, 16);
+    if ((ether_type < MIN_ETHERTYPE) || (ether_type > 0xffff)) {
+      printf("Invalid ethertype %s; specify a hex value between %x and ffff\n", ethertype, MIN_ETHERTYPE);
+      return 0;
+    }
+  }
+
+  if (size_min || size_max) {
+    if (!validate_size(size_min) || !validate_size(size_max))
+      return 0;
+    if (size_min > size_max) {
+      printf("The minimum frame size %d is larger than the maximum %d\n", size_min, size_max);
+      return 0;
+    }
+  }
+
+  if ((weight < 0) || (weight > 0xffff)) {
+    printf("Invalid weight %d; specify a value between 0 and 65535\n", weight);
+    return 0;
+  }
+
+  return sprintf(command, "%c a %c %02x:%02x:%02x:%02x:%02x:%02x %02x:%02x:%02x:%02x:%02x:%02x %d %d %d %x %d %d %d",
+      CMD_FLOW, type[0], dst_mac[0], dst_mac[1], dst_mac[2], dst_mac[3], dst_mac[4], dst_mac[5],
+      src_mac[0], src_mac[1], src_mac[2], src_mac[3], src_mac[4], src_mac[5],
+      tagged, vlan_id, prio, ether_type, size_min, size_max, weight);
+}
+
+/* Read a file with a flow per line, lines starting with '#' are ignored. Returns the flow count */
+static int read_flows(const char *filename, char commands[][MAX_COMMAND_BYTES])
+{
+  FILE *fp = fopen(filename, "r");
+  char line[LINE_LENGTH];
+  int line_number = 0;
+  int count = 0;
+
+  if (!fp) {
+    printf("Unable to open '%s'\n", filename);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    char *ptr = line;
+    line_number++;
+    while (isspace(*ptr))
+      ptr++;
+    if ((*ptr == '#') || (*ptr == '\0'))
+      continue;
+
+    for (char *p = ptr; *p; p++)
+      *p = tolower(*p);
+
+    if (count == MAX_FLOWS) {
+      printf("'%s' has more than %d flows\n", filename, MAX_FLOWS);
+      count = -1;
+      break;
+    }
+    if (!parse_flow(ptr, commands[count])) {
+      printf("in line %d of '%s'\n", line_number, filename);
+      count = -1;
+      break;
+    }
+    count++;
+  }
+  fclose(fp);
+  return count;
+}
+
+/*
+ * Handle the flow command. The file name is taken from the line as entered, as
+ * the buffer has been converted to lower case.
+ */
+static void handle_flows(int sockfd, const unsigned char *buffer, const unsigned char *line)
+{
+  static char commands[MAX_FLOWS][MAX_COMMAND_BYTES];
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  char word[LINE_LENGTH];
+
+  while (isspace(*ptr))
+    ptr++;
+  if (sscanf((const char*)ptr, "%s", word) != 1) {
+    print_flow_usage();
+    return;
+  }
+
+  if (!strcmp(word, "c") || !strcmp(word, "p")) {
+    sprintf(commands[0], "%c %c", CMD_FLOW, word[0]);
+    send_command(sockfd, (unsigned char *)commands[0]);
+
+  } else if (!strcmp(word, "a")) {
+    if (parse_flow((const char*)ptr + 1, commands[0]))
+      send_command(sockfd, (unsigned char *)commands[0]);
+
+  } else if (!strcmp(word, "file")) {
+    char filename[LINE_LENGTH];
+    const unsigned char *name = &line[ptr - buffer] + strlen(word);
+    if (sscanf((const char*)name, "%s", filename) != 1) {
+      printf("Specify the name of the file holding the flows\n");
+      return;
+    }
+    int count = read_flows(filename, commands);
+    if (count < 0)
+      return;
+
+    unsigned char clear[] = { CMD_FLOW, ' ', 'c', '\0' };
+    send_command(sockfd, clear);
+    for (int i = 0; i < count; i++) {
+      if (!send_command(sockfd, (unsigned char *)commands[i]))
+        return;
+    }
+    printf("Sent %d flows, they are used from the next '%c' or '%c'\n", count, CMD_APPLY_CFG, CMD_SWAP_CFG);
+
+  } else {
+    print_flow_usage();
+  }
+}
+
+/* The longest phase, within the milliseconds the device counts in 32 bits */
+#define MAX_PHASE_SECONDS 86400
+
+/* Check a command of a scenario as if it was typed. Returns 0 if it is not valid */
+static int validate_scenario_command(unsigned char *buffer)
+{
+  const unsigned char *ptr = &buffer[1];
+
+  switch (buffer[0]) {
+    case CMD_SET_GENERATOR_MODE: return validate_mode(buffer);
+    case CMD_PKT_CONTROL:        return validate_pkt_ctrl_setting(buffer);
+    case CMD_VLAN_TAG:           return validate_vlan_tag_settings(buffer);
+    case CMD_SET_MAC_ADDRESS:    return validate_set_mac_address(buffer);
+    case CMD_MAC_SWEEP:          return validate_mac_sweep(buffer);
+    case CMD_LINE_RATE:          return validate_line_rate(buffer);
+    case CMD_GAP_DISTRIBUTION:   return validate_gap_distribution(buffer);
+    case CMD_SHAPER:
+      if (get_next_char(&ptr) == 'c')
+        return validate_shaper(buffer);
+      break;
+    default:
+      break;
+  }
+  printf("'%s' cannot be part of a scenario\n", buffer);
+  return 0;
+}
+
+/* Read a scenario file into the batch. Returns the number of phases, or -1 if it is not valid */
+static int read_scenario(const char *filename, command_batch_t *scenario)
+{
+  FILE *fp = fopen(filename, "r");
+  unsigned char line[LINE_LENGTH + 1];
+  unsigned char command[MAX_COMMAND_BYTES];
+  int line_number = 0;
+  int phases = 0;
+
+  if (!fp) {
+    printf("Unable to open '%s'\n", filename);
+    return -1;
+  }
+
+  while (fgets((char*)line, sizeof(line), fp)) {
+    unsigned char *ptr = line;
+    int valid = 1;
+    line_number++;
+    while (isspace(*ptr))
+      ptr++;
+    if ((*ptr == '#') || (*ptr == '\0'))
+      continue;
+
+    for (unsigned char *p = ptr; *p; p++)
+      *p = (*p == '\n') ? '\0' : tolower(*p);
+
+    if (!strncmp((char*)ptr, "phase", 5)) {
+      char *end = NULL;
+      double seconds = strtod((char*)ptr + 5, &end);
+      if (((unsigned char *)end == ptr + 5) || (seconds < 0.001) || (seconds > MAX_PHASE_SECONDS)) {
+        printf("Invalid phase; specify its duration between 0.001 and %d seconds\n", MAX_PHASE_SECONDS);
+        valid = 0;
+      } else if (phases == SCENARIO_MAX_PHASES) {
+        printf("A scenario has at most %d phases\n", SCENARIO_MAX_PHASES);
+        valid = 0;
+      } else {
+        sprintf((char*)command, "%c p %u", CMD_SCENARIO, (unsigned)(seconds * 1000 + 0.5));
+        valid = command_stage(scenario, command);
+        phases++;
+      }
+    } else if (!phases) {
+      printf("Start the scenario with a phase\n");
+      valid = 0;
+    } else if (strlen((char*)ptr) >= sizeof(command)) {
+      printf("Command too long\n");
+      valid = 0;
+    } else {
+      strcpy((char*)command, (char*)ptr);
+      valid = validate_scenario_command(command) && command_stage(scenario, command);
+    }
+
+    if (!valid) {
+      printf("in line %d of '%s'\n", line_number, filename);
+      phases = -1;
+      break;
+    }
+  }
+  fclose(fp);
+  return phases;
+}
+
+/*
+ * Handle the scenario command. The file name is taken from the line as entered, as
+ * the buffer has been converted to lower case.
+ */
+static void handle_scenario(int sockfd, const unsigned char *buffer, const unsigned char *line)
+{
+  static command_batch_t scenario;
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  unsigned char command[MAX_COMMAND_BYTES];
+  char word[LINE_LENGTH];
+
+  while (isspace(*ptr))
+    ptr++;
+  if (sscanf((const char*)ptr, "%s", word) != 1) {
+    print_scenario_usage();
+    return;
+  }
+
+  if (!strcmp(word, "r") || !strcmp(word, "l") || !strcmp(word, "s")) {
+    sprintf((char*)command, "%c %c", CMD_SCENARIO, word[0]);
+    send_command(sockfd, command);
+
+  } else if (!strcmp(word, "file")) {
+    char filename[LINE_LENGTH];
+    const unsigned char *name = &line[ptr - buffer] + strlen(word);
+    if (sscanf((const char*)name, "%s", filename) != 1) {
+      printf("Specify the name of the file holding the scenario\n");
+      return;
+    }
+    command_batch_clear(&scenario);
+    int phases = read_scenario(filename, &scenario);
+    if (phases < 0)
+      return;
+    if (scenario.length > SCENARIO_WORDS) {
+      printf("A scenario has at most %d words of changes, '%s' has %d\n", SCENARIO_WORDS, filename, scenario.length);
+      return;
+    }
+
+    command_upload(&scenario, CMD_SCENARIO, send_message, &sockfd);
+    printf("Sent a scenario of %d phases, start it with '%c r' or '%c l'\n", phases, CMD_SCENARIO, CMD_SCENARIO);
+
+  } else {
+    print_scenario_usage();
+  }
+}
+
+static volatile int g_pcap_playing = 0;
+static volatile int g_pcap_stop = 0;
+
+#ifdef _WIN32
+static void sleep_ms(unsigned ms) { Sleep(ms); }
+#else
+static void sleep_ms(unsigned ms) { usleep(ms * 1000); }
+#endif
+
+/*
+ * A thread streaming the capture opened by handle_pcap(). Each block is sent once
+ * the device reports that it has room for it, until the last has been sent.
+ */
+#ifdef _WIN32
+DWORD WINAPI pcap_thread(void *arg)
+#else
+void *pcap_thread(void *arg)
+#endif
+{
+  static uint32_t words[PCAP_BLOCK_WORDS];
+  int sockfd = *(int *)arg;
+  unsigned stream = g_pcap_stream;
+  unsigned block = 0;
+  unsigned length = 0;
+  unsigned frames = pcap_reader_fill(&g_pcap_reader, words, &length);
+
+  while (frames && !g_pcap_stop && !g_pcap_status.errors) {
+    if ((g_pcap_status.stream != stream) || (block >= g_pcap_status.blocks_played + PCAP_BLOCKS_AHEAD)) {
+      sleep_ms(1);
+      continue;
+    }
+    int last = pcap_reader_done(&g_pcap_reader);
+    pcap_send_block(block, words, length, frames, last, send_message, &sockfd);
+    block++;
+    if (last)
+      break;
+    frames = pcap_reader_fill(&g_pcap_reader, words, &length);
+  }
+
+  pcap_reader_close(&g_pcap_reader);
+  g_pcap_playing = 0;
+#ifdef _WIN32
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+/*
+ * Handle the capture command. The file name is taken from the line as entered, as
+ * the buffer has been converted to lower case.
+ */
+static void handle_pcap(int *sockfd, const unsigned char *buffer, const unsigned char *line)
+{
+  const unsigned char *ptr = &buffer[1]; // Skip command
+  unsigned char command[MAX_COMMAND_BYTES];
+  char word[LINE_LENGTH];
+  char filename[LINE_LENGTH];
+  char timing[LINE_LENGTH] = "o";
+  double speed = 1.0;
+
+  while (isspace(*ptr))
+    ptr++;
+  if (sscanf((const char*)ptr, "%s", word) != 1) {
+    print_pcap_usage();
+    return;
+  }
+
+  if (!strcmp(word, "s")) {
+    g_pcap_stop = 1;
+    sprintf((char*)command, "%c s", CMD_SET_GENERATOR_MODE);
+    send_command(*sockfd, command);
+    return;
+  }
+
+  if (strcmp(word, "file")) {
+    print_pcap_usage();
+    return;
+  }
+
+  if (g_pcap_playing) {
+    printf("A capture is already playing, stop it with '%c s'\n", CMD_PCAP);
+    return;
+  }
+
+  const unsigned char *name = &line[ptr - buffer] + strlen(word);
+  int args = sscanf((const char*)name, "%s %s %lf", filename, timing, &speed);
+  if (args < 1) {
+    printf("Specify the name of the capture file\n");
+    return;
+  }
+
+  pcap_timing_t pcap_timing;
+  char mode = (strlen(timing) == 1) ? tolower(timing[0]) : '\0';
+  if (mode == 'o') {
+    pcap_timing = PCAP_TIMING_ORIGINAL;
+  } else if (mode == 'l') {
+    pcap_timing = PCAP_TIMING_LINE;
+  } else if ((mode == 'x') && (args == 3) && (speed > 0)) {
+    pcap_timing = PCAP_TIMING_SCALED;
+  } else {
+    print_pcap_usage();
+    return;
+  }
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    printf("Unable to open '%s'\n", filename);
+    return;
+  }
+  if (!pcap_reader_open(&g_pcap_reader, fp, pcap_timing, speed)) {
+    pcap_reader_close(&g_pcap_reader);
+    return;
+  }
+  if (pcap_reader_done(&g_pcap_reader)) {
+    printf("'%s' holds no frames that can be sent\n", filename);
+    pcap_reader_close(&g_pcap_reader);
+    return;
+  }
+
+  // The device echoes the id of the stream so that what it says of an earlier one is not mistaken for it
+  memset(&g_pcap_status, 0, sizeof(g_pcap_status));
+  g_pcap_stream = g_pcap_stream + 1;
+  g_pcap_stop = 0;
+  g_pcap_playing = 1;
+  sprintf((char*)command, "%c s %u", CMD_PCAP, g_pcap_stream);
+  send_command(*sockfd, command);
+
+#ifdef _WIN32
+  if (CreateThread(NULL, 0, pcap_thread, sockfd, 0, NULL) == NULL) {
+#else
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, &pcap_thread, sockfd) || pthread_detach(tid)) {
+#endif
+    printf("Failed to create the thread streaming the capture\n");
+    pcap_reader_close(&g_pcap_reader);
+    g_pcap_playing = 0;
+  }
+}
+
+/*
+ * A separate thread to handle user commands to control the target.
+ */
+#ifdef _WIN32
+DWORD WINAPI console_thread(void *arg)
+#else
+void *console_thread(void *arg)
+#endif
+{
+  int sockfd = *(int *)arg;
+  unsigned char buffer[LINE_LENGTH + 1];
+  unsigned char line[LINE_LENGTH + 1];
+  do {
+    int i = 0;
+    int j = 0;
+    int c = 0;
+
+    printf("%s", g_prompt);
+    for (i = 0; (i < LINE_LENGTH) && ((c = getchar()) != EOF) && (c != '\n'); i++) {
+      line[i] = c;
+      buffer[i] = tolower(c);
+    }
+    line[i] = '\0';
+    buffer[i] = '\0';
+
+    switch (buffer[0]) {
+      case CMD_SET_GENERATOR_MODE:
+        i = validate_mode(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_PKT_CONTROL:
+        if (validate_pkt_ctrl_setting(buffer))
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_VLAN_TAG:
+        if (validate_vlan_tag_settings(buffer))
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_LINE_RATE:
+        i = validate_line_rate(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_SIZE_TABLE:
+        handle_size_table(sockfd, buffer, line);
+        break;
+
+      case CMD_MAC_SWEEP:
+        i = validate_mac_sweep(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_FLOW:
+        handle_flows(sockfd, buffer, line);
+        break;
+
+      case CMD_SHAPER:
+        i = validate_shaper(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_SCENARIO:
+        handle_scenario(sockfd, buffer, line);
+        break;
+
+      case CMD_PCAP:
+        handle_pcap((int *)arg, buffer, line);
+        break;
+
+      case CMD_GAP_DISTRIBUTION:
+        i = validate_gap_distribution(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_STATS_INTERVAL:
+        i = validate_stats_interval(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_LATENCY:
+        i = validate_latency(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_REFLECT:
+        if (validate_reflect(buffer))
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_CATCHUP_LIMIT:
+        i = validate_catchup_limit(buffer);
+        if (i)
+          send_command(sockfd, buffer);
+        break;
+
+      case CMD_SET_MAC_ADDRESS:
+          if (validate_set_mac_address(buffer))
+            send_command(sockfd, buffer);
+        break;
+
+      case CMD_PRINT_PKT_CONFIGURATION:
+        send_command(sockfd, buffer);
+        if (g_batch.records)
+          printf("%d changes not shown are sent with the next '%c' or '%c'\n", g_batch.records,
+              CMD_APPLY_CFG, CMD_SWAP_CFG);
+        break;
+
+      case CMD_SWAP_CFG:
+      case CMD_APPLY_CFG:
+        buffer[1] = '\0';
+        send_command(sockfd, buffer);
+        break;
+
+      case CMD_QUIT:
+        print_and_exit("Done\n");
+        break;
+
+      case 'h':
+      case '?':
+        print_console_usage();
+        break;
+
+      default:
+        printf("Unrecognised command '%s'\n", buffer);
+        print_console_usage();
+        break;
+    }
+  } while (1);
+
+#ifdef _WIN32
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+void usage(char *argv[])
+{
+  printf("Usage: %s [-s server_ip] [-p port] [-l file]\n", argv[0]);
+  printf("  -s server_ip :   The IP address of the xscope server (default %s)\n", DEFAULT_SERVER_IP);
+  printf("  -p port      :   The port of the xscope server (default %s)\n", DEFAULT_PORT);
+  printf("  -l file      :   Log the achieved rates to a CSV file\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _WIN32
+  HANDLE thread;
+#else
+  pthread_t tid;
+#endif
+
+  char *server_ip = DEFAULT_SERVER_IP;
+  char *port_str = DEFAULT_PORT;
+  int err = 0;
+  int sockfds[1] = {0};
+  int c = 0;
+
+  // Ensure that stdout is not buffered for the auto-test framework
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  while ((c = getopt(argc, argv, "s:p:l:")) != -1) {
+    switch (c) {
+      case 'l':
+        open_stats_log(optarg);
+        break;
+      case 's':
+        server_ip = optarg;
+        break;
+      case 'p':
+        port_str = optarg;
+        break;
       case ':': /* -f or -o without operand */
         fprintf(stderr, "Option -%c requires an operand\n", optopt);
         err++;
@@ -377,6 +1894,10 @@ int main(int argc, char *argv[])
 
   sockfds[0] = initialise_socket(server_ip, port_str);
 
+#ifdef _WIN32
+  InitializeCriticalSection(&g_send_lock);
+#endif
+
   // Now start the console
 #ifdef _WIN32
   thread = CreateThread(NULL, 0, console_thread, &sockfds[0], 0, NULL);
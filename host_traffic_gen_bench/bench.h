@@ -0,0 +1,62 @@
+/*
+ * Shared between the reports of the host benchmark.
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include "packet_generator.h"
+#include "command_encoder.h"
+
+#define MAX_COMMANDS 12
+#define COMMAND_BYTES 256
+
+/* The state a generator task keeps, the reports other than the producers one use producer 0 */
+typedef struct generator_state_t {
+  unsigned producer;
+  random_generator_t r;
+  generator_mode_t generator_mode;
+  uintptr_t ctrl_ptr;
+} generator_state_t;
+
+/* The generator states that move onto a new configuration before each message is handled */
+typedef struct bench_states_t {
+  generator_state_t *states;
+  unsigned count;
+} bench_states_t;
+
+void bench_init_state(generator_state_t *state);
+
+/*
+ * Hand a message to the device command handler in a word aligned buffer, as xscope
+ * does. The context is a bench_states_t, or NULL to leave the generators alone.
+ */
+void bench_deliver_message(void *context, const uint32_t message[], unsigned bytes);
+
+/* Pass a command to the device command handler as the host controller would */
+void bench_send_command(generator_state_t *state, const char *command);
+
+/* As bench_send_command(), with the states of several producers */
+void bench_send_command_all(generator_state_t states[], unsigned count, const char *command);
+
+/* Upload a batch of records to the device command handler, see command_upload() */
+void bench_upload(generator_state_t *state, command_batch_t *batch, unsigned char target);
+
+/* Fill a buffer with the next frame, as the generator task does in the mode it is in */
+unsigned bench_fill_buffer(generator_state_t *state, uintptr_t dptr);
+
+/* The total of a receive counter over the packet types */
+unsigned bench_rx_count(volatile unsigned counts[]);
+
+void bench_pacing_report(void);
+void bench_gap_report(void);
+void bench_handoff_report(unsigned num_frames);
+void bench_rx_report(unsigned num_frames);
+void bench_shaping_report(void);
+void bench_scenario_report(void);
+void bench_control_report(void);
+void bench_replay_report(unsigned num_frames);
+void bench_pcap_report(void);
+void bench_producers_report(unsigned num_frames);
+
+#endif /* __BENCH_H__ */
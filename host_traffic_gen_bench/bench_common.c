@@ -0,0 +1,87 @@
+/*
+ * Helpers shared by the reports: the generator task's state, passing commands to
+ * the device's command handler as the host controller would and filling buffers
+ * as the generator task does.
+ */
+#include <string.h>
+
+#include "packet_generator.h"
+#include "packet_controller.h"
+#include "host_protocol.h"
+#include "bench.h"
+
+void bench_init_state(generator_state_t *state)
+{
+  state->producer = 0;
+  state->r = random_create_generator_from_seed(0);
+  state->generator_mode = GENERATOR_SILENT;
+  state->ctrl_ptr = 0;
+}
+
+void bench_deliver_message(void *context, const uint32_t message[], unsigned bytes)
+{
+  const bench_states_t *states = context;
+  uint32_t buffer[PROTOCOL_MAX_MESSAGE_WORDS];
+
+  // The generators move onto any configuration swapped in before the next message is handled
+  for (unsigned i = 0; states && (i < states->count); i++) {
+    generator_state_t *state = &states->states[i];
+    generator_update(state->producer, &state->generator_mode, &state->ctrl_ptr);
+  }
+  memcpy(buffer, message, bytes);
+  handle_host_data((unsigned char *)buffer, bytes);
+}
+
+void bench_send_command_all(generator_state_t states[], unsigned count, const char *command)
+{
+  // Changes to the next configuration are uploaded with the next 'e' or 's'
+  static command_batch_t batch;
+  bench_states_t context = { states, count };
+
+  command_send(&batch, (const unsigned char *)command, bench_deliver_message, &context);
+}
+
+void bench_send_command(generator_state_t *state, const char *command)
+{
+  bench_send_command_all(state, 1, command);
+}
+
+void bench_upload(generator_state_t *state, command_batch_t *batch, unsigned char target)
+{
+  bench_states_t context = { state, 1 };
+
+  command_upload(batch, target, bench_deliver_message, &context);
+}
+
+unsigned bench_fill_buffer(generator_state_t *state, uintptr_t dptr)
+{
+  unsigned len = 0;
+  pkt_ctrl_t *packet;
+
+  generator_update(state->producer, &state->generator_mode, &state->ctrl_ptr);
+  while (!(packet = choose_packet_type(state->producer, &state->r, state->ctrl_ptr, &len)))
+    state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+
+  unsigned length_in_bytes;
+  switch (state->generator_mode) {
+    case GENERATOR_BURST:
+      length_in_bytes = gen_burst_frame(state->producer, dptr, packet, len);
+      break;
+    case GENERATOR_REPLAY:
+      length_in_bytes = gen_replay_frame(state->producer, dptr, packet, len);
+      break;
+    default:
+      length_in_bytes = gen_frame(state->producer, dptr, packet, len);
+      break;
+  }
+  state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+  return length_in_bytes;
+}
+
+unsigned bench_rx_count(volatile unsigned counts[])
+{
+  unsigned total = 0;
+  for (unsigned i = 0; i < TRAFFIC_GEN_TYPES; i++)
+    total += counts[i];
+  return total;
+}
@@ -0,0 +1,221 @@
+/*
+ * Control task report.
+ *
+ * Traces the rate frames are generated at while a burst of host messages arrives:
+ * configuration changes swapped in, mode changes and configuration prints. Before,
+ * each message was handled between frames by the generation loop, so the frames
+ * stopped for as long as it took. Now they are handled by a control task on a
+ * logical core of its own and the generator only takes up what it publishes.
+ *
+ * There is only one thread here, so each task keeps its own clock, advanced by
+ * what its work takes when timed for real, and the task that is behind runs next.
+ * With one clock for both the trace is that of the old single loop. The prints go
+ * to /dev/null, which is far quicker than debug_printf() over xscope on the device,
+ * so the dip before is smaller here than it would be on the wire.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "packet_generator.h"
+#include "packet_controller.h"
+#include "buffers.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+#define CONTROL_BUCKET_NS 250000
+#define CONTROL_BUCKETS 24
+#define CONTROL_BURST_NS 1000000
+#define CONTROL_BURST_REPEATS 16
+#define CONTROL_MAX_MESSAGES 256
+
+static const char *setup_commands[] = {
+  "c u 100 64 64", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL
+};
+
+/* The burst repeats these, each change uploaded with the 'e' and printed by 'p' */
+static const char *burst_commands[] = {
+  "c u 100 64 64", "r u l", "m d", "e", "p", NULL
+};
+
+typedef struct control_message_t {
+  uint32_t words[PROTOCOL_MAX_MESSAGE_WORDS];
+  unsigned bytes;
+} control_message_t;
+
+static control_message_t g_messages[CONTROL_MAX_MESSAGES];
+static unsigned g_num_messages = 0;
+
+typedef struct control_trace_t {
+  unsigned frames[CONTROL_BUCKETS];
+  uint64_t control_ns;  // The time the messages took to handle
+  uint64_t done_ns;     // When the last message had been handled
+} control_trace_t;
+
+/* Keep the messages the encoder sends, so both traces are given the same ones */
+static void collect_message(void *context, const uint32_t message[], unsigned bytes)
+{
+  if (g_num_messages == CONTROL_MAX_MESSAGES)
+    return;
+  memcpy(g_messages[g_num_messages].words, message, bytes);
+  g_messages[g_num_messages].bytes = bytes;
+  g_num_messages++;
+}
+
+static void encode_burst(void)
+{
+  static command_batch_t batch;
+
+  g_num_messages = 0;
+  command_batch_clear(&batch);
+  for (unsigned i = 0; i < CONTROL_BURST_REPEATS; i++) {
+    for (unsigned j = 0; burst_commands[j]; j++)
+      command_send(&batch, (const unsigned char *)burst_commands[j], collect_message, NULL);
+  }
+}
+
+/* Handle a message as xscope delivers it and return what that took */
+static uint64_t handle_message(const control_message_t *message, int zero_buffer)
+{
+  uint32_t buffer[PROTOCOL_MAX_MESSAGE_WORDS];
+
+  memcpy(buffer, message->words, message->bytes);
+  uint64_t start = sim_time_ns();
+  handle_host_data((unsigned char *)buffer, message->bytes);
+
+  // As the old loop did after every message
+  if (zero_buffer) {
+    for (unsigned i = 0; i < (message->bytes + 3) / 4; i++)
+      ((volatile uint32_t *)buffer)[i] = 0;
+  }
+  return sim_time_ns() - start;
+}
+
+/* Generate one frame as the generator task does and return what that took */
+static uint64_t generate(generator_state_t *state, uintptr_t dptr)
+{
+  unsigned len = 0;
+  pkt_ctrl_t *packet;
+
+  uint64_t start = sim_time_ns();
+  generator_update(state->producer, &state->generator_mode, &state->ctrl_ptr);
+  while (!(packet = choose_packet_type(state->producer, &state->r, state->ctrl_ptr, &len)))
+    state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+  gen_frame(state->producer, dptr, packet, len);
+  state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+  return sim_time_ns() - start;
+}
+
+/*
+ * Run the generator through the burst. With a control task it only handles a
+ * message when its clock is behind the generator's, and the generator steps in
+ * between, so a swap never waits for a generator that is not running.
+ */
+static void run_trace(int control_task, control_trace_t *trace)
+{
+  static unsigned buffer[MAX_BUFFER_SIZE / sizeof(unsigned)];
+  generator_state_t state;
+  uint64_t generator_ns = 0;
+  uint64_t control_ns = CONTROL_BURST_NS;
+  unsigned next = 0;
+
+  memset(trace, 0, sizeof(*trace));
+  bench_init_state(&state);
+  for (unsigned i = 0; setup_commands[i]; i++)
+    bench_send_command(&state, setup_commands[i]);
+
+  // Warm the caches and branch predictors before tracing
+  for (unsigned i = 0; i < 10000; i++)
+    generate(&state, (uintptr_t)buffer);
+
+  while (generator_ns < (uint64_t)CONTROL_BUCKET_NS * CONTROL_BUCKETS) {
+    uint64_t step_ns = 0;
+
+    if ((next < g_num_messages) && (generator_ns >= CONTROL_BURST_NS)) {
+      if (!control_task) {
+        step_ns = handle_message(&g_messages[next++], 1);
+        trace->control_ns += step_ns;
+        trace->done_ns = generator_ns + step_ns;
+      } else if (control_ns <= generator_ns) {
+        uint64_t elapsed = handle_message(&g_messages[next++], 0);
+        control_ns += elapsed;
+        trace->control_ns += elapsed;
+        trace->done_ns = control_ns;
+      }
+    }
+
+    step_ns += generate(&state, (uintptr_t)buffer);
+    generator_ns += step_ns;
+    if (generator_ns < (uint64_t)CONTROL_BUCKET_NS * CONTROL_BUCKETS)
+      trace->frames[generator_ns / CONTROL_BUCKET_NS]++;
+  }
+}
+
+static int compare_unsigned(const void *a, const void *b)
+{
+  unsigned x = *(const unsigned *)a;
+  unsigned y = *(const unsigned *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * The fewest frames in a bucket while the messages were being handled, as a
+ * percentage of the median. Buckets outside the burst are left out, as they only
+ * show when the host ran something else.
+ */
+static double burst_percent(const control_trace_t *trace)
+{
+  unsigned sorted[CONTROL_BUCKETS];
+  unsigned last = trace->done_ns / CONTROL_BUCKET_NS;
+  unsigned lowest = ~0u;
+
+  for (unsigned i = CONTROL_BURST_NS / CONTROL_BUCKET_NS; (i <= last) && (i < CONTROL_BUCKETS); i++) {
+    if (trace->frames[i] < lowest)
+      lowest = trace->frames[i];
+  }
+
+  memcpy(sorted, trace->frames, sizeof(sorted));
+  qsort(sorted, CONTROL_BUCKETS, sizeof(sorted[0]), compare_unsigned);
+  return 100.0 * lowest / sorted[CONTROL_BUCKETS / 2];
+}
+
+void bench_control_report(void)
+{
+  static control_trace_t before, after;
+  double per_second = 1e9 / CONTROL_BUCKET_NS;
+
+  encode_burst();
+  printf("\nGeneration rate through a burst of %u host messages at %.1f ms\n",
+      g_num_messages, CONTROL_BURST_NS / 1e6);
+
+  // The configuration prints go nowhere, but are still formatted and written
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+
+  run_trace(0, &before);
+  run_trace(1, &after);
+
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+
+  printf("%10s %16s %16s\n", "time ms", "before frames/s", "after frames/s");
+  for (unsigned i = 0; i < CONTROL_BUCKETS; i++) {
+    printf("%10.2f %16.0f %16.0f\n", (double)i * CONTROL_BUCKET_NS / 1e6,
+        before.frames[i] * per_second, after.frames[i] * per_second);
+  }
+  printf("Handling the messages took %.0f us before and %.0f us after\n",
+      before.control_ns / 1e3, after.control_ns / 1e3);
+  printf("Lowest rate during the burst %.1f%% of the median before, %.1f%% after\n",
+      burst_percent(&before), burst_percent(&after));
+
+  // Leave the following reports silent
+  generator_state_t state;
+  bench_init_state(&state);
+  bench_send_command(&state, "m s");
+}
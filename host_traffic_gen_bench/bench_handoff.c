@@ -0,0 +1,166 @@
+/*
+ * Buffer handoff report.
+ *
+ * Compares the cost per frame of passing buffers between the generator and the
+ * transmitter through the buffer manager's queues with that of the descriptor
+ * rings. On the device the buffer manager path also costs five streaming channel
+ * transfers and a hop through another logical core for every frame, which cannot
+ * be reproduced here, so the single thread figures are the bookkeeping alone.
+ *
+ * The rings are also run with the generator and the transmitter on separate
+ * threads, as they are on the device, to include the cost of sharing the rings.
+ * Unlike the device's hardware threads these may share a CPU, so a thread that
+ * finds nothing to do gives up the CPU rather than spinning out its time slice.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "packet_generator.h"
+#include "buffers.h"
+#include "descriptor_ring.h"
+#include "c_utils.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+typedef enum {
+  HANDOFF_MANAGER,
+  HANDOFF_RINGS,
+  HANDOFF_RINGS_THREADED,
+} handoff_t;
+
+static const char *handoff_names[] = { "buffer manager", "rings", "rings, 2 threads" };
+
+typedef struct handoff_run_t {
+  generator_state_t *state;
+  unsigned num_frames;
+} handoff_run_t;
+
+static void transmit(uintptr_t dptr, unsigned length_in_bytes)
+{
+  send_ether_frame(0, dptr + BUFFER_OVERHEAD_BYTES, length_in_bytes - BUFFER_OVERHEAD_BYTES);
+}
+
+static void run_manager(generator_state_t *state, unsigned num_frames)
+{
+  buffers_free_t free_buffers;
+  buffers_used_t used_buffers;
+  unsigned length_in_bytes;
+  uintptr_t dptr;
+
+  buffers_free_initialise(&free_buffers);
+  buffers_used_initialise(&used_buffers);
+
+  for (unsigned i = 0; i < num_frames; i++) {
+    dptr = buffers_free_acquire(&free_buffers);
+    buffers_used_add(&used_buffers, dptr, bench_fill_buffer(state, dptr));
+
+    if (buffers_used_full(&used_buffers) || free_buffers.top_index == 0) {
+      dptr = buffers_used_take(&used_buffers, &length_in_bytes);
+      transmit(dptr, length_in_bytes & BUFFER_LENGTH_MASK);
+      buffers_free_release(&free_buffers, dptr);
+    }
+  }
+
+  while (used_buffers.head_index != used_buffers.tail_index) {
+    dptr = buffers_used_take(&used_buffers, &length_in_bytes);
+    transmit(dptr, length_in_bytes & BUFFER_LENGTH_MASK);
+    buffers_free_release(&free_buffers, dptr);
+  }
+}
+
+static void run_rings(generator_state_t *state, unsigned num_frames)
+{
+  unsigned length_in_bytes;
+  uintptr_t dptr;
+
+  descriptor_rings_init(1);
+
+  for (unsigned i = 0; i < num_frames; i++) {
+    if (!descriptor_rings_acquire(state->producer, &dptr)) {
+      descriptor_rings_take(&dptr, &length_in_bytes);
+      transmit(dptr, length_in_bytes);
+      descriptor_rings_release(dptr);
+      descriptor_rings_acquire(state->producer, &dptr);
+    }
+    descriptor_rings_submit(state->producer, dptr, bench_fill_buffer(state, dptr));
+  }
+
+  while (descriptor_rings_take(&dptr, &length_in_bytes)) {
+    transmit(dptr, length_in_bytes);
+    descriptor_rings_release(dptr);
+  }
+}
+
+static void *transmitter_thread(void *arg)
+{
+  handoff_run_t *run = (handoff_run_t *)arg;
+  unsigned length_in_bytes;
+  uintptr_t dptr;
+
+  for (unsigned i = 0; i < run->num_frames; ) {
+    if (descriptor_rings_take(&dptr, &length_in_bytes)) {
+      transmit(dptr, length_in_bytes);
+      descriptor_rings_release(dptr);
+      i++;
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void run_rings_threaded(generator_state_t *state, unsigned num_frames)
+{
+  handoff_run_t run = { state, num_frames };
+  pthread_t transmitter;
+  uintptr_t dptr;
+
+  descriptor_rings_init(1);
+  pthread_create(&transmitter, NULL, transmitter_thread, &run);
+
+  for (unsigned i = 0; i < num_frames; i++) {
+    while (!descriptor_rings_acquire(state->producer, &dptr))
+      sched_yield();
+    descriptor_rings_submit(state->producer, dptr, bench_fill_buffer(state, dptr));
+  }
+
+  pthread_join(transmitter, NULL);
+}
+
+static void run_handoff(generator_state_t *state, handoff_t handoff, unsigned num_frames)
+{
+  switch (handoff) {
+    case HANDOFF_MANAGER:        run_manager(state, num_frames);        break;
+    case HANDOFF_RINGS:          run_rings(state, num_frames);          break;
+    case HANDOFF_RINGS_THREADED: run_rings_threaded(state, num_frames); break;
+  }
+}
+
+void bench_handoff_report(unsigned num_frames)
+{
+  printf("\nBuffer handoff (64 byte unicast frames)\n");
+  printf("%-22s %12s %10s\n", "handoff", "frames/s", "ns/frame");
+
+  for (handoff_t handoff = HANDOFF_MANAGER; handoff <= HANDOFF_RINGS_THREADED; handoff++) {
+    generator_state_t state;
+    bench_init_state(&state);
+    bench_send_command(&state, "c u 100 64 64");
+    bench_send_command(&state, "c m 0");
+    bench_send_command(&state, "c b 0");
+    bench_send_command(&state, "v u d");
+    bench_send_command(&state, "r * b 1 0");
+    bench_send_command(&state, "m d");
+    bench_send_command(&state, "e");
+
+    run_handoff(&state, handoff, num_frames / 10);
+    sim_mac_reset();
+
+    uint64_t start = sim_time_ns();
+    run_handoff(&state, handoff, num_frames);
+    uint64_t elapsed = sim_time_ns() - start;
+
+    printf("%-22s %12.0f %10.1f\n", handoff_names[handoff],
+        g_sim_mac.frames / (elapsed / 1e9), (double)elapsed / g_sim_mac.frames);
+  }
+}
@@ -0,0 +1,210 @@
+/*
+ * Pacing accuracy report.
+ *
+ * Compares the bits/s requested with the bits/s achieved by the transmitter's
+ * old relative wait (wait for the frame's gap after the previous send returned)
+ * and by the absolute schedule kept by the pacer.
+ *
+ * Time is simulated in 100MHz reference timer ticks, which is also one bit time
+ * at 100Mb/s. The periods come from gen_frame() for the configured rate and, as
+ * the delay calculation has always assumed, sending a frame takes its time on
+ * the wire. On top of that every frame costs a fixed software overhead for the
+ * channel handoffs and timer reads, and the generator periodically stalls.
+ *
+ * The gap distributions are checked for keeping the requested rate on average
+ * and for the spread of the idle time between frames that they produce.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "packet_generator.h"
+#include "buffers.h"
+#include "pacer.h"
+#include "bench.h"
+
+#define PACING_FRAMES 20000
+
+/* Ticks spent per frame outside the wait and the send */
+#define SIM_OVERHEAD_TICKS 100
+
+/* Every so often the transmitter is starved of frames for a while */
+#define SIM_STALL_EVERY 1000
+#define SIM_STALL_TICKS 5000
+
+#define LINE_RATE_BPS 100000000.0
+
+/* Preamble, CRC and minimum inter-frame gap in addition to the frame bytes */
+#define WIRE_OVERHEAD_BYTES (8 + 4 + 12)
+
+static const double rates_percent[] = { 10, 50, 90, 99, 99.99 };
+static const unsigned frame_bytes[] = { 64, 512, 1518 };
+
+#define NUM_RATES (sizeof(rates_percent) / sizeof(rates_percent[0]))
+#define NUM_SIZES (sizeof(frame_bytes) / sizeof(frame_bytes[0]))
+
+typedef enum {
+  PACING_RELATIVE,
+  PACING_ABSOLUTE,
+} pacing_t;
+
+/* Generate a frame and return the period the generator gave it */
+static unsigned next_period(generator_state_t *state, unsigned char *buffer)
+{
+  unsigned len = 0;
+  generator_update(state->producer, &state->generator_mode, &state->ctrl_ptr);
+  pkt_ctrl_t *packet = choose_packet_type(state->producer, &state->r, state->ctrl_ptr, &len);
+  gen_frame(state->producer, (uintptr_t)buffer, packet, len);
+  state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+  return ((packet_data_t *)buffer)->period;
+}
+
+/* Returns the achieved bits/s on the wire */
+static double simulate(generator_state_t *state, unsigned len, pacing_t pacing, unsigned num_frames)
+{
+  static unsigned buffer[MAX_BUFFER_SIZE / sizeof(unsigned)];
+  unsigned wire_ticks = (len + WIRE_OVERHEAD_BYTES) * 8;
+  unsigned now = 0;
+  unsigned last_start = 0;
+  unsigned long long elapsed = 0;
+  pacer_t pacer;
+
+  pacer_init(&pacer);
+
+  for (unsigned i = 0; i < num_frames; i++) {
+    unsigned period = next_period(state, (unsigned char *)buffer);
+
+    now += SIM_OVERHEAD_TICKS;
+    if (i && (i % SIM_STALL_EVERY) == 0)
+      now += SIM_STALL_TICKS;
+
+    if (pacing == PACING_RELATIVE) {
+      // The old transmitter waited for the gap between frames from 'now'
+      now += period - wire_ticks;
+    } else {
+      unsigned departure = pacer_departure_time(&pacer, now, period);
+      if ((int)(departure - now) > 0)
+        now = departure;
+    }
+
+    // Accumulate in 64 bits as the timer wraps during long runs
+    if (i)
+      elapsed += now - last_start;
+    last_start = now;
+    now += wire_ticks;
+  }
+
+  // Every frame but the last has completed its period by the last start
+  double seconds = elapsed / LINE_RATE_BPS;
+  return (double)(num_frames - 1) * wire_ticks / seconds;
+}
+
+void bench_pacing_report(void)
+{
+  printf("\nPacing accuracy (%d ticks overhead per frame, %d tick stall every %d frames)\n",
+      SIM_OVERHEAD_TICKS, SIM_STALL_TICKS, SIM_STALL_EVERY);
+  printf("%6s %6s %14s %14s %14s %8s %14s %8s\n", "rate%", "bytes", "requested b/s", "limit b/s",
+      "relative b/s", "error%", "absolute b/s", "error%");
+
+  for (unsigned i = 0; i < NUM_RATES; i++) {
+    for (unsigned j = 0; j < NUM_SIZES; j++) {
+      generator_state_t state;
+      char command[COMMAND_BYTES];
+      double requested = LINE_RATE_BPS * rates_percent[i] / 100;
+      unsigned wire_ticks = (frame_bytes[j] + WIRE_OVERHEAD_BYTES) * 8;
+
+      // The most the simulated transmitter can send given its overhead per frame
+      double limit = LINE_RATE_BPS * wire_ticks / (wire_ticks + SIM_OVERHEAD_TICKS);
+      double achieved[2];
+
+      bench_init_state(&state);
+
+      // The same conversion the host controller does for the line rate command
+      double ticks_per_bit = 100.0 / rates_percent[i];
+      unsigned ticks_hi = (unsigned)ticks_per_bit;
+      unsigned ticks_lo = (unsigned)((ticks_per_bit - ticks_hi) * 4294967296.0);
+      snprintf(command, sizeof(command), "c u 100 %u %u", frame_bytes[j], frame_bytes[j]);
+      bench_send_command(&state, command);
+      bench_send_command(&state, "c m 0");
+      bench_send_command(&state, "c b 0");
+      bench_send_command(&state, "v u d");
+      snprintf(command, sizeof(command), "r * b %x %x", ticks_hi, ticks_lo);
+      bench_send_command(&state, command);
+      bench_send_command(&state, "m d");
+      bench_send_command(&state, "e");
+
+      achieved[PACING_RELATIVE] = simulate(&state, frame_bytes[j], PACING_RELATIVE, PACING_FRAMES);
+      achieved[PACING_ABSOLUTE] = simulate(&state, frame_bytes[j], PACING_ABSOLUTE, PACING_FRAMES);
+
+      printf("%6g %6u %14.0f %14.0f %14.0f %8.3f %14.0f %8.3f\n", rates_percent[i], frame_bytes[j], requested, limit,
+          achieved[PACING_RELATIVE], 100.0 * (achieved[PACING_RELATIVE] - requested) / requested,
+          achieved[PACING_ABSOLUTE], 100.0 * (achieved[PACING_ABSOLUTE] - requested) / requested);
+    }
+  }
+}
+
+typedef struct gap_config_t {
+  const char *name;
+  const char *command;
+} gap_config_t;
+
+static const gap_config_t gap_configs[] = {
+  { "constant",      "g c" },
+  { "exponential",   "g e" },
+  { "uniform-50",    "g u 50" },
+  { "table-0-200",   "g t 0 1 200 1" },
+  { "table-10-1000", "g t 10 9 1000 1" },
+};
+
+#define NUM_GAP_CONFIGS (sizeof(gap_configs) / sizeof(gap_configs[0]))
+
+#define GAP_RATE_PERCENT 50
+#define GAP_FRAME_BYTES 512
+
+/* Enough frames for the mean of the widest distribution to settle */
+#define GAP_FRAMES 1000000
+
+void bench_gap_report(void)
+{
+  static unsigned buffer[MAX_BUFFER_SIZE / sizeof(unsigned)];
+  unsigned wire_ticks = (GAP_FRAME_BYTES + WIRE_OVERHEAD_BYTES) * 8;
+  double requested = LINE_RATE_BPS * GAP_RATE_PERCENT / 100;
+
+  printf("\nGap distributions (%d%% of line rate, %d byte frames)\n", GAP_RATE_PERCENT, GAP_FRAME_BYTES);
+  printf("%-14s %12s %12s %14s %8s\n", "gaps", "mean idle", "idle cv", "absolute b/s", "error%");
+
+  for (unsigned i = 0; i < NUM_GAP_CONFIGS; i++) {
+    generator_state_t state;
+    char command[COMMAND_BYTES];
+    double sum = 0;
+    double sum_squares = 0;
+
+    bench_init_state(&state);
+    snprintf(command, sizeof(command), "c u 100 %u %u", GAP_FRAME_BYTES, GAP_FRAME_BYTES);
+    bench_send_command(&state, command);
+    bench_send_command(&state, "c m 0");
+    bench_send_command(&state, "c b 0");
+    bench_send_command(&state, "v u d");
+    bench_send_command(&state, "r * b 2 0");
+    bench_send_command(&state, gap_configs[i].command);
+    bench_send_command(&state, "m d");
+    bench_send_command(&state, "e");
+
+    for (unsigned j = 0; j < GAP_FRAMES; j++) {
+      double idle = (double)next_period(&state, (unsigned char *)buffer) - wire_ticks;
+      sum += idle;
+      sum_squares += idle * idle;
+    }
+
+    double mean = sum / GAP_FRAMES;
+    double deviation = sqrt(sum_squares / GAP_FRAMES - mean * mean);
+    double achieved = simulate(&state, GAP_FRAME_BYTES, PACING_ABSOLUTE, GAP_FRAMES);
+
+    printf("%-14s %12.1f %12.3f %14.0f %8.3f\n", gap_configs[i].name, mean, deviation / mean,
+        achieved, 100.0 * (achieved - requested) / requested);
+
+    // Leave the following reports with constant gaps
+    bench_send_command(&state, "g c");
+    bench_send_command(&state, "e");
+  }
+}
@@ -0,0 +1,402 @@
+/*
+ * Capture playback report.
+ *
+ * Writes a capture of mixed frame sizes and destinations, including frames too
+ * short and too long to send as they are, and plays it as the device would: the
+ * host reader packs it into blocks, sent through the command handler once the
+ * status the device polls out says there is room, the first generator copies the
+ * frames into buffers through the descriptor rings and the transmitter paces them
+ * through its queues, every class unshaped.
+ *
+ * Each frame sent is checked against the capture, and its departure against the
+ * capture's timestamp, scaled for a speed-up. At line rate the frames must fill
+ * the line. The status the device sends reaches the host, which answers it, after
+ * a modelled latency: shorter than a block takes to play no frame may be late,
+ * longer they must be. The generator may run out of blocks, counted as underruns,
+ * either way, as the buffers it has already filled keep the line going.
+ *
+ * Time is simulated in 100MHz reference timer ticks as in bench_shaper.c.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "packet_generator.h"
+#include "descriptor_ring.h"
+#include "shaper.h"
+#include "pcap_player.h"
+#include "pcap_stream.h"
+#include "packet_controller.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+#define CAPTURE_RECORDS 3000
+
+// One record in this many is longer than a frame can be
+#define CAPTURE_TOO_LONG_EVERY 50
+
+// The first timestamp, so the seconds and microseconds both matter
+#define CAPTURE_START_SECONDS 1700000000ull
+
+// The most a gap exceeds twice the wire time of the frame before it
+#define CAPTURE_MAX_EXTRA_US 20
+
+// The latency of the host answering the device when checking the timing
+#define HOST_LATENCY_TICKS 10000 // 100us
+
+/* Ticks spent per frame outside the wait and the send */
+#define SIM_OVERHEAD_TICKS 20
+
+/* Preamble, CRC and minimum inter-frame gap in addition to the frame bytes */
+#define WIRE_OVERHEAD_BYTES (8 + 4 + 12)
+
+/* The frames of the capture that can be sent, in order */
+typedef struct capture_frame_t {
+  unsigned record;
+  unsigned captured;
+  unsigned length;   // Padded to the minimum
+  uint64_t time_us;
+} capture_frame_t;
+
+static capture_frame_t g_frames[CAPTURE_RECORDS];
+static unsigned g_frame_count;
+static unsigned g_too_long;
+static uint64_t g_capture_bytes;
+
+typedef struct timing_run_t {
+  const char *name;
+  pcap_timing_t timing;
+  double speed;
+} timing_run_t;
+
+static const timing_run_t timing_runs[] = {
+  { "original", PCAP_TIMING_ORIGINAL, 1.0 },
+  { "x2",       PCAP_TIMING_SCALED,   2.0 },
+  { "line",     PCAP_TIMING_LINE,     1.0 },
+};
+
+#define NUM_TIMING_RUNS (sizeof(timing_runs) / sizeof(timing_runs[0]))
+
+/* A byte of a record as it was captured, the first six are the destination */
+static unsigned char capture_byte(unsigned record, unsigned i)
+{
+  static const unsigned char dest[TRAFFIC_GEN_TYPES][MAC_ADDRESS_BYTES] = {
+    { 0x00, 0x22, 0x97, 0x00, 0x00, 0x01 },
+    { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x01 },
+    { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+  };
+
+  if (i < MAC_ADDRESS_BYTES)
+    return dest[record % TRAFFIC_GEN_TYPES][i];
+  return (unsigned char)(record * 7 + i);
+}
+
+static void put_word(unsigned char *bytes, uint32_t value)
+{
+  memcpy(bytes, &value, sizeof(value));
+}
+
+/* Write the capture in the host's byte order, with microsecond timestamps */
+static FILE *write_capture(void)
+{
+  static unsigned char record[2048];
+  unsigned char header[24] = { 0 };
+  random_generator_t r = random_create_generator_from_seed(25);
+  uint64_t time_us = 0;
+  FILE *fp = tmpfile();
+
+  if (!fp)
+    return NULL;
+
+  put_word(&header[0], 0xa1b2c3d4);
+  header[4] = 2;   // Version 2.4
+  header[6] = 4;
+  put_word(&header[16], 65535);
+  put_word(&header[20], 1);
+  fwrite(header, 1, sizeof(header), fp);
+
+  g_frame_count = 0;
+  g_too_long = 0;
+  g_capture_bytes = 0;
+  for (unsigned i = 0; i < CAPTURE_RECORDS; i++) {
+    unsigned choice = random_get_random_number(&r) % 100;
+    unsigned length;
+
+    if (i % CAPTURE_TOO_LONG_EVERY == CAPTURE_TOO_LONG_EVERY - 1)
+      length = 2000;
+    else if (choice < 10)
+      length = 42;   // As captured before the MAC padded it
+    else if (choice < 40)
+      length = 64;
+    else
+      length = MIN_FRAME_BYTES + random_get_random_number(&r) % (MAX_FRAME_BYTES - MIN_FRAME_BYTES + 1);
+
+    uint64_t seconds = CAPTURE_START_SECONDS + time_us / 1000000;
+    put_word(&record[0], (uint32_t)seconds);
+    put_word(&record[4], (uint32_t)(time_us % 1000000));
+    put_word(&record[8], length);
+    put_word(&record[12], length);
+    for (unsigned j = 0; j < length; j++)
+      record[16 + j] = capture_byte(i, j);
+    fwrite(record, 1, 16 + length, fp);
+
+    if (length > MAX_FRAME_BYTES) {
+      g_too_long++;
+    } else {
+      capture_frame_t *frame = &g_frames[g_frame_count++];
+      frame->record = i;
+      frame->captured = length;
+      frame->length = (length < MIN_FRAME_BYTES) ? MIN_FRAME_BYTES : length;
+      frame->time_us = time_us;
+      g_capture_bytes += frame->length;
+    }
+
+    // Far enough apart that a frame is always sent before the next is due, even at x2
+    unsigned wire_us = ((length < MIN_FRAME_BYTES ? MIN_FRAME_BYTES : length) + WIRE_OVERHEAD_BYTES) * 8 / 100 + 2;
+    time_us += 2 * wire_us + random_get_random_number(&r) % (CAPTURE_MAX_EXTRA_US + 1);
+  }
+
+  rewind(fp);
+  return fp;
+}
+
+/* The statuses on their way to the host, each arriving after the latency */
+#define STATUS_QUEUE_DEPTH 64
+
+typedef struct host_model_t {
+  pcap_reader_t reader;
+  uint32_t words[PCAP_BLOCK_WORDS];
+  unsigned length;
+  unsigned frames;
+  unsigned block;
+  unsigned stream;
+  int sent_last;
+  unsigned latency;
+  pcap_status_t seen;
+
+  pcap_status_t queue[STATUS_QUEUE_DEPTH];
+  unsigned arrival[STATUS_QUEUE_DEPTH];
+  unsigned head;
+  unsigned tail;
+} host_model_t;
+
+static host_model_t g_host;
+static unsigned g_now;
+
+static void status_sent(unsigned char id, unsigned int length, const unsigned char data[])
+{
+  host_model_t *host = &g_host;
+
+  if ((id != PCAP_STATUS_PROBE) || (length != sizeof(pcap_status_t)) ||
+      (host->head - host->tail == STATUS_QUEUE_DEPTH))
+    return;
+  memcpy(&host->queue[host->head % STATUS_QUEUE_DEPTH], data, length);
+  host->arrival[host->head % STATUS_QUEUE_DEPTH] = g_now + host->latency;
+  host->head++;
+}
+
+/* Take the statuses that have arrived and send the blocks there is room for, as pcap_thread() */
+static void host_step(host_model_t *host, unsigned now)
+{
+  while ((host->tail != host->head) && ((int)(now - host->arrival[host->tail % STATUS_QUEUE_DEPTH]) >= 0)) {
+    host->seen = host->queue[host->tail % STATUS_QUEUE_DEPTH];
+    host->tail++;
+  }
+
+  while (!host->sent_last && host->frames && (host->seen.stream == host->stream) &&
+         (host->block < host->seen.blocks_played + PCAP_BLOCKS_AHEAD)) {
+    host->sent_last = pcap_reader_done(&host->reader);
+    pcap_send_block(host->block, host->words, host->length, host->frames, host->sent_last,
+        bench_deliver_message, NULL);
+    host->block++;
+    host->frames = pcap_reader_fill(&host->reader, host->words, &host->length);
+  }
+}
+
+typedef struct playback_t {
+  unsigned frames;
+  uint64_t bytes;
+  unsigned mismatches;
+  int max_error;         // Of a departure from its timestamp, in ticks
+  uint64_t wire_ticks;
+  unsigned first_departure;
+  unsigned last_end;
+  unsigned underruns;
+  unsigned late_frames;
+  unsigned blocks;
+  int finished;
+} playback_t;
+
+/* Check a frame sent against the capture */
+static void check_frame(playback_t *playback, const timing_run_t *run, uintptr_t dptr,
+    unsigned length_in_bytes, unsigned departure)
+{
+  const unsigned char *frame = (const unsigned char *)dptr + BUFFER_OVERHEAD_BYTES;
+  unsigned nbytes = length_in_bytes - BUFFER_OVERHEAD_BYTES;
+  unsigned k = playback->frames;
+
+  if (k == 0)
+    playback->first_departure = departure;
+
+  if ((k >= g_frame_count) || (nbytes != g_frames[k].length)) {
+    playback->mismatches++;
+  } else {
+    // Short frames are padded with zeros
+    for (unsigned i = 0; i < nbytes; i++) {
+      unsigned char expected = (i < g_frames[k].captured) ? capture_byte(g_frames[k].record, i) : 0;
+      if (frame[i] != expected) {
+        playback->mismatches++;
+        break;
+      }
+    }
+
+    if (run->timing != PCAP_TIMING_LINE) {
+      double expected = (g_frames[k].time_us - g_frames[0].time_us) * 100.0 / run->speed;
+      int error = (int)(departure - playback->first_departure) - (int)(expected + 0.5);
+      if (error < 0)
+        error = -error;
+      if (error > playback->max_error)
+        playback->max_error = error;
+    }
+  }
+
+  playback->frames++;
+  playback->bytes += nbytes;
+}
+
+/* Play the capture through the device, returns 0 if it could not be read */
+static int play(generator_state_t *state, const timing_run_t *run, unsigned latency, playback_t *playback)
+{
+  static shaper_t shaper;
+  static unsigned stream = 0;
+  host_model_t *host = &g_host;
+  char command[COMMAND_BYTES];
+  unsigned next_poll;
+
+  memset(playback, 0, sizeof(*playback));
+  memset(host, 0, sizeof(*host));
+  FILE *fp = write_capture();
+  if (!fp)
+    return 0;
+  if (!pcap_reader_open(&host->reader, fp, run->timing, run->speed)) {
+    pcap_reader_close(&host->reader);
+    return 0;
+  }
+  host->latency = latency;
+  host->stream = ++stream;
+  host->frames = pcap_reader_fill(&host->reader, host->words, &host->length);
+
+  descriptor_rings_init(1);
+  shaper_init(&shaper);
+  g_now = 0;
+  next_poll = 0;
+  g_sim_xscope_hook = status_sent;
+
+  snprintf(command, sizeof(command), "u s %u", host->stream);
+  bench_send_command(state, command);
+
+  // Until the host has seen the end, or for far longer than the capture lasts
+  unsigned limit = (unsigned)((g_frames[g_frame_count - 1].time_us + 1000000) * 100);
+  while (!host->seen.finished || shaper.queued) {
+    uintptr_t dptr;
+    unsigned length_in_bytes;
+    unsigned tx_class;
+    unsigned wake_time = g_now;
+
+    if ((int)(g_now - limit) > 0)
+      break;
+
+    if ((int)(g_now - next_poll) >= 0) {
+      pcap_player_poll();
+      next_poll += PCAP_POLL_TICKS;
+    }
+    host_step(host, g_now);
+
+    // The first generator, and the transmitter taking its buffers into its queues
+    while (pcap_player_ready() && descriptor_rings_acquire(0, &dptr))
+      descriptor_rings_submit(0, dptr, pcap_player_fill(0, dptr));
+    while (descriptor_rings_take(&dptr, &length_in_bytes))
+      shaper_enqueue(&shaper, dptr, length_in_bytes, g_now);
+
+    if (shaper_next(&shaper, g_now, &dptr, &length_in_bytes, &tx_class, &wake_time)) {
+      unsigned wire_ticks = (length_in_bytes - BUFFER_OVERHEAD_BYTES + WIRE_OVERHEAD_BYTES) * 8;
+      check_frame(playback, run, dptr, length_in_bytes, g_now);
+      descriptor_rings_release(dptr);
+      playback->wire_ticks += wire_ticks;
+      g_now += wire_ticks + SIM_OVERHEAD_TICKS;
+      playback->last_end = g_now;
+      continue;
+    }
+
+    // Move on to whatever happens next
+    unsigned next = next_poll;
+    if ((host->tail != host->head) && ((int)(host->arrival[host->tail % STATUS_QUEUE_DEPTH] - next) < 0))
+      next = host->arrival[host->tail % STATUS_QUEUE_DEPTH];
+    if ((wake_time != g_now) && ((int)(wake_time - next) < 0))
+      next = wake_time;
+    g_now = next;
+  }
+
+  playback->underruns = host->seen.underruns;
+  playback->late_frames = shaper_late_frames(&shaper);
+  playback->blocks = host->block;
+  playback->finished = host->seen.finished && (host->seen.frames == playback->frames) && !host->seen.errors;
+
+  g_sim_xscope_hook = NULL;
+  pcap_reader_close(&host->reader);
+  bench_send_command(state, "m s");
+  return 1;
+}
+
+static void print_playback(const char *name, unsigned latency, const playback_t *playback, int timed)
+{
+  int sent_ok = playback->finished && !playback->mismatches &&
+      (playback->frames == g_frame_count) && (playback->bytes == g_capture_bytes);
+  unsigned span = playback->last_end - playback->first_departure;
+  char max_error[16] = "-";
+  char late_frames[16] = "-";
+
+  // Every frame is late to a period of zero
+  if (timed) {
+    snprintf(max_error, sizeof(max_error), "%.2f", playback->max_error / 100.0);
+    snprintf(late_frames, sizeof(late_frames), "%u", playback->late_frames);
+  }
+  printf("%-10s %8.0f %8u %10llu %8s %12s %6s %10u %8.2f\n", name, latency / 100.0, playback->frames,
+      (unsigned long long)playback->bytes, sent_ok ? "yes" : "NO", max_error, late_frames, playback->underruns,
+      span ? 100.0 * playback->wire_ticks / span : 0.0);
+}
+
+void bench_pcap_report(void)
+{
+  generator_state_t state;
+  playback_t playback;
+
+  // Written again for each run, as the reader closes it
+  bench_init_state(&state);
+  FILE *fp = write_capture();
+  if (!fp) {
+    printf("\nCapture playback: unable to write a capture\n");
+    return;
+  }
+  fclose(fp);
+
+  printf("\nCapture playback (%d records, %u too long, %d word blocks, %d ticks overhead per frame)\n",
+      CAPTURE_RECORDS, g_too_long, PCAP_BLOCK_WORDS, SIM_OVERHEAD_TICKS);
+  printf("%-10s %8s %8s %10s %8s %12s %6s %10s %8s\n", "timing", "host us", "frames", "bytes", "sent ok",
+      "max error us", "late", "underruns", "wire%");
+
+  unsigned blocks = 0;
+  for (unsigned i = 0; i < NUM_TIMING_RUNS; i++) {
+    if (!play(&state, &timing_runs[i], HOST_LATENCY_TICKS, &playback))
+      return;
+    print_playback(timing_runs[i].name, HOST_LATENCY_TICKS, &playback, timing_runs[i].timing != PCAP_TIMING_LINE);
+    blocks = playback.blocks;
+  }
+
+  // Half and twice the time a block takes to play at the original timing
+  unsigned block_ticks = (unsigned)((g_frames[g_frame_count - 1].time_us - g_frames[0].time_us) * 100 / blocks);
+  for (unsigned latency = block_ticks / 2; latency <= 2 * block_ticks; latency *= 4) {
+    if (!play(&state, &timing_runs[0], latency, &playback))
+      return;
+    print_playback(timing_runs[0].name, latency, &playback, 1);
+  }
+}
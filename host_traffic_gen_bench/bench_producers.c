@@ -0,0 +1,283 @@
+/*
+ * Producer scaling report.
+ *
+ * Runs 1, 2 and 4 generator producers filling buffers through the descriptor
+ * rings for one transmitter, and reports the frames per second that get through
+ * for 64 byte frames. The frames the transmitter takes are checked as it would
+ * send them: the receive analyzer must see no lost, reordered or duplicate frames
+ * in any producer's numbers, the periods must add up to the configured rate and
+ * every burst must go out whole, with no other producer's frames inside it.
+ *
+ * There is only one thread here, so each task keeps its own clock, advanced by
+ * what its work takes when timed for real, and the task that is behind runs next.
+ * A filled buffer is only submitted, and a sent one only released, once the clock
+ * of the task doing it has reached the end of the work. The transmitter only takes
+ * and releases buffers, so the rate is that of the generation and the handoff.
+ *
+ * The host has a core for each task, but a tile shares its issue slots between
+ * its busy logical cores, with none getting more than a quarter. The producers
+ * and the transmitter poll, so with more than three producers each gets less and
+ * the xcore estimate scales the speedup by that.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "packet_generator.h"
+#include "packet_controller.h"
+#include "descriptor_ring.h"
+#include "rx_analyzer.h"
+#include "traffic_stats.h"
+#include "pacer.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+#define PRODUCERS_BURST_FRAMES 32
+
+// The share of the issue slots any logical core can have, and the most that get it
+#define XCORE_SLOTS 4
+
+/* Preamble, CRC and minimum inter-frame gap in addition to the frame bytes */
+#define WIRE_OVERHEAD_BYTES (8 + 4 + 12)
+
+// The sequence number of the untagged frames sent here
+#define SEQ_OFFSET (2 * MAC_ADDRESS_BYTES + 2)
+
+static const char *setup_commands[] = {
+  "c u 100 64 64", "c m 0", "c b 0", "v u d", NULL
+};
+
+typedef struct producer_task_t {
+  generator_state_t *state;
+  uint64_t clock_ns;
+  uint64_t busy_ns;
+  uintptr_t filled;
+  unsigned length_in_bytes;
+} producer_task_t;
+
+typedef struct producers_run_t {
+  unsigned frames;
+  uint64_t elapsed_ns;
+  uint64_t producer_busy_ns;
+  uint64_t transmitter_busy_ns;
+  unsigned long long wire_bits;
+  unsigned long long period_ticks;
+  unsigned trains;
+  unsigned broken_trains;
+  unsigned last_producer;
+  int in_train;
+} producers_run_t;
+
+static producer_task_t g_tasks[GENERATOR_PRODUCERS];
+static generator_state_t g_states[GENERATOR_PRODUCERS];
+static unsigned g_num_tasks = 0;
+
+/* What reading the clock twice costs, taken off every step timed */
+static uint64_t g_clock_ns = 0;
+
+static void calibrate_clock(void)
+{
+  const unsigned reads = 100000;
+  uint64_t start = sim_time_ns();
+  for (unsigned i = 0; i < reads; i++)
+    sim_time_ns();
+  g_clock_ns = (sim_time_ns() - start) / reads;
+}
+
+static uint64_t since(uint64_t start)
+{
+  uint64_t elapsed = sim_time_ns() - start;
+  return (elapsed > g_clock_ns) ? elapsed - g_clock_ns : 0;
+}
+
+static void setup(unsigned producers, const char *rate, const char *mode)
+{
+  packet_generator_init(producers);
+  descriptor_rings_init(producers);
+
+  g_num_tasks = producers;
+  for (unsigned i = 0; i < producers; i++) {
+    producer_task_t *task = &g_tasks[i];
+
+    memset(task, 0, sizeof(*task));
+    task->state = &g_states[i];
+    bench_init_state(task->state);
+    task->state->producer = i;
+    task->state->r = random_create_generator_from_seed(PRODUCER_SEED(i, 0));
+  }
+
+  // Every producer moves onto any configuration swapped in before the next message is handled
+  for (unsigned i = 0; setup_commands[i]; i++)
+    bench_send_command_all(g_states, producers, setup_commands[i]);
+  bench_send_command_all(g_states, producers, rate);
+  bench_send_command_all(g_states, producers, mode);
+  bench_send_command_all(g_states, producers, "e");
+}
+
+/* Fill a buffer as the generator task does and return what that took */
+static uint64_t produce(producer_task_t *task, uintptr_t dptr)
+{
+  uint64_t start = sim_time_ns();
+  task->length_in_bytes = bench_fill_buffer(task->state, dptr);
+  task->filled = dptr;
+  return since(start);
+}
+
+/* Check a frame the transmitter has taken, as the receiver would see it */
+static void check_frame(producers_run_t *run, uintptr_t dptr, unsigned length_in_bytes)
+{
+  static unsigned rxbuf[MAX_BUFFER_SIZE / sizeof(unsigned)];
+  const unsigned char *frame = (const unsigned char *)dptr + BUFFER_OVERHEAD_BYTES;
+  unsigned nbytes = length_in_bytes - BUFFER_OVERHEAD_BYTES;
+  unsigned period = ((packet_data_t *)dptr)->period;
+
+  unsigned seq_num = (frame[SEQ_OFFSET] << 24) | (frame[SEQ_OFFSET + 1] << 16) |
+      (frame[SEQ_OFFSET + 2] << 8) | frame[SEQ_OFFSET + 3];
+  unsigned producer = producer_from_seq(seq_num);
+
+  // A burst ends with the frame that anchors the gap after it
+  if (run->in_train && (producer != run->last_producer))
+    run->broken_trains++;
+  run->in_train = !(period & PACER_ANCHOR);
+  if (period & PACER_ANCHOR)
+    run->trains++;
+  run->last_producer = producer;
+
+  run->wire_bits += (nbytes + WIRE_OVERHEAD_BYTES) * 8;
+  run->period_ticks += period & ~PACER_ANCHOR;
+
+  memcpy(rxbuf, frame, nbytes);
+  rx_analyzer_frame(rxbuf, nbytes, 0);
+}
+
+static producer_task_t *first_task(void)
+{
+  producer_task_t *first = &g_tasks[0];
+  for (unsigned i = 1; i < g_num_tasks; i++) {
+    if (g_tasks[i].clock_ns < first->clock_ns)
+      first = &g_tasks[i];
+  }
+  return first;
+}
+
+/* A transmitter with nothing to take waits until the next producer has moved on */
+static uint64_t next_producer_clock(uint64_t clock_ns)
+{
+  uint64_t next_ns = ~0ull;
+  for (unsigned i = 0; i < g_num_tasks; i++) {
+    if ((g_tasks[i].clock_ns > clock_ns) && (g_tasks[i].clock_ns < next_ns))
+      next_ns = g_tasks[i].clock_ns;
+  }
+  return (next_ns == ~0ull) ? clock_ns + 1 : next_ns;
+}
+
+static void run(unsigned producers, const char *rate, const char *mode, unsigned num_frames, producers_run_t *result)
+{
+  uint64_t transmitter_ns = 0;
+  uintptr_t sent = 0;
+
+  setup(producers, rate, mode);
+  rx_analyzer_reset();
+  memset(result, 0, sizeof(*result));
+
+  while (result->frames < num_frames) {
+    producer_task_t *task = first_task();
+
+    if (task->clock_ns < transmitter_ns) {
+      uintptr_t dptr;
+
+      if (task->filled) {
+        descriptor_rings_submit(task->state->producer, task->filled, task->length_in_bytes);
+        task->filled = 0;
+      } else if (descriptor_rings_acquire(task->state->producer, &dptr)) {
+        uint64_t elapsed = produce(task, dptr);
+        task->clock_ns += elapsed;
+        task->busy_ns += elapsed;
+      } else {
+        // Only the transmitter frees buffers, and it is ahead
+        task->clock_ns = transmitter_ns;
+      }
+    } else {
+      uintptr_t dptr;
+      unsigned length_in_bytes;
+
+      if (sent) {
+        descriptor_rings_release(sent);
+        sent = 0;
+        continue;
+      }
+
+      uint64_t start = sim_time_ns();
+      int taken = descriptor_rings_take(&dptr, &length_in_bytes);
+      uint64_t elapsed = since(start);
+
+      if (taken) {
+        check_frame(result, dptr, length_in_bytes);
+        transmitter_ns += elapsed;
+        result->transmitter_busy_ns += elapsed;
+        result->frames++;
+        sent = dptr;
+      } else {
+        transmitter_ns = next_producer_clock(transmitter_ns);
+      }
+    }
+  }
+
+  result->elapsed_ns = transmitter_ns;
+  for (unsigned i = 0; i < producers; i++)
+    result->producer_busy_ns += g_tasks[i].busy_ns;
+}
+
+void bench_producers_report(unsigned num_frames)
+{
+  static const unsigned producer_counts[] = { 1, 2, 4 };
+  double single_rate = 0;
+
+  calibrate_clock();
+
+  printf("\nProducer scaling for 64 byte unicast frames (%d buffers)\n", BUFFER_COUNT);
+  printf("%9s %12s %8s %8s %10s %10s %6s %9s %6s %6s\n", "producers", "frames/s", "speedup", "xcore",
+      "producer%", "transmit%", "lost", "reordered", "dups", "rate%");
+
+  for (unsigned i = 0; i < sizeof(producer_counts) / sizeof(producer_counts[0]); i++) {
+    unsigned producers = producer_counts[i];
+    producers_run_t result;
+
+    if (producers > GENERATOR_PRODUCERS)
+      break;
+
+    // Half the line rate, so the periods show the rate is kept whatever the merge
+    run(producers, "r * b 2 0", "m d", num_frames, &result);
+
+    double rate = result.frames * 1e9 / result.elapsed_ns;
+    if (producers == 1)
+      single_rate = rate;
+    double speedup = rate / single_rate;
+    unsigned busy = (producers + 1 > XCORE_SLOTS) ? producers + 1 : XCORE_SLOTS;
+
+    printf("%9u %12.0f %8.2f %8.2f %10.1f %10.1f %6u %9u %6u %6.2f\n", producers, rate, speedup,
+        speedup * XCORE_SLOTS / busy,
+        100.0 * result.producer_busy_ns / (producers * result.elapsed_ns),
+        100.0 * result.transmitter_busy_ns / result.elapsed_ns,
+        bench_rx_count(g_traffic_stats.rx_lost), bench_rx_count(g_traffic_stats.rx_reordered),
+        bench_rx_count(g_traffic_stats.rx_duplicates), 100.0 * result.wire_bits / result.period_ticks);
+  }
+
+  printf("Bursts of %d frames: ", PRODUCERS_BURST_FRAMES);
+  for (unsigned i = 0; i < sizeof(producer_counts) / sizeof(producer_counts[0]); i++) {
+    unsigned producers = producer_counts[i];
+    producers_run_t result;
+    char mode[COMMAND_BYTES];
+
+    if (producers > GENERATOR_PRODUCERS)
+      break;
+
+    snprintf(mode, sizeof(mode), "m b %d 1000", PRODUCERS_BURST_FRAMES);
+    run(producers, "r * b 1 0", mode, PRODUCERS_BURST_FRAMES * 1000, &result);
+    printf("%s%u producers %u sent, %u broken", i ? ", " : "", producers, result.trains, result.broken_trains);
+  }
+  printf("\n");
+
+  // Leave the generator as the other reports expect it
+  setup(1, "r * b 1 0", "m s");
+  g_num_tasks = 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Replay mode report.
+ *
+ * Compares the cost per frame of generating every frame and handing it to the
+ * transmitter through the descriptor rings with that of the transmitter cycling
+ * through a replay ring, with and without numbering the frames as they are sent.
+ * Replay needs the generator only to fill the ring, so what is left is the pacing
+ * and the sequence number patch.
+ *
+ * The frames sent from a ring of mixed packet types are then checked as the
+ * receiver would see them over many passes: numbered, the analyzer must find no
+ * lost, reordered or duplicate frames; unchanged, every pass after the first is
+ * duplicates. Leaving replay mode must hand every buffer of the ring back.
+ *
+ * Last, a ring taking the first producer's whole share of the pool is asked for
+ * again, which must hand it back for the producer to fill the new one.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "packet_generator.h"
+#include "buffers.h"
+#include "c_utils.h"
+#include "descriptor_ring.h"
+#include "replay.h"
+#include "rx_analyzer.h"
+#include "traffic_stats.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+// Passes of the ring checked by the receiver
+#define REPLAY_PASSES 1000
+
+static const char *unicast_commands[] = {
+  "c u 100 64 64", "c m 0", "c b 0", "v u d", "r * b 1 0", NULL
+};
+
+static const char *mixed_commands[] = {
+  "c u 50 64 64", "c m 30 64 64", "c b 20 64 64", "v u d", "r * b 1 0", NULL
+};
+
+typedef enum {
+  REPLAY_GENERATED,
+  REPLAY_NUMBERED,
+  REPLAY_UNCHANGED,
+} replay_run_t;
+
+static const char *replay_names[] = { "generated, rings", "replay, numbered", "replay, unchanged" };
+
+static replay_t g_replay;
+
+static void transmit(uintptr_t dptr, unsigned length_in_bytes, int analyse)
+{
+  static unsigned rxbuf[MAX_BUFFER_SIZE / sizeof(unsigned)];
+  unsigned nbytes = length_in_bytes - BUFFER_OVERHEAD_BYTES;
+
+  send_ether_frame(0, dptr + BUFFER_OVERHEAD_BYTES, nbytes);
+  if (analyse) {
+    memcpy(rxbuf, (const unsigned char *)dptr + BUFFER_OVERHEAD_BYTES, nbytes);
+    rx_analyzer_frame(rxbuf, nbytes, 0);
+  }
+}
+
+/* The pool is shared by the given number of producers, of which only the first runs */
+static void setup(generator_state_t *state, const char *commands[], const char *mode, unsigned producers)
+{
+  packet_generator_init(1);
+  descriptor_rings_init(producers);
+  replay_init(&g_replay);
+
+  bench_init_state(state);
+  for (unsigned i = 0; commands[i]; i++)
+    bench_send_command(state, commands[i]);
+  bench_send_command(state, mode);
+  bench_send_command(state, "e");
+}
+
+static void run_generated(generator_state_t *state, unsigned num_frames, int analyse)
+{
+  unsigned length_in_bytes;
+  uintptr_t dptr;
+
+  for (unsigned i = 0; i < num_frames; i++) {
+    if (!descriptor_rings_acquire(state->producer, &dptr)) {
+      descriptor_rings_take(&dptr, &length_in_bytes);
+      transmit(dptr, length_in_bytes, analyse);
+      descriptor_rings_release(dptr);
+      descriptor_rings_acquire(state->producer, &dptr);
+    }
+    descriptor_rings_submit(state->producer, dptr, bench_fill_buffer(state, dptr));
+  }
+
+  while (descriptor_rings_take(&dptr, &length_in_bytes)) {
+    transmit(dptr, length_in_bytes, analyse);
+    descriptor_rings_release(dptr);
+  }
+}
+
+/* The generator fills the ring and the transmitter keeps it, as the tasks do. Returns the frames filled */
+static unsigned fill_ring(generator_state_t *state)
+{
+  unsigned length_in_bytes;
+  unsigned filled = 0;
+  uintptr_t dptr;
+
+  while (!g_replay.complete && descriptor_rings_acquire(state->producer, &dptr)) {
+    descriptor_rings_submit(state->producer, dptr, bench_fill_buffer(state, dptr));
+    filled++;
+    while (descriptor_rings_take(&dptr, &length_in_bytes)) {
+      if (!(length_in_bytes & BUFFER_REPLAY) || !replay_add(&g_replay, dptr, length_in_bytes))
+        descriptor_rings_release(dptr);
+    }
+  }
+  return filled;
+}
+
+/* Send from the ring, the clock moving straight on to each frame's time */
+static void run_replay(unsigned num_frames, int analyse)
+{
+  static unsigned now = 0;
+  unsigned length_in_bytes;
+  unsigned tx_class;
+  uintptr_t dptr;
+
+  for (unsigned i = 0; i < num_frames; ) {
+    unsigned wake_time = now;
+    if (replay_next(&g_replay, now, &dptr, &length_in_bytes, &tx_class, &wake_time)) {
+      transmit(dptr, length_in_bytes, analyse);
+      i++;
+    } else {
+      now = wake_time;
+    }
+  }
+}
+
+static void run(generator_state_t *state, replay_run_t replay_run, unsigned num_frames, int analyse)
+{
+  if (replay_run == REPLAY_GENERATED)
+    run_generated(state, num_frames, analyse);
+  else
+    run_replay(num_frames, analyse);
+}
+
+static const char *replay_mode(replay_run_t replay_run)
+{
+  static char mode[COMMAND_BYTES];
+
+  if (replay_run == REPLAY_GENERATED)
+    return "m d";
+  // As the host controller sends it, with whether to number the frames
+  snprintf(mode, sizeof(mode), "m p %d %d", REPLAY_MAX_FRAMES, replay_run == REPLAY_NUMBERED);
+  return mode;
+}
+
+/* Leave replay mode as the transmitter sees it, and count the buffers that can be acquired again */
+static unsigned buffers_returned(generator_state_t *state)
+{
+  unsigned returned = 0;
+  uintptr_t dptr;
+
+  bench_send_command(state, "m s");
+  while (replay_release(&g_replay, 0, &dptr))
+    descriptor_rings_release(dptr);
+  while (descriptor_rings_acquire(state->producer, &dptr))
+    returned++;
+  return returned;
+}
+
+/*
+ * Ask for the ring again while it holds the first producer's whole share of the
+ * pool, which it can only fill again once the transmitter hands the ring back.
+ * Returns the frames of the new ring filled.
+ */
+static unsigned refill_full_ring(void)
+{
+  generator_state_t state;
+  uintptr_t dptr;
+
+  setup(&state, unicast_commands, replay_mode(REPLAY_NUMBERED), GENERATOR_PRODUCERS);
+  fill_ring(&state);
+
+  // The transmitter looks for a ring to hand back between frames
+  bench_send_command(&state, replay_mode(REPLAY_NUMBERED));
+  while (replay_release(&g_replay, 0, &dptr))
+    descriptor_rings_release(dptr);
+  return fill_ring(&state);
+}
+
+void bench_replay_report(unsigned num_frames)
+{
+  printf("\nReplay of a ring of %d 64 byte unicast frames\n", REPLAY_MAX_FRAMES);
+  printf("%-22s %12s %10s\n", "frames from", "frames/s", "ns/frame");
+
+  for (replay_run_t replay_run = REPLAY_GENERATED; replay_run <= REPLAY_UNCHANGED; replay_run++) {
+    generator_state_t state;
+
+    setup(&state, unicast_commands, replay_mode(replay_run), 1);
+    if (replay_run != REPLAY_GENERATED)
+      fill_ring(&state);
+
+    run(&state, replay_run, num_frames / 10, 0);
+    sim_mac_reset();
+
+    uint64_t start = sim_time_ns();
+    run(&state, replay_run, num_frames, 0);
+    uint64_t elapsed = sim_time_ns() - start;
+
+    printf("%-22s %12.0f %10.1f\n", replay_names[replay_run],
+        g_sim_mac.frames / (elapsed / 1e9), (double)elapsed / g_sim_mac.frames);
+  }
+
+  printf("Mixed types, %d passes: ", REPLAY_PASSES);
+  for (replay_run_t replay_run = REPLAY_NUMBERED; replay_run <= REPLAY_UNCHANGED; replay_run++) {
+    generator_state_t state;
+
+    setup(&state, mixed_commands, replay_mode(replay_run), 1);
+    fill_ring(&state);
+    rx_analyzer_reset();
+    run(&state, replay_run, REPLAY_PASSES * g_replay.count, 1);
+
+    printf("%s%s %u lost, %u reordered, %u dups", (replay_run == REPLAY_NUMBERED) ? "" : "; ",
+        replay_names[replay_run], bench_rx_count(g_traffic_stats.rx_lost),
+        bench_rx_count(g_traffic_stats.rx_reordered), bench_rx_count(g_traffic_stats.rx_duplicates));
+    printf(", %u of %d buffers returned", buffers_returned(&state), BUFFER_COUNT);
+  }
+  printf("\n");
+
+  printf("Asked again while holding a producer's whole share: %u of %d frames filled\n",
+      refill_full_ring(), REPLAY_MAX_FRAMES);
+}
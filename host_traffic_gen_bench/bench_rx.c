@@ -0,0 +1,192 @@
+/*
+ * Receive analysis report.
+ *
+ * Feeds generated frames through rx_analyzer_frame() with known impairments: one
+ * frame in every RX_IMPAIR_EVERY is dropped, one delivered after its successor,
+ * one delivered twice and one has a payload word corrupted. The counts from the
+ * analyzer are compared with those expected and the cost of the analysis per
+ * frame is found by timing the same run with and without it.
+ *
+ * Each frame is given a latency from a fixed delay, a uniform spread and an
+ * occasional long tail, and the latency report is compared with the exact
+ * figures worked out from all the latencies.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packet_generator.h"
+#include "buffers.h"
+#include "payload.h"
+#include "rx_analyzer.h"
+#include "traffic_stats.h"
+#include "latency.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+#define RX_IMPAIR_EVERY 1000
+#define RX_DROP      999
+#define RX_REORDER   500
+#define RX_DUPLICATE 250
+#define RX_CORRUPT   750
+
+// Enough buffers that a held back frame is not overwritten before it is delivered
+#define RX_BUFFERS 4
+
+// Latencies in ticks: a fixed delay, a uniform spread and one frame in RX_TAIL_EVERY delayed further
+#define RX_DELAY 5000
+#define RX_SPREAD 2000
+#define RX_TAIL_EVERY 500
+#define RX_TAIL 20000
+
+static unsigned *g_latencies = NULL;
+static unsigned g_num_latencies = 0;
+static unsigned g_latency_random = 1;
+
+typedef struct rx_expected_t {
+  unsigned frames;
+  unsigned lost;
+  unsigned reordered;
+  unsigned duplicates;
+  unsigned pattern_errors;
+} rx_expected_t;
+
+/* The transmitter stamps each frame as it sends it and the MAC copies it into the client's buffer */
+static void deliver(const unsigned char *buffer, unsigned length_in_bytes, int corrupt, int analyse)
+{
+  static unsigned rxbuf[MAX_BUFFER_SIZE / sizeof(unsigned)];
+  static unsigned tx_time = 0;
+  unsigned nbytes = length_in_bytes - BUFFER_OVERHEAD_BYTES;
+
+  g_latency_random = g_latency_random * 1103515245 + 12345;
+  unsigned latency = RX_DELAY + (g_latency_random >> 8) % RX_SPREAD;
+  if ((g_latency_random >> 4) % RX_TAIL_EVERY == 0)
+    latency += RX_TAIL;
+  tx_time += 1000;
+
+  memcpy(rxbuf, buffer + BUFFER_OVERHEAD_BYTES, nbytes);
+  rxbuf[FRAME_TIMESTAMP_WORD] = tx_time;
+  if (corrupt)
+    rxbuf[PAYLOAD_START_WORD] ^= 1;
+  if (analyse) {
+    rx_analyzer_frame(rxbuf, nbytes, tx_time + latency);
+    g_latencies[g_num_latencies++] = latency;
+  }
+}
+
+static int compare_unsigned(const void *a, const void *b)
+{
+  unsigned x = *(const unsigned *)a;
+  unsigned y = *(const unsigned *)b;
+  return (x > y) - (x < y);
+}
+
+static unsigned exact_percentile(unsigned thousandths)
+{
+  unsigned index = ((unsigned long long)g_num_latencies * thousandths + 999) / 1000;
+  return g_latencies[index ? index - 1 : 0];
+}
+
+static uint64_t run(generator_state_t *state, unsigned num_frames, int analyse, rx_expected_t *expected)
+{
+  static unsigned buffers[RX_BUFFERS][MAX_BUFFER_SIZE / sizeof(unsigned)];
+  const unsigned char *held = NULL;
+  unsigned held_length = 0;
+
+  memset(expected, 0, sizeof(*expected));
+  uint64_t start = sim_time_ns();
+
+  for (unsigned i = 0; i < num_frames; i++) {
+    unsigned char *buffer = (unsigned char *)buffers[i % RX_BUFFERS];
+    unsigned length_in_bytes = bench_fill_buffer(state, (uintptr_t)buffer);
+
+    switch (i % RX_IMPAIR_EVERY) {
+      case RX_DROP:
+        // A loss is only seen once a later frame arrives
+        if (i + 1 < num_frames)
+          expected->lost++;
+        continue;
+      case RX_REORDER:
+        held = buffer;
+        held_length = length_in_bytes;
+        expected->reordered++;
+        continue;
+      case RX_DUPLICATE:
+        deliver(buffer, length_in_bytes, 0, analyse);
+        expected->frames++;
+        expected->duplicates++;
+        break;
+      case RX_CORRUPT:
+        expected->pattern_errors++;
+        break;
+    }
+
+    deliver(buffer, length_in_bytes, (i % RX_IMPAIR_EVERY) == RX_CORRUPT, analyse);
+    expected->frames++;
+
+    if (held) {
+      deliver(held, held_length, 0, analyse);
+      expected->frames++;
+      held = NULL;
+    }
+  }
+
+  return sim_time_ns() - start;
+}
+
+void bench_rx_report(unsigned num_frames)
+{
+  generator_state_t state;
+  rx_expected_t expected;
+
+  bench_init_state(&state);
+  bench_send_command(&state, "c u 100 64 1518 p");
+  bench_send_command(&state, "c m 0");
+  bench_send_command(&state, "c b 0");
+  bench_send_command(&state, "v u q 100 5 10 3");
+  bench_send_command(&state, "v u c 1 4094 0 7");
+  bench_send_command(&state, "r * b 1 0");
+  bench_send_command(&state, "m d");
+  bench_send_command(&state, "e");
+
+  // Every frame can be delivered twice
+  g_latencies = malloc(2 * num_frames * sizeof(unsigned));
+  g_num_latencies = 0;
+
+  // The swap has reset the analyzer, so only the second run is counted
+  uint64_t without = run(&state, num_frames, 0, &expected);
+  uint64_t with = run(&state, num_frames, 1, &expected);
+
+  printf("\nReceive analysis (%u double tagged PRBS-31 frames of 64-1518 bytes, 1 in %d impaired each way)\n",
+      num_frames, RX_IMPAIR_EVERY);
+  printf("%-16s %10s %10s\n", "count", "expected", "analyzer");
+  printf("%-16s %10u %10u\n", "frames", expected.frames, g_traffic_stats.rx_frames[TYPE_UNICAST]);
+  printf("%-16s %10u %10u\n", "lost", expected.lost, g_traffic_stats.rx_lost[TYPE_UNICAST]);
+  printf("%-16s %10u %10u\n", "reordered", expected.reordered, g_traffic_stats.rx_reordered[TYPE_UNICAST]);
+  printf("%-16s %10u %10u\n", "duplicates", expected.duplicates, g_traffic_stats.rx_duplicates[TYPE_UNICAST]);
+  printf("%-16s %10u %10u\n", "pattern errors", expected.pattern_errors, g_traffic_stats.rx_pattern_errors[TYPE_UNICAST]);
+  printf("%-16s %10s %10u\n", "restarts", "0", g_traffic_stats.rx_restarts);
+  printf("Analysis costs %.1f ns/frame\n", (double)(with - without) / expected.frames);
+
+  latency_report_t report;
+  unsigned long long total = 0;
+  for (unsigned i = 0; i < g_num_latencies; i++)
+    total += g_latencies[i];
+  qsort(g_latencies, g_num_latencies, sizeof(unsigned), compare_unsigned);
+  latency_get_report(TYPE_UNICAST, &report);
+
+  printf("\nLatency (%u tick buckets, %u beyond the last)\n", report.bucket_ticks, report.overflows);
+  printf("%-16s %10s %10s\n", "ticks", "exact", "reported");
+  printf("%-16s %10u %10u\n", "min", g_latencies[0], report.min);
+  printf("%-16s %10llu %10u\n", "mean", total / g_num_latencies, report.mean);
+  printf("%-16s %10u %10u\n", "max", g_latencies[g_num_latencies - 1], report.max);
+  printf("%-16s %10u %10u\n", "50%", exact_percentile(500), report.p50);
+  printf("%-16s %10u %10u\n", "99%", exact_percentile(990), report.p99);
+  printf("%-16s %10u %10u\n", "99.9%", exact_percentile(999), report.p999);
+  free(g_latencies);
+
+  // Leave the following reports with the default payload and untagged frames
+  bench_send_command(&state, "c u 100 64 1518 i");
+  bench_send_command(&state, "v u d");
+  bench_send_command(&state, "e");
+}
@@ -0,0 +1,146 @@
+/*
+ * Scenario timing report.
+ *
+ * Uploads a looping rate ramp with a burst phase, as the host controller does for
+ * a scenario file, and steps it as the control task does on its timer.
+ * Each phase should start exactly when the durations before it add up to, however
+ * long the scenario runs, as the device times every wait from the end of the one
+ * before rather than from when it got round to it. Phases longer than a timer
+ * comparison can reach are waited for in several parts.
+ *
+ * Time is simulated in 100MHz reference timer ticks. The cost of a phase change,
+ * applying its changes and preparing the configuration, is timed for real.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "packet_generator.h"
+#include "packet_controller.h"
+#include "scenario.h"
+#include "generator_config.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+#define SCENARIO_LOOPS 2
+#define TICKS_PER_SEC 100000000.0
+
+typedef struct phase_config_t {
+  double seconds;
+  double rate_percent; // Of the unicast frames, 0 for the line rate
+  const char *mode;
+} phase_config_t;
+
+static const phase_config_t phases[] = {
+  { 30, 10,  "m d" },
+  { 30, 40,  NULL },
+  { 30, 70,  NULL },
+  { 30, 0,   NULL },
+  { 1,  0,   "m b 32 100000" },
+};
+
+#define NUM_PHASES (sizeof(phases) / sizeof(phases[0]))
+
+static const char *mode_names[] = { "silent", "random", "directed", "burst" };
+
+static void stage(command_batch_t *batch, const char *command)
+{
+  command_stage(batch, (const unsigned char *)command);
+}
+
+static void upload_scenario(generator_state_t *state)
+{
+  static command_batch_t batch;
+  char command[COMMAND_BYTES];
+
+  command_batch_clear(&batch);
+  for (unsigned i = 0; i < NUM_PHASES; i++) {
+    snprintf(command, sizeof(command), "n p %u", (unsigned)(phases[i].seconds * 1000));
+    stage(&batch, command);
+
+    // The first phase sets everything the others change, so the loop starts the same way
+    if (i == 0) {
+      stage(&batch, "c u 100 512 512");
+      stage(&batch, "c m 0");
+      stage(&batch, "c b 0");
+    }
+    if (phases[i].rate_percent) {
+      // The same conversion the host controller does for the line rate command
+      double ticks_per_bit = 100.0 / phases[i].rate_percent;
+      unsigned ticks_hi = (unsigned)ticks_per_bit;
+      unsigned ticks_lo = (unsigned)((ticks_per_bit - ticks_hi) * 4294967296.0);
+      snprintf(command, sizeof(command), "r u b %x %x", ticks_hi, ticks_lo);
+    } else {
+      snprintf(command, sizeof(command), "r u l");
+    }
+    stage(&batch, command);
+    if (phases[i].mode)
+      stage(&batch, phases[i].mode);
+  }
+  bench_upload(state, &batch, CMD_SCENARIO);
+}
+
+static void print_phase(unsigned count, double start, double expected, unsigned waits)
+{
+  const rate_t *rate = &config_settings()->types[TYPE_UNICAST].rate;
+  char rate_text[32];
+
+  if (rate->mode == RATE_PER_BIT)
+    snprintf(rate_text, sizeof(rate_text), "%.2f", 100.0 / (rate->ticks_hi + rate->ticks_lo / 4294967296.0));
+  else
+    snprintf(rate_text, sizeof(rate_text), "line");
+
+  printf("%6d %6d %12.3f %12.3f %8d %10s %10s\n", count, scenario_get_phase() + 1, start, expected, waits,
+      rate_text, mode_names[get_generator_mode()]);
+}
+
+void bench_scenario_report(void)
+{
+  generator_state_t state;
+  unsigned long long now = 0;
+  double expected = 0;
+  unsigned waits = 0;
+  unsigned changes = 0;
+  uint64_t change_ns = 0;
+
+  printf("\nScenario timing (%d phases looped %d times, waits of at most %d ms)\n",
+      (int)NUM_PHASES, SCENARIO_LOOPS, SCENARIO_MAX_WAIT_MS);
+  printf("%6s %6s %12s %12s %8s %10s %10s\n", "step", "phase", "start s", "expected s", "waits", "rate%", "mode");
+
+  bench_init_state(&state);
+  upload_scenario(&state);
+  bench_send_command(&state, "n l");
+  if (!scenario_start_requested()) {
+    printf("The scenario did not start\n");
+    return;
+  }
+
+  while (changes < SCENARIO_LOOPS * NUM_PHASES) {
+    unsigned phase = scenario_get_phase();
+    unsigned wait_ticks = 0;
+
+    // The generator takes up each phase before the next step
+    generator_update(state.producer, &state.generator_mode, &state.ctrl_ptr);
+
+    uint64_t start = sim_time_ns();
+    if (!scenario_step(&wait_ticks))
+      break;
+    uint64_t elapsed = sim_time_ns() - start;
+
+    if (!changes || (scenario_get_phase() != phase)) {
+      if (changes)
+        expected += phases[phase].seconds;
+      print_phase(changes + 1, now / TICKS_PER_SEC, expected, waits);
+      change_ns += elapsed;
+      changes++;
+      waits = 0;
+    }
+    now += wait_ticks;
+    waits++;
+  }
+
+  printf("A phase change costs %.0f ns\n", (double)change_ns / changes);
+
+  // Leave the following reports without a scenario and silent
+  bench_send_command(&state, "n s");
+  scenario_load(NULL, 0);
+}
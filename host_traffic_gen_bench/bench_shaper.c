@@ -0,0 +1,187 @@
+/*
+ * Traffic class shaping report.
+ *
+ * Simulates the transmitter of packet_transmitter.xc with its queue per traffic
+ * class, fed by the generator from the buffer pool, and compares the rate each
+ * class achieves with the rate its packet type asks for and the rate reserved for
+ * it. Also reports how long the frames of each class waited after their place in
+ * the schedule.
+ *
+ * Time is simulated in 100MHz reference timer ticks as in bench_pacing.c. The
+ * generator fills a buffer as soon as one is free and a frame takes its time on the
+ * wire to send plus a fixed software overhead.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "packet_generator.h"
+#include "buffers.h"
+#include "shaper.h"
+#include "bench.h"
+
+#define SHAPING_FRAMES 200000
+#define SHAPING_FRAME_BYTES 512
+
+/* Ticks spent per frame outside the wait and the send */
+#define SIM_OVERHEAD_TICKS 100
+
+/* Preamble, CRC and minimum inter-frame gap in addition to the frame bytes */
+#define WIRE_OVERHEAD_BYTES (8 + 4 + 12)
+
+typedef struct shaping_config_t {
+  const char *name;
+  double rate_percent[TRAFFIC_GEN_TYPES];     // The rate of each packet type, 0 for the line rate
+  int weight[TRAFFIC_GEN_TYPES];
+  double reserved_percent[TX_CLASSES];        // 0 leaves the class unshaped
+} shaping_config_t;
+
+/*
+ * Unicast is sent from class A, multicast from class B and broadcast as best effort,
+ * which always has frames to fill the line.
+ */
+static const shaping_config_t shaping_configs[] = {
+  { "within-reservation", { 20, 30, 0 }, { 22, 32, 46 }, { 0, 35, 25 } },
+  { "a-over-reservation", { 0, 30, 0 },  { 40, 30, 30 }, { 0, 35, 25 } },
+  { "a-unshaped",         { 0, 30, 0 },  { 40, 30, 30 }, { 0, 35, 0 } },
+};
+
+#define NUM_SHAPING_CONFIGS (sizeof(shaping_configs) / sizeof(shaping_configs[0]))
+
+static const char *class_names[TX_CLASSES] = { "best effort", "B", "A" };
+
+static void send_rate(generator_state_t *state, char type, double percent)
+{
+  char command[COMMAND_BYTES];
+
+  if (percent == 0) {
+    snprintf(command, sizeof(command), "r %c l", type);
+  } else {
+    // The same conversion the host controller does for the line rate command
+    double ticks_per_bit = 100.0 / percent;
+    unsigned ticks_hi = (unsigned)ticks_per_bit;
+    unsigned ticks_lo = (unsigned)((ticks_per_bit - ticks_hi) * 4294967296.0);
+    snprintf(command, sizeof(command), "r %c b %x %x", type, ticks_hi, ticks_lo);
+  }
+  bench_send_command(state, command);
+}
+
+static void configure(generator_state_t *state, const shaping_config_t *config)
+{
+  static const char type_chars[TRAFFIC_GEN_TYPES] = { 'u', 'm', 'b' };
+  static const char class_chars[TRAFFIC_GEN_TYPES] = { 'a', 'b', 'e' };
+  char command[COMMAND_BYTES];
+
+  bench_init_state(state);
+  for (int i = 0; i < TRAFFIC_GEN_TYPES; i++) {
+    snprintf(command, sizeof(command), "c %c %d %d %d", type_chars[i], config->weight[i],
+        SHAPING_FRAME_BYTES, SHAPING_FRAME_BYTES);
+    bench_send_command(state, command);
+    bench_send_command(state, (i == 0) ? "v u d" : (i == 1) ? "v m d" : "v b d");
+    send_rate(state, type_chars[i], config->rate_percent[i]);
+    snprintf(command, sizeof(command), "k c %c %c", type_chars[i], class_chars[i]);
+    bench_send_command(state, command);
+  }
+  bench_send_command(state, "r * b 1 0");
+
+  // The same conversion the host controller does for the reservation command
+  for (int c = TX_CLASS_B; c <= TX_CLASS_A; c++) {
+    unsigned slope = (unsigned)(config->reserved_percent[c] / 100 * SHAPER_SLOPE_ONE + 0.5);
+    snprintf(command, sizeof(command), "k s %c %x", (c == TX_CLASS_A) ? 'a' : 'b', slope);
+    bench_send_command(state, command);
+  }
+
+  bench_send_command(state, "m d");
+  bench_send_command(state, "e");
+}
+
+/* Fill a free buffer with the next frame and pass it to the transmitter's queues */
+static void generate(generator_state_t *state, shaper_t *shaper, uintptr_t dptr, unsigned now)
+{
+  unsigned len = 0;
+  pkt_ctrl_t *packet = NULL;
+
+  generator_update(state->producer, &state->generator_mode, &state->ctrl_ptr);
+  while (!packet) {
+    packet = choose_packet_type(state->producer, &state->r, state->ctrl_ptr, &len);
+    state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+  }
+  shaper_enqueue(shaper, dptr, gen_frame(state->producer, dptr, packet, len), now);
+}
+
+static void simulate(generator_state_t *state, const shaping_config_t *config)
+{
+  static unsigned buffers[BUFFER_COUNT][MAX_BUFFER_SIZE / sizeof(unsigned)];
+  static shaper_t shaper;
+  unsigned long long class_bits[TX_CLASSES] = { 0 };
+  unsigned max_wait[TX_CLASSES] = { 0 };
+  unsigned now = 0;
+  unsigned long long elapsed = 0;
+
+  memset(buffers, 0, sizeof(buffers));
+  shaper_init(&shaper);
+  for (unsigned i = 0; i < BUFFER_COUNT; i++)
+    generate(state, &shaper, (uintptr_t)buffers[i], now);
+
+  for (unsigned frames = 0; frames < SHAPING_FRAMES; ) {
+    uintptr_t dptr;
+    unsigned length_in_bytes;
+    unsigned tx_class;
+    unsigned wake_time = now;
+
+    now += SIM_OVERHEAD_TICKS;
+    elapsed += SIM_OVERHEAD_TICKS;
+    if (!shaper_next(&shaper, now, &dptr, &length_in_bytes, &tx_class, &wake_time)) {
+      // Only waits for the schedule or for credit, as the pool always holds frames
+      elapsed += wake_time - now;
+      now = wake_time;
+      continue;
+    }
+
+    unsigned wait = now - shaper.queue[tx_class].ready_time;
+    if ((int)wait > 0 && wait > max_wait[tx_class])
+      max_wait[tx_class] = wait;
+
+    unsigned wire_ticks = (length_in_bytes - BUFFER_OVERHEAD_BYTES + WIRE_OVERHEAD_BYTES) * 8;
+    class_bits[tx_class] += wire_ticks;
+    now += wire_ticks;
+    elapsed += wire_ticks;
+    frames++;
+
+    generate(state, &shaper, dptr, now);
+  }
+
+  for (int c = TX_CLASSES - 1; c >= 0; c--) {
+    // Each packet type is sent from its own class, unicast from A down to broadcast as best effort
+    double requested = config->rate_percent[TX_CLASS_A - c];
+    if (requested == 0)
+      requested = 100;
+    printf("%-20s %-12s %10.2f %10.2f %10.2f %12.2f\n", (c == TX_CLASSES - 1) ? config->name : "", class_names[c],
+        requested, config->reserved_percent[c], 100.0 * class_bits[c] / elapsed, max_wait[c] / 100.0);
+  }
+}
+
+void bench_shaping_report(void)
+{
+  printf("\nTraffic class shaping (%d byte frames, %d ticks overhead per frame)\n",
+      SHAPING_FRAME_BYTES, SIM_OVERHEAD_TICKS);
+  printf("%-20s %-12s %10s %10s %10s %12s\n", "config", "class", "rate%", "reserved%", "achieved%", "max wait us");
+
+  for (unsigned i = 0; i < NUM_SHAPING_CONFIGS; i++) {
+    generator_state_t state;
+    configure(&state, &shaping_configs[i]);
+    simulate(&state, &shaping_configs[i]);
+  }
+
+  // Leave the following reports with every type best effort and nothing reserved
+  generator_state_t state;
+  bench_init_state(&state);
+  bench_send_command(&state, "k c u e");
+  bench_send_command(&state, "k c m e");
+  bench_send_command(&state, "k c b e");
+  bench_send_command(&state, "k s a 0");
+  bench_send_command(&state, "k s b 0");
+  bench_send_command(&state, "r u l");
+  bench_send_command(&state, "r m l");
+  bench_send_command(&state, "r b l");
+  bench_send_command(&state, "e");
+}
@@ -0,0 +1,252 @@
+/*
+ * Host benchmark for the packet generation path.
+ *
+ * Builds the device generator sources natively and drives the same loop as
+ * listener_and_generator(), buffer_manager() and packet_transmitter() with the
+ * channels replaced by direct calls into the buffer library and the MAC replaced
+ * by a sink. The cost reported per frame is therefore the generator's own work
+ * plus the buffer handoff, which is what limits the achievable packet rate.
+ *
+ * The cost of the buffer handoff is reported by bench_handoff.c, the pacing
+ * accuracy of the transmitter by bench_pacing.c, its traffic class shaping by
+ * bench_shaper.c, the scenario timing by bench_scenario.c, the generation rate
+ * through a burst of host messages by bench_control.c and the receive analysis by
+ * bench_rx.c.
+ *
+ *  ./traffic_gen_bench [-n frames] [-c config] [-m all|throughput|handoff|pacing|shaping|scenario|control|rx]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "packet_generator.h"
+#include "packet_controller.h"
+#include "buffers.h"
+#include "c_utils.h"
+#include "sim_platform.h"
+#include "bench.h"
+
+#define DEFAULT_FRAMES 2000000
+
+typedef struct bench_config_t {
+  const char *name;
+  const char *commands[MAX_COMMANDS];
+  unsigned flows; // Unicast flows added before the commands, each with its own address and weight
+} bench_config_t;
+
+/* Each configuration is applied using the same commands the host controller sends */
+static const bench_config_t configs[] = {
+  { "unicast-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL } },
+  { "unicast-1518",
+    { "c u 100 1518 1518", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL } },
+  { "vlan-unicast-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u e 10 3", "r * b 1 0", "m d", "e", NULL } },
+  { "qinq-unicast-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u q 100 5 10 3", "r * b 1 0", "m d", "e", NULL } },
+  { "vlan-cycle-unicast-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u e 10 3", "v u c 1 4094 0 7", "r * b 1 0", "m d", "e", NULL } },
+  { "vlan-table-unicast-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u t 10 0 1 20 3 2 30 5 4 40 7 8", "r * b 1 0", "m d", "e", NULL } },
+  { "mixed-64-1518",
+    { "c u 35 64 1518", "c m 30 64 1518", "c b 35 64 1518", "v u d", "r * b 1 0", "m d", "e", NULL } },
+  { "mixed-64-1518-50pc",
+    { "c u 35 64 1518", "c m 30 64 1518", "c b 35 64 1518", "v u d", "r * b 2 0", "m d", "e", NULL } },
+  { "mixed-64-1518-50pc-exp",
+    { "c u 35 64 1518", "c m 30 64 1518", "c b 35 64 1518", "v u d", "r * b 2 0", "g e", "m d", "e", NULL } },
+  { "imix",
+    { "c u 100 64 1518", "z u a 64 7 570 4 1518 1", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL } },
+  { "burst-32-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u d", "r * b 1 0", "m b 32 1000", "e", NULL } },
+  { "flows-4-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL }, 4 },
+  { "flows-max-64",
+    { "c u 100 64 64", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL }, MAX_FLOWS },
+  // The payload pattern and address sweeps are kept by later commands that do not give
+  // them, so these run last
+  { "unicast-1518-prbs31",
+    { "c u 100 1518 1518 p", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL } },
+  { "unicast-1518-random",
+    { "c u 100 1518 1518 r", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL } },
+  { "unicast-1518-incr",
+    { "c u 100 1518 1518 i", "c m 0", "c b 0", "v u d", "r * b 1 0", "m d", "e", NULL } },
+  { "unicast-64-mac-sweep",
+    { "c u 100 64 64 i", "c m 0", "c b 0", "v u d", "w u d s f4240 1", "w u s r ffffff", "r * b 1 0", "m d", "e", NULL } },
+  { "random-mode",
+    { "r * b 1 0", "m r", "e", NULL } },
+};
+
+#define NUM_CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+/*
+ * Generate the requested number of frames. The generator keeps producing until
+ * the pool runs dry, at which point the transmitter sends the oldest frame and
+ * returns its buffer, so every buffer in the pool is cycled through.
+ */
+static void run_frames(generator_state_t *state, unsigned num_frames)
+{
+  buffers_free_t free_buffers;
+  buffers_used_t used_buffers;
+  pkt_ctrl_t *packet = NULL;
+  unsigned len = 0;
+  unsigned frames = 0;
+
+  buffers_free_initialise(&free_buffers);
+  buffers_used_initialise(&used_buffers);
+
+  while (frames < num_frames) {
+    if (generator_update(state->producer, &state->generator_mode, &state->ctrl_ptr))
+      packet = NULL;
+    if (!packet)
+      packet = choose_packet_type(state->producer, &state->r, state->ctrl_ptr, &len);
+
+    if (!packet) {
+      state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+      continue;
+    }
+
+    // Generator: c_prod handoff
+    uintptr_t dptr = buffers_free_acquire(&free_buffers);
+    unsigned length_in_bytes;
+    if (state->generator_mode == GENERATOR_BURST)
+      length_in_bytes = gen_burst_frame(state->producer, dptr, packet, len);
+    else
+      length_in_bytes = gen_frame(state->producer, dptr, packet, len);
+    buffers_used_add(&used_buffers, dptr, length_in_bytes);
+    state->ctrl_ptr = choose_next(&state->r, state->ctrl_ptr);
+    packet = NULL;
+    frames++;
+
+    // Transmitter: c_con handoff and buffer release
+    if (buffers_used_full(&used_buffers) || free_buffers.top_index == 0) {
+      dptr = buffers_used_take(&used_buffers, &length_in_bytes);
+      length_in_bytes &= BUFFER_LENGTH_MASK;
+      send_ether_frame(0, dptr + BUFFER_OVERHEAD_BYTES, length_in_bytes - BUFFER_OVERHEAD_BYTES);
+      buffers_free_release(&free_buffers, dptr);
+    }
+  }
+
+  while (used_buffers.head_index != used_buffers.tail_index) {
+    unsigned length_in_bytes;
+    uintptr_t dptr = buffers_used_take(&used_buffers, &length_in_bytes);
+    length_in_bytes &= BUFFER_LENGTH_MASK;
+    send_ether_frame(0, dptr + BUFFER_OVERHEAD_BYTES, length_in_bytes - BUFFER_OVERHEAD_BYTES);
+    buffers_free_release(&free_buffers, dptr);
+  }
+}
+
+static void run_config(const bench_config_t *config, unsigned num_frames)
+{
+  generator_state_t state;
+  bench_init_state(&state);
+
+  // Flows carry over from one configuration to the next, so are replaced for each one
+  bench_send_command(&state, "f c");
+  for (unsigned i = 0; i < config->flows; i++) {
+    char command[COMMAND_BYTES];
+    snprintf(command, sizeof(command), "f a u 00:22:97:00:%02x:%02x 00:00:00:00:00:00 %d %d 0 0 0 0 %d",
+        i >> 8, i & 0xff, i & 1, i, i + 1);
+    bench_send_command(&state, command);
+  }
+
+  for (int i = 0; config->commands[i]; i++)
+    bench_send_command(&state, config->commands[i]);
+
+  // Warm the caches and branch predictors before timing
+  run_frames(&state, num_frames / 10);
+  sim_mac_reset();
+
+  uint64_t start = sim_time_ns();
+  run_frames(&state, num_frames);
+  uint64_t elapsed = sim_time_ns() - start;
+
+  double seconds = elapsed / 1e9;
+  printf("%-22s %12.0f %10.1f %14.0f %10.1f\n", config->name,
+      g_sim_mac.frames / seconds,
+      (double)elapsed / g_sim_mac.frames,
+      g_sim_mac.bytes / seconds,
+      (double)g_sim_mac.bytes / g_sim_mac.frames);
+}
+
+static void usage(char *argv[])
+{
+  printf("Usage: %s [-n frames] [-c config] [-m mode]\n", argv[0]);
+  printf("  -n frames :   The number of frames to time per configuration (default %d)\n", DEFAULT_FRAMES);
+  printf("  -c config :   Only run the named throughput configuration, one of:\n");
+  for (unsigned i = 0; i < NUM_CONFIGS; i++)
+    printf("                  %s\n", configs[i].name);
+  printf("  -m mode   :   Run (all) reports (default), or only (throughput), (handoff), (pacing), (shaping),\n");
+  printf("                (scenario), (control), (rx), (replay), (pcap) or (producers)\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned num_frames = DEFAULT_FRAMES;
+  const char *only = NULL;
+  const char *mode = "all";
+  int c = 0;
+
+  while ((c = getopt(argc, argv, "n:c:m:")) != -1) {
+    switch (c) {
+      case 'n':
+        num_frames = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        only = optarg;
+        break;
+      case 'm':
+        mode = optarg;
+        break;
+      default:
+        usage(argv);
+    }
+  }
+
+  if (num_frames == 0)
+    usage(argv);
+
+  packet_generator_init(1);
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "throughput")) {
+    printf("Generation throughput\n");
+    printf("%-22s %12s %10s %14s %10s\n", "config", "frames/s", "ns/frame", "bytes/s", "avg bytes");
+    for (unsigned i = 0; i < NUM_CONFIGS; i++) {
+      if (only && strcmp(only, configs[i].name))
+        continue;
+      run_config(&configs[i], num_frames);
+    }
+  }
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "handoff"))
+    bench_handoff_report(num_frames);
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "pacing")) {
+    bench_pacing_report();
+    bench_gap_report();
+  }
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "shaping"))
+    bench_shaping_report();
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "scenario"))
+    bench_scenario_report();
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "control"))
+    bench_control_report();
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "rx"))
+    bench_rx_report(num_frames);
+
+  if (!strcmp(mode, "all") || !strcmp(mode, "replay"))
+    bench_replay_report(num_frames);
+  if (!strcmp(mode, "all") || !strcmp(mode, "pcap"))
+    bench_pcap_report();
+
+  // Last, as it starts the generator again for each number of producers
+  if (!strcmp(mode, "all") || !strcmp(mode, "producers"))
+    bench_producers_report(num_frames);
+
+  return 0;
+}
@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for module_logging.
+ */
+#ifndef __DEBUG_PRINT_H__
+#define __DEBUG_PRINT_H__
+
+#include <stdio.h>
+
+#define debug_printf printf
+
+#endif /* __DEBUG_PRINT_H__ */
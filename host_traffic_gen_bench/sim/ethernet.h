@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for module_ethernet. mac_tx() is implemented by the simulated
+ * MAC sink in sim_platform.c.
+ */
+#ifndef __ETHERNET_H__
+#define __ETHERNET_H__
+
+#include <xccompat.h>
+
+#define ETH_BROADCAST (-1)
+
+void mac_tx(chanend c_mac, unsigned int buffer[], int nbytes, int ifnum);
+
+#endif /* __ETHERNET_H__ */
@@ -0,0 +1,7 @@
+/*
+ * Host stand-in for <platform.h>. Nothing is needed from it by the generator sources.
+ */
+#ifndef __PLATFORM_H__
+#define __PLATFORM_H__
+
+#endif /* __PLATFORM_H__ */
@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for module_random. Uses the same CRC32 based LFSR as the
+ * device so that the sequence of random numbers matches.
+ */
+#ifndef _random_h_
+#define _random_h_
+
+#include <xccompat.h>
+
+typedef unsigned random_generator_t;
+
+random_generator_t random_create_generator_from_seed(unsigned seed);
+unsigned random_get_random_number(REFERENCE_PARAM(random_generator_t, g));
+
+#endif /* _random_h_ */
@@ -0,0 +1,66 @@
+/*
+ * Host implementations of the device services used by the generator sources:
+ * the module_random LFSR, a MAC sink standing in for mac_tx(), xscope and a clock.
+ */
+#include <string.h>
+#include <time.h>
+#include "random.h"
+#include "ethernet.h"
+#include "xscope.h"
+#include "sim_platform.h"
+
+#define random_poly 0xEDB88320
+
+sim_mac_stats_t g_sim_mac;
+sim_xscope_hook_t g_sim_xscope_hook = NULL;
+
+/* The MAC copies each frame into its own buffer before putting it on the wire */
+static unsigned int mac_buffer[1600 / sizeof(unsigned int)];
+
+/* Equivalent of the xCORE crc32 instruction */
+static unsigned crc32(unsigned checksum, unsigned data, unsigned poly)
+{
+  checksum ^= data;
+  for (int i = 0; i < 32; i++)
+    checksum = (checksum >> 1) ^ (poly & -(checksum & 1));
+  return checksum;
+}
+
+random_generator_t random_create_generator_from_seed(unsigned seed)
+{
+  random_generator_t g = seed;
+  random_get_random_number(&g);
+  return g;
+}
+
+unsigned random_get_random_number(random_generator_t *g)
+{
+  *g = crc32(*g, -1, random_poly);
+  return *g;
+}
+
+void mac_tx(chanend c_mac, unsigned int buffer[], int nbytes, int ifnum)
+{
+  memcpy(mac_buffer, buffer, nbytes);
+  g_sim_mac.frames++;
+  g_sim_mac.bytes += nbytes;
+  g_sim_mac.checksum += mac_buffer[0] ^ mac_buffer[(nbytes / sizeof(unsigned int)) - 1];
+}
+
+void xscope_bytes(unsigned char id, unsigned int length, const unsigned char data[])
+{
+  if (g_sim_xscope_hook)
+    g_sim_xscope_hook(id, length, data);
+}
+
+void sim_mac_reset(void)
+{
+  memset(&g_sim_mac, 0, sizeof(g_sim_mac));
+}
+
+uint64_t sim_time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
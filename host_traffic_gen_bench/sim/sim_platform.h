@@ -0,0 +1,27 @@
+/*
+ * Host implementations of the device services used by the generator sources.
+ */
+#ifndef __SIM_PLATFORM_H__
+#define __SIM_PLATFORM_H__
+
+#include <stdint.h>
+
+/* Everything the simulated MAC has been handed by send_ether_frame() */
+typedef struct sim_mac_stats_t {
+  uint64_t frames;
+  uint64_t bytes;
+  unsigned checksum;
+} sim_mac_stats_t;
+
+extern sim_mac_stats_t g_sim_mac;
+
+void sim_mac_reset(void);
+
+/* Called with what the device sends over xscope, when set */
+typedef void (*sim_xscope_hook_t)(unsigned char id, unsigned int length, const unsigned char data[]);
+extern sim_xscope_hook_t g_sim_xscope_hook;
+
+/* Monotonic time in nanoseconds */
+uint64_t sim_time_ns(void);
+
+#endif /* __SIM_PLATFORM_H__ */
@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for module_xassert.
+ */
+#ifndef __XASSERT_H__
+#define __XASSERT_H__
+
+#include <assert.h>
+
+#endif /* __XASSERT_H__ */
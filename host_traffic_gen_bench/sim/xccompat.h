@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for the xccompat.h shipped with the xTIMEcomposer tools so that
+ * the generator sources can be compiled with a native C compiler.
+ */
+#ifndef __XCCOMPAT_H__
+#define __XCCOMPAT_H__
+
+#include <stdint.h>
+
+typedef unsigned chanend;
+typedef unsigned streaming_chanend;
+typedef unsigned timer;
+typedef unsigned port;
+
+#define REFERENCE_PARAM(type, name) type *name
+#define NULLABLE_REFERENCE_PARAM(type, name) type *name
+#define NULLABLE_ARRAY_OF(type, name) type *name
+#define ARRAY_OF_SIZE(type, name, size) type *name
+#define CHANEND_PARAM(param, name) unsigned name
+
+#endif /* __XCCOMPAT_H__ */
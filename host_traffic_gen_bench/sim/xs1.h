@@ -0,0 +1,7 @@
+/*
+ * Host stand-in for <xs1.h>. Nothing is needed from it by the generator sources.
+ */
+#ifndef __XS1_H__
+#define __XS1_H__
+
+#endif /* __XS1_H__ */
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for <xscope.h>. Probe data is discarded unless a
+ * report sets g_sim_xscope_hook, see sim_platform.h.
+ */
+#ifndef __XSCOPE_H__
+#define __XSCOPE_H__
+
+void xscope_bytes(unsigned char id, unsigned int length, const unsigned char data[]);
+
+#endif /* __XSCOPE_H__ */